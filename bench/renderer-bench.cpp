@@ -0,0 +1,315 @@
+#include "renderer-bench.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+const std::vector<BenchScene> BenchScenes = {
+	// vertex and primitive throughput, one big draw
+	{ "many-triangles", 1000000, 1, 1, 0, 0, false, true },
+	// CPU recording and per draw overhead
+	{ "many-draws", 100000, 20000, 1, 0, 0, false, true },
+	// a small mesh drawn many times by a single draw
+	{ "instanced", 2000, 1, 500, 0, 0, false, true },
+	// hardly any vertices, but every instance covers most of the target
+	{ "fill-rate", 2, 1, 100, 0, 0, false, true },
+	// fill-rate without the depth test, so every instance is shaded and the overdraw the depth test saves shows up
+	{ "fill-rate-no-depth", 2, 1, 100, 0, 0, false, false },
+	// compute throughput, a million particles stepped by a compute shader and drawn as points
+	{ "particles", 1, 1, 1, 1000000, 0, false, true },
+	// the many-draws scene again, but culled and drawn indirectly so the CPU cost doesn't depend on the draw count
+	{ "gpu-culling", 100000, 20000, 1, 0, 0, true, true },
+	// per instance transforms, colours and materials from structure of arrays buffers, a single draw each
+	{ "instanced-10k", 1, 1, 1, 0, 10000, false, true },
+	{ "instanced-100k", 1, 1, 1, 0, 100000, false, true },
+	{ "instanced-1m", 1, 1, 1, 0, 1000000, false, true }
+};
+
+uint64_t BenchFrameCount = 300;
+// rendered before timing starts, so pipeline creation, first touches of memory etc. aren't measured
+uint64_t WarmupFrameCount = 30;
+std::vector<std::string> SelectedScenes;
+std::string OutputFilename = "bench-results.json";
+std::string TraceFilename;
+
+int main(int argc, char** argv) {
+	start_logger();
+
+	try {
+		parse_bench_arguments(argc, argv);
+
+		set_trace_thread_name("main");
+
+		// no window, so the runs are the same on a desktop, CI or a software rasteriser like lavapipe
+		Headless = true;
+		// for the overdraw, turned off again when creating the device if it can't count fragments
+		PipelineStatisticsEnabled = true;
+
+		std::vector<BenchResult> results;
+		for (const auto& scene : BenchScenes) {
+			if (!SelectedScenes.empty() &&
+				(std::find(SelectedScenes.begin(), SelectedScenes.end(), scene.name) == SelectedScenes.end())) {
+				continue;
+			}
+
+			results.push_back(run_scene(scene));
+		}
+
+		if (results.empty()) {
+			throw std::runtime_error("No scenes matched");
+		}
+
+		print_overdraw_reduction(results);
+
+		write_results(results, OutputFilename);
+
+		if (!TraceFilename.empty()) {
+			write_trace(TraceFilename);
+		}
+	} catch (const std::exception& error) {
+		LOG_ERROR("{}", error.what());
+		stop_logger();
+
+		return EXIT_FAILURE;
+	}
+
+	stop_logger();
+
+	return EXIT_SUCCESS;
+}
+
+void parse_bench_arguments(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+
+		if ((argument == "--frames") && (i + 1 < argc)) {
+			BenchFrameCount = parse_uint64_argument(argument, argv[++i]);
+		} else if ((argument == "--warmup") && (i + 1 < argc)) {
+			WarmupFrameCount = parse_uint64_argument(argument, argv[++i]);
+		} else if ((argument == "--scene") && (i + 1 < argc)) {
+			SelectedScenes.push_back(argv[++i]);
+		} else if ((argument == "--output") && (i + 1 < argc)) {
+			OutputFilename = argv[++i];
+		} else if ((argument == "--trace") && (i + 1 < argc)) {
+			TraceFilename = argv[++i];
+			start_tracing();
+		} else if ((argument == "--width") && (i + 1 < argc)) {
+			InitialWidth = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--height") && (i + 1 < argc)) {
+			InitialHeight = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--frames-in-flight") && (i + 1 < argc)) {
+			FramesInFlight = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--record-threads") && (i + 1 < argc)) {
+			RecordingThreadCount = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--log-level") && (i + 1 < argc)) {
+			MinimumLogLevel = parse_log_level(argv[++i]);
+		} else {
+			throw std::runtime_error("Unknown argument " + argument);
+		}
+	}
+
+	if (BenchFrameCount == 0) {
+		throw std::runtime_error("Need at least one frame to benchmark");
+	}
+}
+
+BenchResult run_scene(const BenchScene& scene) {
+	TRACE_ZONE("run_scene");
+
+	LOG_INFO("Running scene {}", scene.name);
+
+	MeshTriangleCount = scene.triangleCount;
+	DrawCount = scene.drawCount;
+	InstanceCount = scene.instanceCount;
+	ParticleCount = scene.particleCount;
+	InstancedObjectCount = scene.instancedObjectCount;
+	GpuCullingEnabled = scene.gpuCulling;
+	DepthTestEnabled = scene.depthTest;
+
+	// every scene gets a fresh renderer, so nothing one scene leaves behind skews the next
+	init_vulkan();
+
+	BenchResult result;
+	result.scene = scene;
+
+	result.deviceName = PhysicalDeviceCapabilities.properties.deviceName;
+
+	// an indirect draw of GPU culled draws counts as all of them, the particles as one draw and no instances
+	uint32_t batchCount = (InstancedObjects.instance_count() > 0) ? 1 : 0;
+	result.drawsPerFrame = DrawList.size() + batchCount + (Particles.is_enabled() ? 1 : 0);
+	result.instancesPerFrame = (uint64_t) DrawList.size() * InstanceCount + InstancedObjects.instance_count();
+
+	for (uint64_t i = 0; i < WarmupFrameCount; i++) {
+		draw_frame();
+	}
+	// so the GPU timings only cover the timed frames
+	Profiler.reset_statistics();
+
+	std::vector<double> frameTimes;
+	frameTimes.reserve(BenchFrameCount);
+
+	auto runStart = std::chrono::steady_clock::now();
+	auto previousFrameEnd = runStart;
+	for (uint64_t i = 0; i < BenchFrameCount; i++) {
+		draw_frame();
+
+		auto frameEnd = std::chrono::steady_clock::now();
+		frameTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - previousFrameEnd).count());
+		previousFrameEnd = frameEnd;
+	}
+
+	vkDeviceWaitIdle(Device);
+	double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+
+	result.frameCount = BenchFrameCount;
+	result.framesPerSecond = BenchFrameCount / runSeconds;
+	result.drawsPerSecond = result.drawsPerFrame * result.framesPerSecond;
+	result.instancesPerSecond = result.instancesPerFrame * result.framesPerSecond;
+	result.cpuFrame = summarise_timings(frameTimes);
+
+	for (const auto& scopeStatistics : Profiler.get_scope_statistics()) {
+		TimingSummary* summary = nullptr;
+		if (scopeStatistics.name == "frame") {
+			summary = &result.gpuFrame;
+		} else if (scopeStatistics.name == "particle simulation") {
+			summary = &result.gpuParticles;
+		} else if (scopeStatistics.name == "gpu culling") {
+			summary = &result.gpuCulling;
+		} else {
+			continue;
+		}
+
+		summary->sampleCount = scopeStatistics.sampleCount;
+		summary->minMs = scopeStatistics.minMs;
+		summary->averageMs = scopeStatistics.averageMs;
+		summary->maxMs = scopeStatistics.maxMs;
+		summary->p99Ms = scopeStatistics.p99Ms;
+	}
+
+	if (PipelineStatisticsEnabled) {
+		double pixelCount = (double) SurfaceExtent.width * SurfaceExtent.height;
+		result.overdraw = Profiler.get_pipeline_statistics().fragmentShaderInvocations / pixelCount;
+	}
+
+	cleanup();
+
+	LOG_INFO("{}: {} fps, {} ms/frame CPU, {} ms/frame GPU", scene.name, result.framesPerSecond, result.cpuFrame.averageMs,
+		result.gpuFrame.averageMs);
+	LOG_INFO("{}: {} draws/s, {} instances/s", scene.name, result.drawsPerSecond, result.instancesPerSecond);
+
+	return result;
+}
+
+TimingSummary summarise_timings(std::vector<double> samples) {
+	TimingSummary summary;
+	if (samples.empty()) return summary;
+
+	std::sort(samples.begin(), samples.end());
+
+	double total = 0.0;
+	for (double sample : samples) {
+		total += sample;
+	}
+
+	summary.sampleCount = (uint32_t) samples.size();
+	summary.minMs = samples.front();
+	summary.averageMs = total / samples.size();
+	summary.maxMs = samples.back();
+	// nearest rank
+	size_t p99Rank = (size_t) std::ceil(0.99 * samples.size());
+	summary.p99Ms = samples[std::max<size_t>(p99Rank, 1) - 1];
+
+	return summary;
+}
+
+static void write_timing_summary(std::ofstream& file, const TimingSummary& summary) {
+	if (summary.sampleCount == 0) {
+		file << "null";
+		return;
+	}
+
+	file << "{ \"samples\": " << summary.sampleCount << ", \"min\": " << summary.minMs << ", \"avg\": "
+		<< summary.averageMs << ", \"max\": " << summary.maxMs << ", \"p99\": " << summary.p99Ms << " }";
+}
+
+void print_overdraw_reduction(const std::vector<BenchResult>& results) {
+	const std::string suffix = "-no-depth";
+
+	for (const auto& withoutDepth : results) {
+		const std::string& name = withoutDepth.scene.name;
+		if ((name.size() <= suffix.size()) || (name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)) {
+			continue;
+		}
+
+		auto withDepth = std::find_if(results.begin(), results.end(), [&](const BenchResult& result) {
+			return result.scene.name == name.substr(0, name.size() - suffix.size());
+		});
+		if ((withDepth == results.end()) || (withDepth->overdraw < 0.0) || (withoutDepth.overdraw <= 0.0)) continue;
+
+		LOG_INFO("{}: depth test cuts overdraw from {}x to {}x ({}% fewer fragments shaded)", withDepth->scene.name,
+			withoutDepth.overdraw, withDepth->overdraw, 100.0 * (1.0 - withDepth->overdraw / withoutDepth.overdraw));
+	}
+}
+
+void write_results(const std::vector<BenchResult>& results, const std::string& filename) {
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open " + filename + " for writing");
+	}
+
+	file << "{\n";
+	// straight from the driver, so it's escaped like the trace's names
+	file << "  \"device\": ";
+	write_json_string(file, results.front().deviceName.c_str());
+	file << ",\n";
+	file << "  \"width\": " << InitialWidth << ",\n";
+	file << "  \"height\": " << InitialHeight << ",\n";
+	file << "  \"frames_in_flight\": " << FramesInFlight << ",\n";
+	file << "  \"warmup_frames\": " << WarmupFrameCount << ",\n";
+	file << "  \"scenes\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const auto& result = results[i];
+
+		file << "    {\n";
+		file << "      \"name\": \"" << result.scene.name << "\",\n";
+		file << "      \"triangles_per_draw\": " << result.scene.triangleCount << ",\n";
+		file << "      \"draws\": " << result.scene.drawCount << ",\n";
+		file << "      \"instances\": " << result.scene.instanceCount << ",\n";
+		file << "      \"particles\": " << result.scene.particleCount << ",\n";
+		file << "      \"instanced_objects\": " << result.scene.instancedObjectCount << ",\n";
+		file << "      \"gpu_culling\": " << (result.scene.gpuCulling ? "true" : "false") << ",\n";
+		file << "      \"depth_test\": " << (result.scene.depthTest ? "true" : "false") << ",\n";
+		file << "      \"frames\": " << result.frameCount << ",\n";
+		file << "      \"fps\": " << result.framesPerSecond << ",\n";
+		file << "      \"draws_per_frame\": " << result.drawsPerFrame << ",\n";
+		file << "      \"instances_per_frame\": " << result.instancesPerFrame << ",\n";
+		file << "      \"draws_per_second\": " << result.drawsPerSecond << ",\n";
+		file << "      \"instances_per_second\": " << result.instancesPerSecond << ",\n";
+		file << "      \"overdraw\": ";
+		if (result.overdraw < 0.0) {
+			file << "null";
+		} else {
+			file << result.overdraw;
+		}
+		file << ",\n";
+		file << "      \"cpu_frame_ms\": ";
+		write_timing_summary(file, result.cpuFrame);
+		file << ",\n";
+		file << "      \"gpu_frame_ms\": ";
+		write_timing_summary(file, result.gpuFrame);
+		file << ",\n";
+		file << "      \"gpu_particles_ms\": ";
+		write_timing_summary(file, result.gpuParticles);
+		file << ",\n";
+		file << "      \"gpu_culling_ms\": ";
+		write_timing_summary(file, result.gpuCulling);
+		file << "\n";
+		file << "    }" << ((i + 1 < results.size()) ? "," : "") << "\n";
+	}
+
+	file << "  ]\n";
+	file << "}\n";
+
+	LOG_INFO("Wrote results for {} scene(s) to {}", results.size(), filename);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+// A synthetic workload, each one stresses a different part of the pipeline
+struct BenchScene {
+	std::string name;
+	uint32_t triangleCount;
+	uint32_t drawCount;
+	uint32_t instanceCount;
+	uint32_t particleCount;
+	// drawn with one instanced draw on top of the draws above
+	uint32_t instancedObjectCount;
+	bool gpuCulling;
+	bool depthTest;
+};
+
+struct TimingSummary {
+	uint32_t sampleCount = 0;
+	double minMs = 0.0;
+	double averageMs = 0.0;
+	double maxMs = 0.0;
+	double p99Ms = 0.0;
+};
+
+struct BenchResult {
+	BenchScene scene;
+	std::string deviceName;
+	uint64_t frameCount = 0;
+	double framesPerSecond = 0.0;
+	// draw calls and the instances they add up to, as recorded every frame
+	uint64_t drawsPerFrame = 0;
+	uint64_t instancesPerFrame = 0;
+	double drawsPerSecond = 0.0;
+	double instancesPerSecond = 0.0;
+	TimingSummary cpuFrame;
+	// empty when the device can't write timestamps
+	TimingSummary gpuFrame;
+	// empty without particles too
+	TimingSummary gpuParticles;
+	// empty unless culling on the GPU
+	TimingSummary gpuCulling;
+	// fragment shader invocations per pixel of the target in the last frame, negative when the device can't count them
+	double overdraw = -1.0;
+};
+
+void parse_bench_arguments(int argc, char** argv);
+
+BenchResult run_scene(const BenchScene& scene);
+
+TimingSummary summarise_timings(std::vector<double> samples);
+
+// Compares every "<scene>-no-depth" scene with <scene>
+void print_overdraw_reduction(const std::vector<BenchResult>& results);
+
+void write_results(const std::vector<BenchResult>& results, const std::string& filename);
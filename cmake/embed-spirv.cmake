@@ -0,0 +1,36 @@
+# Turns a compiled SPIR-V module into a C++ header that holds it as a word aligned constexpr array, so the
+# renderer can hand it straight to vkCreateShaderModule without touching the disk or copying it.
+# Run in script mode with:
+#   -DINPUT=<module.spv> -DOUTPUT=<header.hpp> -DSYMBOL=<array name>
+
+file(READ "${INPUT}" SPIRV_HEX HEX)
+
+string(LENGTH "${SPIRV_HEX}" SPIRV_HEX_LENGTH)
+math(EXPR SPIRV_REMAINDER "${SPIRV_HEX_LENGTH} % 8")
+if(SPIRV_HEX_LENGTH EQUAL 0 OR NOT SPIRV_REMAINDER EQUAL 0)
+    message(FATAL_ERROR "${INPUT} is not a whole number of SPIR-V words")
+endif()
+
+# the module is stored as little endian words, so flip the bytes of each word to get its value
+string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])"
+    "0x\\4\\3\\2\\1, " SPIRV_WORDS "${SPIRV_HEX}")
+# eight words to a line
+set(SPIRV_LINE_PATTERN "")
+foreach(WORD_INDEX RANGE 7)
+    string(APPEND SPIRV_LINE_PATTERN "0x[0-9a-f]+, ")
+endforeach()
+string(REGEX REPLACE "(${SPIRV_LINE_PATTERN})" "\\1\n    " SPIRV_WORDS "${SPIRV_WORDS}")
+string(REPLACE ", \n" ",\n" SPIRV_WORDS "${SPIRV_WORDS}")
+string(REGEX REPLACE "[ \n]+$" "" SPIRV_WORDS "${SPIRV_WORDS}")
+
+get_filename_component(INPUT_NAME "${INPUT}" NAME)
+
+file(WRITE "${OUTPUT}"
+"// Generated from ${INPUT_NAME} by cmake/embed-spirv.cmake, do not edit\n"
+"#pragma once\n"
+"\n"
+"#include <cstdint>\n"
+"\n"
+"alignas(4) inline constexpr uint32_t ${SYMBOL}[] = {\n"
+"    ${SPIRV_WORDS}\n"
+"};\n")
@@ -0,0 +1,387 @@
+#include "command-recording.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+uint32_t RecordingThreadCount = 0;
+RecordingThreadPool RecordingThreads;
+
+uint32_t DrawCount = 1;
+std::vector<DrawCommand> DrawList;
+uint32_t InstanceCount = 1;
+
+// RecordingThreadPool
+
+void RecordingThreadPool::create(uint32_t threadCount, uint32_t frameCount, uint32_t queueFamilyIndex)
+{
+	commandPools.resize(threadCount * frameCount);
+	for (auto& commandPool : commandPools) {
+		VkCommandPoolCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		createInfo.queueFamilyIndex = queueFamilyIndex;
+
+		if (vkCreateCommandPool(Device, &createInfo, nullptr, &commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create recording thread command pool");
+		}
+	}
+
+	stopping = false;
+	for (uint32_t i = 0; i < threadCount; i++) {
+		workers.emplace_back(&RecordingThreadPool::worker_loop, this, i);
+	}
+}
+
+void RecordingThreadPool::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobReady.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+
+	for (auto& commandPool : commandPools) {
+		vkDestroyCommandPool(Device, commandPool, nullptr);
+	}
+	commandPools.clear();
+}
+
+void RecordingThreadPool::run(uint32_t jobCount, const std::function<void(uint32_t)>& job)
+{
+	jobCount = std::min(jobCount, thread_count());
+	if (jobCount == 0) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->job = &job;
+		this->jobCount = jobCount;
+		pendingWorkers = jobCount;
+		jobError = nullptr;
+		generation++;
+	}
+	jobReady.notify_all();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this] { return pendingWorkers == 0; });
+	this->job = nullptr;
+
+	if (jobError) {
+		std::rethrow_exception(jobError);
+	}
+}
+
+void RecordingThreadPool::worker_loop(uint32_t threadIndex)
+{
+	set_trace_thread_name("recording thread " + std::to_string(threadIndex));
+
+	uint64_t seenGeneration = 0;
+
+	while (true) {
+		const std::function<void(uint32_t)>* currentJob = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobReady.wait(lock, [&] { return stopping || (generation != seenGeneration); });
+			if (stopping) return;
+
+			seenGeneration = generation;
+			if (threadIndex >= jobCount) continue;
+
+			currentJob = job;
+		}
+
+		try {
+			(*currentJob)(threadIndex);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!jobError) {
+				jobError = std::current_exception();
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--pendingWorkers == 0) {
+			jobDone.notify_one();
+		}
+	}
+}
+
+// Recording
+
+void create_recording_threads()
+{
+	TRACE_ZONE("create_recording_threads");
+
+	uint32_t threadCount = RecordingThreadCount;
+	if (threadCount == 0) {
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	RecordingThreads.create(threadCount, FramesInFlight, PhysicalDeviceCapabilities.queueFamilyIndices.graphicsFamily);
+
+	LOG_INFO("Started {} command recording thread(s)", threadCount);
+}
+
+void build_draw_list(const Mesh& mesh, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	uint32_t drawCount)
+{
+	uint32_t triangleCount = mesh.triangle_count();
+	drawCount = std::max(std::min(drawCount, triangleCount), 1u);
+
+	DrawList.clear();
+	DrawList.reserve(drawCount);
+	SceneObjects.clear();
+	SceneObjects.reserve(drawCount);
+	VisibleDraws.clear();
+	VisibleDraws.reserve(drawCount);
+
+	for (uint32_t i = 0; i < drawCount; i++) {
+		uint32_t firstTriangle = (uint32_t) (((uint64_t) triangleCount * i) / drawCount);
+		uint32_t lastTriangle = (uint32_t) (((uint64_t) triangleCount * (i + 1)) / drawCount);
+
+		DrawCommand draw;
+		draw.mesh = &mesh;
+		draw.firstIndex = firstTriangle * 3;
+		draw.indexCount = (lastTriangle - firstTriangle) * 3;
+		draw.boundingSphere = compute_bounding_sphere(vertices, indices, draw.firstIndex, draw.indexCount);
+		DrawList.push_back(draw);
+
+		SceneObjects.add(draw.boundingSphere);
+		VisibleDraws.push_back(i);
+	}
+
+	LOG_INFO("Split mesh into {} draw(s)", DrawList.size());
+}
+
+void get_draw_range(uint32_t threadIndex, uint32_t jobCount, size_t& firstDraw, size_t& drawCount)
+{
+	size_t begin = (VisibleDraws.size() * threadIndex) / jobCount;
+	size_t end = (VisibleDraws.size() * (threadIndex + 1)) / jobCount;
+
+	firstDraw = begin;
+	drawCount = end - begin;
+}
+
+void begin_secondary_commands(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, VkCommandBufferUsageFlags usage)
+{
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = RenderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = framebuffer;
+	inheritanceInfo.pipelineStatistics = Profiler.pipeline_statistic_flags();
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = usage | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	// secondary command buffers don't inherit any state from the primary, so each sets up its own
+	VkViewport viewport = {};
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = (float) SurfaceExtent.width;
+	viewport.height = (float) SurfaceExtent.height;
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.extent = SurfaceExtent;
+	scissor.offset = { 0, 0 };
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	Bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+}
+
+void record_draws(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, VkCommandBufferUsageFlags usage,
+	size_t firstDraw, size_t drawCount)
+{
+	begin_secondary_commands(commandBuffer, framebuffer, usage);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Pipeline);
+
+	const Mesh* boundMesh = nullptr;
+	for (size_t i = firstDraw; i < firstDraw + drawCount; i++) {
+		const DrawCommand& draw = DrawList[VisibleDraws[i]];
+
+		if (draw.mesh != boundMesh) {
+			bind_mesh(commandBuffer, *draw.mesh);
+			boundMesh = draw.mesh;
+		}
+
+		record_object_data(commandBuffer, VisibleDraws[i]);
+		vkCmdDrawIndexed(commandBuffer, draw.indexCount, InstanceCount, draw.firstIndex, 0, 0);
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record secondary command buffer");
+	}
+}
+
+void record_frame(uint32_t frameIndex, uint32_t imageIndex)
+{
+	TRACE_ZONE("record_frame");
+
+	auto& frame = Frames.frames[frameIndex];
+	uint32_t threadCount = RecordingThreads.thread_count();
+	VkFramebuffer framebuffer = FrameGraph.framebuffer(ScenePass, imageIndex);
+
+	// everything recorded the last time this frame came around is thrown away in one go, the buffers
+	// themselves stay allocated and go back to the initial state
+	vkResetCommandPool(Device, frame.commandPool, 0);
+	frame.descriptorAllocator.reset();
+
+	update_object_transforms();
+	write_object_uniforms(frameIndex);
+
+	if (Culling.is_enabled()) {
+		// the GPU builds the draw list, so this is the same handful of commands however many draws there are
+		begin_secondary_commands(frame.cullingCommandBuffer, framebuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+		vkCmdBindPipeline(frame.cullingCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Pipeline);
+
+		// one transform for every draw, as the GPU writes them. create_object_data keeps the objects still.
+		ObjectUniforms identity = { glm::mat4(1.0f) };
+		Bindless.push_constants(frame.cullingCommandBuffer, &identity, sizeof(identity));
+
+		record_culled_draws(frame.cullingCommandBuffer);
+
+		if (vkEndCommandBuffer(frame.cullingCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record culling command buffer");
+		}
+	} else {
+		if (CpuCullingEnabled) {
+			cull_draw_list();
+		}
+		if (DrawSortingEnabled) {
+			sort_visible_draws();
+		}
+
+		RecordingThreads.run(threadCount, [frameIndex, framebuffer, threadCount, &frame](uint32_t threadIndex) {
+			TRACE_ZONE("record secondary command buffer");
+
+			vkResetCommandPool(Device, RecordingThreads.command_pool(frameIndex, threadIndex), 0);
+
+			size_t firstDraw = 0;
+			size_t drawCount = 0;
+			get_draw_range(threadIndex, threadCount, firstDraw, drawCount);
+
+			record_draws(frame.secondaryCommandBuffers[threadIndex], framebuffer,
+				VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, firstDraw, drawCount);
+		});
+	}
+
+	if (InstancedObjects.instance_count() > 0) {
+		begin_secondary_commands(frame.instanceCommandBuffer, framebuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+		record_instanced_objects(frame.instanceCommandBuffer);
+
+		if (vkEndCommandBuffer(frame.instanceCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record instance command buffer");
+		}
+	}
+
+	if (Particles.is_enabled()) {
+		begin_secondary_commands(frame.particleCommandBuffer, framebuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+		record_particle_draw(frame.particleCommandBuffer);
+
+		if (vkEndCommandBuffer(frame.particleCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record particle command buffer");
+		}
+	}
+
+	if (SpriteCount > 0) {
+		update_sprite_overlay(frameIndex);
+
+		begin_secondary_commands(frame.spriteCommandBuffer, framebuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+		Sprites.record(frame.spriteCommandBuffer);
+
+		if (vkEndCommandBuffer(frame.spriteCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record sprite command buffer");
+		}
+	}
+
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(frame.commandBuffer, &bufferBeginInfo);
+
+	Profiler.begin_frame(frame.commandBuffer, frameIndex);
+	uint32_t frameScope = Profiler.begin_scope(frame.commandBuffer, "frame");
+
+	// once for every compute pass, they only push constants from here on
+	Bindless.bind(frame.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+	// the particle simulation, GPU culling and the scene pass, with the barriers between them
+	record_particle_acquire(frame.commandBuffer);
+	FrameGraph.execute(frame.commandBuffer, frameIndex, imageIndex);
+	record_particle_release(frame.commandBuffer);
+
+	Profiler.end_scope(frame.commandBuffer, frameScope);
+
+	if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record frame command buffer");
+	}
+}
+
+void benchmark_recording(uint32_t iterations)
+{
+	if (Culling.is_enabled()) {
+		LOG_WARNING("Draws are culled and recorded on the GPU, there's no CPU recording to benchmark");
+		return;
+	}
+
+	uint32_t threadCount = RecordingThreads.thread_count();
+	auto& frame = Frames.frames[0];
+
+	LOG_INFO("Recording {} draw(s), best of {} run(s):", DrawList.size(), iterations);
+
+	// nothing's been submitted, so frame 0's object data can be written without waiting
+	frame.descriptorAllocator.reset();
+	write_object_uniforms(0);
+
+	std::vector<uint32_t> jobCounts;
+	for (uint32_t jobCount = 1; jobCount < threadCount; jobCount *= 2) {
+		jobCounts.push_back(jobCount);
+	}
+	jobCounts.push_back(threadCount);
+
+	double singleThreadMs = 0.0;
+	for (uint32_t jobCount : jobCounts) {
+		double bestMs = std::numeric_limits<double>::max();
+
+		for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+			auto recordingStart = std::chrono::steady_clock::now();
+
+			RecordingThreads.run(jobCount, [&](uint32_t threadIndex) {
+				vkResetCommandPool(Device, RecordingThreads.command_pool(0, threadIndex), 0);
+
+				size_t firstDraw = 0;
+				size_t drawCount = 0;
+				get_draw_range(threadIndex, jobCount, firstDraw, drawCount);
+
+				record_draws(frame.secondaryCommandBuffers[threadIndex], FrameGraph.framebuffer(ScenePass, 0),
+					VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, firstDraw, drawCount);
+			});
+
+			double recordingMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordingStart).count();
+			bestMs = std::min(bestMs, recordingMs);
+		}
+
+		if (jobCount == 1) {
+			singleThreadMs = bestMs;
+		}
+
+		LOG_INFO("  {} thread(s): {} ms ({}x)", jobCount, bestMs, singleThreadMs / bestMs);
+	}
+}
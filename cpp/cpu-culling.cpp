@@ -0,0 +1,324 @@
+#include "cpu-culling.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULLING_SSE 1
+#include <immintrin.h>
+#endif
+
+// the AVX2 kernel is compiled for AVX2 on its own, so the rest of the build doesn't need -mavx2 and still runs anywhere
+#if defined(CULLING_SSE) && defined(__GNUC__)
+#define CULLING_AVX2 1
+#define CULLING_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#include "vulkan-utils.hpp"
+
+bool CpuCullingEnabled = false;
+CullingKernel CpuCullingKernel = get_best_culling_kernel();
+size_t ParallelCullingThreshold = 16384;
+SceneObjectStore SceneObjects;
+std::vector<uint32_t> VisibleDraws;
+
+// how many survivors each job of cull_scene found, only used from the thread calling it
+static std::vector<size_t> JobVisibleCounts;
+
+static const char* CullingKernelNames[] = { "scalar", "sse", "avx2" };
+
+// SceneObjectStore
+
+void SceneObjectStore::clear()
+{
+	centreX.clear();
+	centreY.clear();
+	centreZ.clear();
+	radius.clear();
+}
+
+void SceneObjectStore::reserve(size_t count)
+{
+	centreX.reserve(count);
+	centreY.reserve(count);
+	centreZ.reserve(count);
+	radius.reserve(count);
+}
+
+void SceneObjectStore::add(const glm::vec4& boundingSphere)
+{
+	centreX.push_back(boundingSphere.x);
+	centreY.push_back(boundingSphere.y);
+	centreZ.push_back(boundingSphere.z);
+	radius.push_back(boundingSphere.w);
+}
+
+// Kernels
+
+static size_t cull_objects_scalar(const SceneObjectStore& objects, const glm::vec4 planes[6], size_t first, size_t count,
+	uint32_t* visible)
+{
+	size_t visibleCount = 0;
+
+	for (size_t i = first; i < first + count; i++) {
+		bool inside = true;
+		for (int plane = 0; plane < 6; plane++) {
+			float distance = planes[plane].x * objects.centreX[i] + planes[plane].y * objects.centreY[i] +
+				planes[plane].z * objects.centreZ[i] + planes[plane].w;
+			inside &= (distance >= -objects.radius[i]);
+		}
+
+		// written either way and only kept when inside, so there's no branch to mispredict
+		visible[visibleCount] = (uint32_t) i;
+		visibleCount += inside ? 1 : 0;
+	}
+
+	return visibleCount;
+}
+
+#ifdef CULLING_SSE
+static size_t cull_objects_sse(const SceneObjectStore& objects, const glm::vec4 planes[6], size_t first, size_t count,
+	uint32_t* visible)
+{
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int plane = 0; plane < 6; plane++) {
+		planeX[plane] = _mm_set1_ps(planes[plane].x);
+		planeY[plane] = _mm_set1_ps(planes[plane].y);
+		planeZ[plane] = _mm_set1_ps(planes[plane].z);
+		planeW[plane] = _mm_set1_ps(planes[plane].w);
+	}
+
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	size_t visibleCount = 0;
+	size_t i = first;
+
+	for (; i + 4 <= first + count; i += 4) {
+		__m128 x = _mm_loadu_ps(&objects.centreX[i]);
+		__m128 y = _mm_loadu_ps(&objects.centreY[i]);
+		__m128 z = _mm_loadu_ps(&objects.centreZ[i]);
+		__m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(&objects.radius[i]), signBit);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int plane = 0; plane < 6; plane++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[plane], x), _mm_mul_ps(planeY[plane], y)),
+				_mm_add_ps(_mm_mul_ps(planeZ[plane], z), planeW[plane]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++) {
+			visible[visibleCount] = (uint32_t) (i + lane);
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+
+	return visibleCount + cull_objects_scalar(objects, planes, i, first + count - i, visible + visibleCount);
+}
+#endif
+
+#ifdef CULLING_AVX2
+CULLING_TARGET_AVX2
+static size_t cull_objects_avx2(const SceneObjectStore& objects, const glm::vec4 planes[6], size_t first, size_t count,
+	uint32_t* visible)
+{
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int plane = 0; plane < 6; plane++) {
+		planeX[plane] = _mm256_set1_ps(planes[plane].x);
+		planeY[plane] = _mm256_set1_ps(planes[plane].y);
+		planeZ[plane] = _mm256_set1_ps(planes[plane].z);
+		planeW[plane] = _mm256_set1_ps(planes[plane].w);
+	}
+
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	size_t visibleCount = 0;
+	size_t i = first;
+
+	for (; i + 8 <= first + count; i += 8) {
+		__m256 x = _mm256_loadu_ps(&objects.centreX[i]);
+		__m256 y = _mm256_loadu_ps(&objects.centreY[i]);
+		__m256 z = _mm256_loadu_ps(&objects.centreZ[i]);
+		__m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(&objects.radius[i]), signBit);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int plane = 0; plane < 6; plane++) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[plane], x), _mm256_mul_ps(planeY[plane], y)),
+				_mm256_add_ps(_mm256_mul_ps(planeZ[plane], z), planeW[plane]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (int lane = 0; lane < 8; lane++) {
+			visible[visibleCount] = (uint32_t) (i + lane);
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+
+	return visibleCount + cull_objects_scalar(objects, planes, i, first + count - i, visible + visibleCount);
+}
+#endif
+
+// Culling
+
+bool is_culling_kernel_supported(CullingKernel kernel)
+{
+	switch (kernel) {
+	case CullingKernel::Scalar:
+		return true;
+#ifdef CULLING_SSE
+	case CullingKernel::Sse:
+		// SSE2 is part of x86-64, and everything running Vulkan on 32 bit x86 has it too
+		return true;
+#endif
+#ifdef CULLING_AVX2
+	case CullingKernel::Avx2:
+		// CpuCullingKernel is picked during static initialisation, possibly before the CPU's features have been detected
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return false;
+	}
+}
+
+CullingKernel get_best_culling_kernel()
+{
+	if (is_culling_kernel_supported(CullingKernel::Avx2)) return CullingKernel::Avx2;
+	if (is_culling_kernel_supported(CullingKernel::Sse)) return CullingKernel::Sse;
+
+	return CullingKernel::Scalar;
+}
+
+const char* get_culling_kernel_name(CullingKernel kernel)
+{
+	return CullingKernelNames[(uint32_t) kernel];
+}
+
+CullingKernel parse_culling_kernel(const std::string& name)
+{
+	for (uint32_t i = 0; i < sizeof(CullingKernelNames) / sizeof(CullingKernelNames[0]); i++) {
+		if (name != CullingKernelNames[i]) continue;
+
+		if (!is_culling_kernel_supported((CullingKernel) i)) {
+			throw std::runtime_error("Culling kernel " + name + " isn't supported on this CPU");
+		}
+
+		return (CullingKernel) i;
+	}
+
+	throw std::runtime_error("Unknown culling kernel " + name);
+}
+
+size_t cull_objects(CullingKernel kernel, const SceneObjectStore& objects, const glm::vec4 planes[6], size_t first,
+	size_t count, uint32_t* visible)
+{
+	switch (kernel) {
+#ifdef CULLING_SSE
+	case CullingKernel::Sse:
+		return cull_objects_sse(objects, planes, first, count, visible);
+#endif
+#ifdef CULLING_AVX2
+	case CullingKernel::Avx2:
+		return cull_objects_avx2(objects, planes, first, count, visible);
+#endif
+	default:
+		return cull_objects_scalar(objects, planes, first, count, visible);
+	}
+}
+
+void cull_scene(CullingKernel kernel, const SceneObjectStore& objects, const glm::vec4 planes[6], uint32_t jobCount,
+	std::vector<uint32_t>& visible)
+{
+	size_t objectCount = objects.size();
+	jobCount = std::max(std::min(jobCount, RecordingThreads.thread_count()), 1u);
+
+	// every job writes its survivors over the start of its own range, so they never overlap
+	visible.resize(objectCount);
+
+	if (jobCount == 1) {
+		visible.resize(cull_objects(kernel, objects, planes, 0, objectCount, visible.data()));
+		return;
+	}
+
+	// ranges start on a multiple of 16 objects, so every job's loads start on a cache line
+	auto get_range_begin = [objectCount, jobCount](uint32_t job) -> size_t {
+		if (job == jobCount) return objectCount;
+		return ((objectCount * job) / jobCount) & ~(size_t) 15;
+	};
+
+	JobVisibleCounts.resize(jobCount);
+	RecordingThreads.run(jobCount, [&](uint32_t job) {
+		TRACE_ZONE("cull objects");
+
+		size_t begin = get_range_begin(job);
+		size_t end = get_range_begin(job + 1);
+		JobVisibleCounts[job] = cull_objects(kernel, objects, planes, begin, end - begin, visible.data() + begin);
+	});
+
+	// close the gaps between the jobs' survivors
+	size_t visibleCount = JobVisibleCounts[0];
+	for (uint32_t job = 1; job < jobCount; job++) {
+		std::memmove(visible.data() + visibleCount, visible.data() + get_range_begin(job),
+			JobVisibleCounts[job] * sizeof(uint32_t));
+		visibleCount += JobVisibleCounts[job];
+	}
+	visible.resize(visibleCount);
+}
+
+void cull_draw_list()
+{
+	TRACE_ZONE("cull_draw_list");
+
+	glm::vec4 planes[6];
+	extract_frustum_planes(CullingViewProjection, planes);
+
+	uint32_t jobCount = (SceneObjects.size() >= ParallelCullingThreshold) ? RecordingThreads.thread_count() : 1;
+	cull_scene(CpuCullingKernel, SceneObjects, planes, jobCount, VisibleDraws);
+}
+
+void benchmark_culling(size_t objectCount, uint32_t iterations)
+{
+	// spread over twice the width, height and depth of the frustum, so roughly one in eight survive
+	std::mt19937 random(0);
+	std::uniform_real_distribution<float> position(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> depth(-0.5f, 1.5f);
+	std::uniform_real_distribution<float> size(0.001f, 0.05f);
+
+	SceneObjectStore objects;
+	objects.reserve(objectCount);
+	for (size_t i = 0; i < objectCount; i++) {
+		objects.add(glm::vec4(position(random), position(random), depth(random), size(random)));
+	}
+
+	glm::vec4 planes[6];
+	extract_frustum_planes(glm::mat4(1.0f), planes);
+
+	std::vector<uint32_t> visible;
+	visible.reserve(objectCount);
+
+	LOG_INFO("Culling {} object(s), best of {} run(s):", objectCount, iterations);
+
+	for (CullingKernel kernel : { CullingKernel::Scalar, CullingKernel::Sse, CullingKernel::Avx2 }) {
+		if (!is_culling_kernel_supported(kernel)) continue;
+
+		for (uint32_t jobCount : { 1u, RecordingThreads.thread_count() }) {
+			double bestMs = std::numeric_limits<double>::max();
+
+			for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+				auto cullingStart = std::chrono::steady_clock::now();
+				cull_scene(kernel, objects, planes, jobCount, visible);
+				double cullingMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullingStart).count();
+
+				bestMs = std::min(bestMs, cullingMs);
+			}
+
+			LOG_INFO("  {} on {} thread(s): {} ms, {} objects/ms, {} visible", get_culling_kernel_name(kernel), jobCount,
+				bestMs, objectCount / bestMs, visible.size());
+
+			if (jobCount == 1 && RecordingThreads.thread_count() == 1) break;
+		}
+	}
+}
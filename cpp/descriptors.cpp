@@ -0,0 +1,319 @@
+#include "descriptors.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+BindlessDescriptors Bindless;
+bool BindlessEnabled = false;
+uint32_t FrameDescriptorSetsPerPool = 256;
+
+// How many of each type a pool of DescriptorAllocator has room for, per set it has room for
+struct PoolSizeRatio {
+	VkDescriptorType type;
+	float ratio;
+};
+
+static const PoolSizeRatio PoolSizeRatios[] = {
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f }
+};
+
+static uint32_t take_slot(std::vector<uint32_t>& freeSlots, uint32_t& nextSlot, uint32_t capacity, const char* kind)
+{
+	if (!freeSlots.empty()) {
+		uint32_t slot = freeSlots.back();
+		freeSlots.pop_back();
+		return slot;
+	}
+
+	if (!BindlessEnabled) {
+		throw std::runtime_error(std::string("Can't register a ") + kind + ", bindless descriptors aren't available");
+	}
+
+	if (nextSlot >= capacity) {
+		throw std::runtime_error(std::string("Out of bindless ") + kind + " slots");
+	}
+
+	return nextSlot++;
+}
+
+uint32_t BindlessDescriptors::register_storage_buffer(const Buffer& buffer)
+{
+	uint32_t index = take_slot(freeStorageBuffers, nextStorageBuffer, storageBufferCapacity, "storage buffer");
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer.buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = set;
+	descriptorWrite.dstBinding = StorageBufferBinding;
+	descriptorWrite.dstArrayElement = index;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+	vkUpdateDescriptorSets(Device, 1, &descriptorWrite, 0, nullptr);
+
+	return index;
+}
+
+uint32_t BindlessDescriptors::register_sampled_image(VkImageView view, VkSampler sampler)
+{
+	uint32_t index = take_slot(freeSampledImages, nextSampledImage, sampledImageCapacity, "sampled image");
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = set;
+	descriptorWrite.dstBinding = SampledImageBinding;
+	descriptorWrite.dstArrayElement = index;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrite.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(Device, 1, &descriptorWrite, 0, nullptr);
+
+	return index;
+}
+
+void BindlessDescriptors::release_storage_buffer(uint32_t index)
+{
+	// the descriptor is left as it is, partially bound means nothing cares as long as shaders don't read it
+	freeStorageBuffers.push_back(index);
+}
+
+void BindlessDescriptors::release_sampled_image(uint32_t index)
+{
+	freeSampledImages.push_back(index);
+}
+
+void BindlessDescriptors::bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint) const
+{
+	if (set == VK_NULL_HANDLE) return;
+
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, 0, 1, &set, 0, nullptr);
+}
+
+void BindlessDescriptors::push_constants(VkCommandBuffer commandBuffer, const void* data, uint32_t size) const
+{
+	vkCmdPushConstants(commandBuffer, pipelineLayout, PushConstantStages, 0, size, data);
+}
+
+void create_bindless_descriptors()
+{
+	TRACE_ZONE("create_bindless_descriptors");
+
+	VkDescriptorSetLayoutBinding drawBinding = {};
+	drawBinding.binding = 0;
+	drawBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	drawBinding.descriptorCount = 1;
+	drawBinding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+	Bindless.drawSetLayout = create_descriptor_set_layout({ drawBinding });
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = BindlessDescriptors::PushConstantStages;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = BindlessDescriptors::PushConstantBytes;
+
+	// the scene only needs the draw set and push constants, so set 0 is left empty to keep DrawSet where it is
+	if (!BindlessEnabled) {
+		Bindless.setLayout = create_descriptor_set_layout({});
+		Bindless.pipelineLayout = create_pipeline_layout({ Bindless.setLayout, Bindless.drawSetLayout }, { pushConstantRange });
+
+		LOG_INFO("Created the per draw descriptor layout without bindless descriptors");
+		return;
+	}
+
+	const auto& indexingLimits = PhysicalDeviceCapabilities.descriptorIndexingProperties;
+
+	// every stage sees the whole set, so the per stage limits apply to all of it. A combined image sampler counts
+	// as both a sampler and a sampled image.
+	uint32_t maxSampledImages = std::min({ indexingLimits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexingLimits.maxDescriptorSetUpdateAfterBindSampledImages,
+		indexingLimits.maxPerStageDescriptorUpdateAfterBindSamplers,
+		indexingLimits.maxDescriptorSetUpdateAfterBindSamplers });
+	uint32_t maxStorageBuffers = std::min(indexingLimits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+		indexingLimits.maxDescriptorSetUpdateAfterBindStorageBuffers);
+
+	Bindless.sampledImageCapacity = std::min(BindlessDescriptors::MaxSampledImages, maxSampledImages);
+	Bindless.storageBufferCapacity = std::min(BindlessDescriptors::MaxStorageBuffers, maxStorageBuffers);
+
+	// both arrays together also have to fit in what a stage can have in total, storage buffers give way first
+	uint32_t maxResources = std::min(indexingLimits.maxPerStageUpdateAfterBindResources,
+		indexingLimits.maxUpdateAfterBindDescriptorsInAllPools);
+	Bindless.sampledImageCapacity = std::min(Bindless.sampledImageCapacity, maxResources / 2);
+	Bindless.storageBufferCapacity = std::min(Bindless.storageBufferCapacity, maxResources - Bindless.sampledImageCapacity);
+
+	VkDescriptorSetLayoutBinding bindings[2] = {};
+	bindings[0].binding = BindlessDescriptors::SampledImageBinding;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = Bindless.sampledImageCapacity;
+	bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+
+	bindings[1].binding = BindlessDescriptors::StorageBufferBinding;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = Bindless.storageBufferCapacity;
+	bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+	VkDescriptorBindingFlagsEXT bindingFlags[2] = {};
+	for (auto& flags : bindingFlags) {
+		flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+	}
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsCreateInfo.bindingCount = 2;
+	bindingFlagsCreateInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	layoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layoutCreateInfo.bindingCount = 2;
+	layoutCreateInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(Device, &layoutCreateInfo, nullptr, &Bindless.setLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless descriptor set layout");
+	}
+
+	VkDescriptorPoolSize poolSizes[2] = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = Bindless.sampledImageCapacity;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = Bindless.storageBufferCapacity;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 2;
+	poolCreateInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(Device, &poolCreateInfo, nullptr, &Bindless.pool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless descriptor pool");
+	}
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.descriptorPool = Bindless.pool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &Bindless.setLayout;
+
+	if (vkAllocateDescriptorSets(Device, &setAllocateInfo, &Bindless.set) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate bindless descriptor set");
+	}
+
+	Bindless.pipelineLayout = create_pipeline_layout({ Bindless.setLayout, Bindless.drawSetLayout }, { pushConstantRange });
+
+	LOG_INFO("Created bindless descriptors with room for {} sampled image(s) and {} storage buffer(s)",
+		Bindless.sampledImageCapacity, Bindless.storageBufferCapacity);
+}
+
+void destroy_bindless_descriptors()
+{
+	vkDestroyPipelineLayout(Device, Bindless.pipelineLayout, nullptr);
+
+	// frees the set along with it, there's no pool without BindlessEnabled
+	vkDestroyDescriptorPool(Device, Bindless.pool, nullptr);
+	vkDestroyDescriptorSetLayout(Device, Bindless.drawSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(Device, Bindless.setLayout, nullptr);
+
+	Bindless = BindlessDescriptors();
+}
+
+void DescriptorAllocator::create(uint32_t setsPerPool)
+{
+	this->setsPerPool = setsPerPool;
+	currentPool = take_pool();
+}
+
+void DescriptorAllocator::destroy()
+{
+	for (VkDescriptorPool pool : usedPools) {
+		vkDestroyDescriptorPool(Device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : freePools) {
+		vkDestroyDescriptorPool(Device, pool, nullptr);
+	}
+
+	usedPools.clear();
+	freePools.clear();
+	currentPool = VK_NULL_HANDLE;
+}
+
+void DescriptorAllocator::reset()
+{
+	// pools are never created with the free descriptor set flag, so resetting them is just moving an offset back
+	for (VkDescriptorPool pool : usedPools) {
+		vkResetDescriptorPool(Device, pool, 0);
+		freePools.push_back(pool);
+	}
+	usedPools.clear();
+
+	currentPool = take_pool();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = currentPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set;
+	VkResult result = vkAllocateDescriptorSets(Device, &allocateInfo, &set);
+
+	// the pool's full, move on to another. Only tried once, a set that doesn't fit in an empty pool never will.
+	if ((result == VK_ERROR_OUT_OF_POOL_MEMORY) || (result == VK_ERROR_FRAGMENTED_POOL)) {
+		currentPool = take_pool();
+		allocateInfo.descriptorPool = currentPool;
+		result = vkAllocateDescriptorSets(Device, &allocateInfo, &set);
+	}
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate per frame descriptor set");
+	}
+
+	return set;
+}
+
+VkDescriptorPool DescriptorAllocator::take_pool()
+{
+	VkDescriptorPool pool;
+
+	if (!freePools.empty()) {
+		pool = freePools.back();
+		freePools.pop_back();
+	} else {
+		VkDescriptorPoolSize poolSizes[std::size(PoolSizeRatios)];
+		for (size_t i = 0; i < std::size(PoolSizeRatios); i++) {
+			poolSizes[i].type = PoolSizeRatios[i].type;
+			poolSizes[i].descriptorCount = (uint32_t) (PoolSizeRatios[i].ratio * setsPerPool);
+		}
+
+		VkDescriptorPoolCreateInfo poolCreateInfo = {};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolCreateInfo.maxSets = setsPerPool;
+		poolCreateInfo.poolSizeCount = (uint32_t) std::size(poolSizes);
+		poolCreateInfo.pPoolSizes = poolSizes;
+
+		if (vkCreateDescriptorPool(Device, &poolCreateInfo, nullptr, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create per frame descriptor pool");
+		}
+	}
+
+	usedPools.push_back(pool);
+	return pool;
+}
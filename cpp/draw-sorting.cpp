@@ -0,0 +1,90 @@
+#include "draw-sorting.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "vulkan-utils.hpp"
+
+bool DrawSortingEnabled = true;
+
+// kept between frames so sorting doesn't allocate once they've grown to fit
+static std::vector<SortedDraw> SortedDraws;
+static std::vector<SortedDraw> SortScratch;
+
+uint64_t make_draw_sort_key(uint16_t pipelineId, uint16_t materialId, float depth)
+{
+	// the bits of a non negative float order the same way as its value, negatives and NaNs fail the comparison
+	depth = (depth > 0.0f) ? depth : 0.0f;
+
+	uint32_t depthBits;
+	std::memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	return ((uint64_t) pipelineId << 48) | ((uint64_t) materialId << 32) | depthBits;
+}
+
+void radix_sort_draws(std::vector<SortedDraw>& draws, std::vector<SortedDraw>& scratch)
+{
+	scratch.resize(draws.size());
+	if (draws.size() < 2) return;
+
+	// every byte's histogram in one pass over the keys
+	uint32_t counts[8][256] = {};
+	for (const auto& draw : draws) {
+		for (uint32_t digit = 0; digit < 8; digit++) {
+			counts[digit][(draw.key >> (digit * 8)) & 0xff]++;
+		}
+	}
+
+	SortedDraw* source = draws.data();
+	SortedDraw* destination = scratch.data();
+
+	for (uint32_t digit = 0; digit < 8; digit++) {
+		uint32_t* digitCounts = counts[digit];
+
+		// all in one bucket, the pass wouldn't move anything
+		if (digitCounts[(source[0].key >> (digit * 8)) & 0xff] == draws.size()) continue;
+
+		uint32_t offsets[256];
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < 256; bucket++) {
+			offsets[bucket] = offset;
+			offset += digitCounts[bucket];
+		}
+
+		for (size_t i = 0; i < draws.size(); i++) {
+			destination[offsets[(source[i].key >> (digit * 8)) & 0xff]++] = source[i];
+		}
+
+		std::swap(source, destination);
+	}
+
+	// an odd number of passes leaves the result in scratch
+	if (source != draws.data()) {
+		draws.swap(scratch);
+	}
+}
+
+void sort_visible_draws()
+{
+	TRACE_ZONE("sort_visible_draws");
+
+	const glm::mat4& viewProjection = CullingViewProjection;
+
+	SortedDraws.resize(VisibleDraws.size());
+	for (size_t i = 0; i < VisibleDraws.size(); i++) {
+		const DrawCommand& draw = DrawList[VisibleDraws[i]];
+
+		glm::vec4 clipPosition = viewProjection * glm::vec4(draw.boundingSphere.x, draw.boundingSphere.y,
+			draw.boundingSphere.z, 1.0f);
+		float depth = (clipPosition.w > 0.0f) ? (clipPosition.z / clipPosition.w) : 0.0f;
+
+		SortedDraws[i].key = make_draw_sort_key(draw.pipelineId, draw.materialId, depth);
+		SortedDraws[i].draw = VisibleDraws[i];
+	}
+
+	radix_sort_draws(SortedDraws, SortScratch);
+
+	for (size_t i = 0; i < VisibleDraws.size(); i++) {
+		VisibleDraws[i] = SortedDraws[i].draw;
+	}
+}
@@ -0,0 +1,183 @@
+#include "gpu-culling.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+bool GpuCullingEnabled = false;
+bool MultiDrawIndirectEnabled = false;
+bool DrawIndirectCountEnabled = false;
+glm::mat4 CullingViewProjection = glm::mat4(1.0f);
+GpuCulling Culling;
+
+static_assert(sizeof(CullingConstants) <= BindlessDescriptors::PushConstantBytes, "Culling constants don't fit");
+
+static void upload_culling_objects(const std::vector<CullingObject>& objects)
+{
+	VkDeviceSize objectBytes = sizeof(CullingObject) * objects.size();
+
+	Buffer stagingBuffer = create_buffer(objectBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	std::memcpy(stagingBuffer.allocation.mapped, objects.data(), (size_t) objectBytes);
+
+	// read by compute on the graphics queue, so it's copied there rather than handed over from the transfer queue
+	VkCommandBuffer commandBuffer = begin_single_time_commands(CommandPool);
+
+	VkBufferCopy region = {};
+	region.size = objectBytes;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, Culling.objectBuffer.buffer, 1, &region);
+
+	end_single_time_commands(CommandPool, GraphicsQueue, commandBuffer);
+
+	destroy_buffer(stagingBuffer);
+}
+
+void create_gpu_culling()
+{
+	TRACE_ZONE("create_gpu_culling");
+
+	if (!GpuCullingEnabled || DrawList.empty()) return;
+
+	const auto& limits = PhysicalDeviceCapabilities.properties.limits;
+	uint32_t objectCount = (uint32_t) DrawList.size();
+
+	uint32_t workgroupCount = (objectCount + GpuCulling::WorkgroupSize - 1) / GpuCulling::WorkgroupSize;
+	if (workgroupCount > limits.maxComputeWorkGroupCount[0]) {
+		throw std::runtime_error("Too many draws to cull in a single dispatch on this device");
+	}
+	if (MultiDrawIndirectEnabled && (objectCount > limits.maxDrawIndirectCount)) {
+		throw std::runtime_error("Too many draws for a single indirect draw on this device");
+	}
+
+	std::vector<CullingObject> objects;
+	objects.reserve(objectCount);
+	for (const auto& draw : DrawList) {
+		if (draw.mesh != DrawList.front().mesh) {
+			throw std::runtime_error("GPU culling needs every draw to be of the same mesh");
+		}
+
+		CullingObject object = {};
+		object.boundingSphere = draw.boundingSphere;
+		object.firstIndex = draw.firstIndex;
+		object.indexCount = draw.indexCount;
+		objects.push_back(object);
+	}
+
+	Culling.mesh = DrawList.front().mesh;
+	Culling.objectCount = objectCount;
+
+	Culling.objectBuffer = create_buffer(sizeof(CullingObject) * objectCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	Culling.drawBuffer = create_buffer(sizeof(VkDrawIndexedIndirectCommand) * objectCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	Culling.drawCountBuffer = create_buffer(sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	upload_culling_objects(objects);
+
+	Culling.objectBufferIndex = Bindless.register_storage_buffer(Culling.objectBuffer);
+	Culling.drawBufferIndex = Bindless.register_storage_buffer(Culling.drawBuffer);
+	Culling.drawCountBufferIndex = Bindless.register_storage_buffer(Culling.drawCountBuffer);
+
+	Culling.pipeline = create_compute_pipeline("cull.comp", Bindless.pipelineLayout);
+
+	if (MultiDrawIndirectEnabled && DrawIndirectCountEnabled) {
+		Culling.drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)
+			vkGetDeviceProcAddr(Device, "vkCmdDrawIndexedIndirectCountKHR");
+	}
+
+	if (!MultiDrawIndirectEnabled) {
+		LOG_WARNING("Device doesn't support multi draw indirect, culled draws are issued one indirect draw at a time");
+	}
+
+	LOG_INFO("GPU culling {} draw(s), {}", Culling.objectCount,
+		Culling.is_compacting() ? "compacted with an indirect count" : "culled draws zeroed in place");
+}
+
+void record_draw_count_reset(VkCommandBuffer commandBuffer)
+{
+	if (!Culling.is_compacting()) return;
+
+	vkCmdFillBuffer(commandBuffer, Culling.drawCountBuffer.buffer, 0, sizeof(uint32_t), 0);
+}
+
+void record_gpu_culling(VkCommandBuffer commandBuffer)
+{
+	if (!Culling.is_enabled()) return;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Culling.pipeline);
+
+	CullingConstants constants = {};
+	extract_frustum_planes(CullingViewProjection, constants.frustumPlanes);
+	constants.objectCount = Culling.objectCount;
+	constants.instanceCount = InstanceCount;
+	constants.compact = Culling.is_compacting() ? 1 : 0;
+	constants.objectBuffer = Culling.objectBufferIndex;
+	constants.drawBuffer = Culling.drawBufferIndex;
+	constants.drawCountBuffer = Culling.drawCountBufferIndex;
+	Bindless.push_constants(commandBuffer, &constants, sizeof(constants));
+
+	uint32_t workgroupCount = (Culling.objectCount + GpuCulling::WorkgroupSize - 1) / GpuCulling::WorkgroupSize;
+	vkCmdDispatch(commandBuffer, workgroupCount, 1, 1);
+}
+
+void record_culled_draws(VkCommandBuffer commandBuffer)
+{
+	if (!Culling.is_enabled()) return;
+
+	bind_mesh(commandBuffer, *Culling.mesh);
+
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (Culling.is_compacting()) {
+		Culling.drawIndexedIndirectCount(commandBuffer, Culling.drawBuffer.buffer, 0, Culling.drawCountBuffer.buffer, 0,
+			Culling.objectCount, stride);
+	} else if (MultiDrawIndirectEnabled) {
+		vkCmdDrawIndexedIndirect(commandBuffer, Culling.drawBuffer.buffer, 0, Culling.objectCount, stride);
+	} else {
+		for (uint32_t i = 0; i < Culling.objectCount; i++) {
+			vkCmdDrawIndexedIndirect(commandBuffer, Culling.drawBuffer.buffer, (VkDeviceSize) i * stride, 1, stride);
+		}
+	}
+}
+
+void destroy_gpu_culling()
+{
+	if (!Culling.is_enabled()) return;
+
+	vkDestroyPipeline(Device, Culling.pipeline, nullptr);
+
+	Bindless.release_storage_buffer(Culling.drawCountBufferIndex);
+	Bindless.release_storage_buffer(Culling.drawBufferIndex);
+	Bindless.release_storage_buffer(Culling.objectBufferIndex);
+
+	destroy_buffer(Culling.drawCountBuffer);
+	destroy_buffer(Culling.drawBuffer);
+	destroy_buffer(Culling.objectBuffer);
+
+	Culling = GpuCulling();
+}
+
+void extract_frustum_planes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+{
+	// a point is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w in clip space, each of which is a plane
+	// made of the matrix's rows (Gribb and Hartmann)
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[2];
+	planes[5] = rows[3] - rows[2];
+
+	for (int i = 0; i < 6; i++) {
+		float length = glm::length(glm::vec3(planes[i].x, planes[i].y, planes[i].z));
+		planes[i] = planes[i] / length;
+	}
+}
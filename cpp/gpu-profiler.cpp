@@ -0,0 +1,272 @@
+#include "gpu-profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+bool PipelineStatisticsEnabled = false;
+GpuProfiler Profiler;
+
+static const VkQueryPipelineStatisticFlags ProfilerStatisticFlags =
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+void GpuProfiler::create(uint32_t frameCount, bool enablePipelineStatistics)
+{
+	const auto& capabilities = PhysicalDeviceCapabilities;
+
+	uint32_t timestampValidBits = capabilities.queueFamilies[capabilities.queueFamilyIndices.graphicsFamily].timestampValidBits;
+	if (timestampValidBits == 0) {
+		LOG_WARNING("Graphics queue doesn't support timestamps, GPU profiling disabled");
+		return;
+	}
+
+	enabled = true;
+	pipelineStatisticsEnabled = enablePipelineStatistics;
+	timestampPeriodNs = capabilities.properties.limits.timestampPeriod;
+	timestampMask = (timestampValidBits >= 64) ? ~0ull : ((1ull << timestampValidBits) - 1);
+
+	frames.resize(frameCount);
+	for (auto& frame : frames) {
+		VkQueryPoolCreateInfo timestampCreateInfo = {};
+		timestampCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		timestampCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		timestampCreateInfo.queryCount = MaxScopesPerFrame * 2;
+
+		if (vkCreateQueryPool(Device, &timestampCreateInfo, nullptr, &frame.timestampPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timestamp query pool");
+		}
+
+		if (pipelineStatisticsEnabled) {
+			VkQueryPoolCreateInfo statisticsCreateInfo = {};
+			statisticsCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			statisticsCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			statisticsCreateInfo.queryCount = 1;
+			statisticsCreateInfo.pipelineStatistics = ProfilerStatisticFlags;
+
+			if (vkCreateQueryPool(Device, &statisticsCreateInfo, nullptr, &frame.statisticsPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create pipeline statistics query pool");
+			}
+		}
+	}
+}
+
+void GpuProfiler::destroy()
+{
+	for (auto& frame : frames) {
+		vkDestroyQueryPool(Device, frame.timestampPool, nullptr);
+		if (frame.statisticsPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(Device, frame.statisticsPool, nullptr);
+		}
+	}
+	frames.clear();
+
+	histories.clear();
+	historyIndices.clear();
+	lastPipelineStatistics = GpuPipelineStatistics();
+
+	enabled = false;
+}
+
+void GpuProfiler::begin_frame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	if (!enabled) return;
+
+	currentFrame = frameIndex;
+	auto& frame = frames[frameIndex];
+
+	if (frame.pending) {
+		collect_results(frame);
+	}
+
+	vkCmdResetQueryPool(commandBuffer, frame.timestampPool, 0, MaxScopesPerFrame * 2);
+	if (pipelineStatisticsEnabled) {
+		vkCmdResetQueryPool(commandBuffer, frame.statisticsPool, 0, 1);
+	}
+
+	frame.scopes.clear();
+	frame.queryCount = 0;
+	frame.statisticsWritten = false;
+	frame.pending = true;
+}
+
+uint32_t GpuProfiler::begin_scope(VkCommandBuffer commandBuffer, const std::string& name)
+{
+	if (!enabled) return InvalidScope;
+
+	auto& frame = frames[currentFrame];
+	if (frame.scopes.size() >= MaxScopesPerFrame) return InvalidScope;
+
+	auto history = historyIndices.find(name);
+	if (history == historyIndices.end()) {
+		ScopeHistory scopeHistory;
+		scopeHistory.name = name;
+		scopeHistory.samples.reserve(HistoryLength);
+		histories.push_back(scopeHistory);
+
+		history = historyIndices.emplace(name, (uint32_t) histories.size() - 1).first;
+	}
+
+	FrameScope scope;
+	scope.history = history->second;
+	scope.beginQuery = frame.queryCount++;
+	frame.scopes.push_back(scope);
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestampPool, scope.beginQuery);
+
+	return (uint32_t) frame.scopes.size() - 1;
+}
+
+void GpuProfiler::end_scope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	if (!enabled || (scope == InvalidScope)) return;
+
+	auto& frame = frames[currentFrame];
+	frame.scopes[scope].endQuery = frame.queryCount++;
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.timestampPool,
+		frame.scopes[scope].endQuery);
+}
+
+void GpuProfiler::begin_pipeline_statistics(VkCommandBuffer commandBuffer)
+{
+	if (!enabled || !pipelineStatisticsEnabled) return;
+
+	vkCmdBeginQuery(commandBuffer, frames[currentFrame].statisticsPool, 0, 0);
+}
+
+void GpuProfiler::end_pipeline_statistics(VkCommandBuffer commandBuffer)
+{
+	if (!enabled || !pipelineStatisticsEnabled) return;
+
+	vkCmdEndQuery(commandBuffer, frames[currentFrame].statisticsPool, 0);
+	frames[currentFrame].statisticsWritten = true;
+}
+
+VkQueryPipelineStatisticFlags GpuProfiler::pipeline_statistic_flags() const
+{
+	return (enabled && pipelineStatisticsEnabled) ? ProfilerStatisticFlags : 0;
+}
+
+std::vector<GpuScopeStatistics> GpuProfiler::get_scope_statistics() const
+{
+	std::vector<GpuScopeStatistics> scopeStatistics;
+
+	for (const auto& history : histories) {
+		if (history.samples.empty()) continue;
+
+		std::vector<double> sorted = history.samples;
+		std::sort(sorted.begin(), sorted.end());
+
+		double total = 0.0;
+		for (double sample : sorted) {
+			total += sample;
+		}
+
+		GpuScopeStatistics statistics;
+		statistics.name = history.name;
+		statistics.sampleCount = (uint32_t) sorted.size();
+		statistics.minMs = sorted.front();
+		statistics.averageMs = total / sorted.size();
+		statistics.maxMs = sorted.back();
+		// nearest rank
+		size_t p99Rank = (size_t) std::ceil(0.99 * sorted.size());
+		statistics.p99Ms = sorted[std::max<size_t>(p99Rank, 1) - 1];
+
+		scopeStatistics.push_back(statistics);
+	}
+
+	return scopeStatistics;
+}
+
+void GpuProfiler::reset_statistics()
+{
+	for (auto& history : histories) {
+		history.samples.clear();
+		history.nextSample = 0;
+	}
+
+	// their queries are still reset when the frame is next recorded, the results just aren't read
+	for (auto& frame : frames) {
+		frame.pending = false;
+	}
+
+	lastPipelineStatistics = GpuPipelineStatistics();
+}
+
+void GpuProfiler::print_statistics() const
+{
+	if (!enabled) return;
+
+	for (const auto& statistics : get_scope_statistics()) {
+		LOG_INFO("GPU {} over the last {} frame(s): min {} ms, avg {} ms, max {} ms, p99 {} ms", statistics.name,
+			statistics.sampleCount, statistics.minMs, statistics.averageMs, statistics.maxMs, statistics.p99Ms);
+	}
+
+	if (pipelineStatisticsEnabled) {
+		LOG_INFO("GPU pipeline statistics of the last frame: {} vertices, {} primitives, {} vertex shader invocations, "
+			"{} primitives after clipping, {} fragment shader invocations", lastPipelineStatistics.inputAssemblyVertices,
+			lastPipelineStatistics.inputAssemblyPrimitives, lastPipelineStatistics.vertexShaderInvocations,
+			lastPipelineStatistics.clippingPrimitives, lastPipelineStatistics.fragmentShaderInvocations);
+	}
+}
+
+void GpuProfiler::collect_results(FrameQueries& frame)
+{
+	frame.pending = false;
+
+	// no WAIT flag, the frame's fence has already been waited on so anything not ready is simply skipped
+	if (frame.queryCount > 0) {
+		std::vector<uint64_t> timestamps(frame.queryCount);
+		VkResult result = vkGetQueryPoolResults(Device, frame.timestampPool, 0, frame.queryCount,
+			timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS) {
+			for (const auto& scope : frame.scopes) {
+				if (scope.endQuery == InvalidScope) continue;
+
+				uint64_t ticks = (timestamps[scope.endQuery] - timestamps[scope.beginQuery]) & timestampMask;
+				double milliseconds = (ticks * timestampPeriodNs) / 1000000.0;
+
+				auto& history = histories[scope.history];
+				if (history.samples.size() < HistoryLength) {
+					history.samples.push_back(milliseconds);
+				} else {
+					history.samples[history.nextSample] = milliseconds;
+				}
+				history.nextSample = (history.nextSample + 1) % HistoryLength;
+			}
+		}
+	}
+
+	if (frame.statisticsWritten) {
+		uint64_t values[5] = {};
+		VkResult result = vkGetQueryPoolResults(Device, frame.statisticsPool, 0, 1, sizeof(values), values,
+			sizeof(values), VK_QUERY_RESULT_64_BIT);
+
+		// results come back in the order of the flag bits
+		if (result == VK_SUCCESS) {
+			lastPipelineStatistics.inputAssemblyVertices = values[0];
+			lastPipelineStatistics.inputAssemblyPrimitives = values[1];
+			lastPipelineStatistics.vertexShaderInvocations = values[2];
+			lastPipelineStatistics.clippingPrimitives = values[3];
+			lastPipelineStatistics.fragmentShaderInvocations = values[4];
+		}
+	}
+}
+
+void create_gpu_profiler()
+{
+	TRACE_ZONE("create_gpu_profiler");
+
+	Profiler.create(FramesInFlight, PipelineStatisticsEnabled);
+
+	if (Profiler.is_enabled()) {
+		LOG_INFO("GPU profiler created{}", PipelineStatisticsEnabled ? " with pipeline statistics" : "");
+	}
+}
@@ -0,0 +1,193 @@
+#include "instancing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+uint32_t InstancedObjectCount = 0;
+Mesh InstanceMesh;
+InstanceBatch InstancedObjects;
+VkPipeline InstancedPipeline = VK_NULL_HANDLE;
+
+static_assert(sizeof(InstancePushConstants) <= BindlessDescriptors::PushConstantBytes, "Instance constants don't fit");
+
+static uint32_t pack_color(const glm::vec4& color)
+{
+	uint32_t packed = 0;
+	for (int i = 0; i < 4; i++) {
+		float channel = std::min(std::max(color[i], 0.0f), 1.0f);
+		packed |= (uint32_t) std::lround(channel * 255.0f) << (i * 8);
+	}
+
+	return packed;
+}
+
+void InstanceBatch::create(const Mesh& mesh, uint32_t firstIndex, uint32_t indexCount, uint32_t capacity)
+{
+	// every attribute buffer is bound whole, the transforms being the largest of them
+	if (sizeof(glm::vec4) * (VkDeviceSize) capacity > PhysicalDeviceCapabilities.properties.limits.maxStorageBufferRange) {
+		throw std::runtime_error("Too many instances for one batch on this device");
+	}
+
+	this->mesh = &mesh;
+	this->firstIndex = firstIndex;
+	this->indexCount = indexCount;
+	this->capacity = capacity;
+
+	transforms.reserve(capacity);
+	colors.reserve(capacity);
+	materialIds.reserve(capacity);
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	transformBuffer = create_buffer(sizeof(glm::vec4) * capacity, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	colorBuffer = create_buffer(sizeof(uint32_t) * capacity, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	materialBuffer = create_buffer(sizeof(uint32_t) * capacity, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	bufferIndices.transformBuffer = Bindless.register_storage_buffer(transformBuffer);
+	bufferIndices.colorBuffer = Bindless.register_storage_buffer(colorBuffer);
+	bufferIndices.materialBuffer = Bindless.register_storage_buffer(materialBuffer);
+}
+
+void InstanceBatch::destroy()
+{
+	Bindless.release_storage_buffer(bufferIndices.materialBuffer);
+	Bindless.release_storage_buffer(bufferIndices.colorBuffer);
+	Bindless.release_storage_buffer(bufferIndices.transformBuffer);
+
+	destroy_buffer(materialBuffer);
+	destroy_buffer(colorBuffer);
+	destroy_buffer(transformBuffer);
+
+	*this = InstanceBatch();
+}
+
+uint32_t InstanceBatch::add(const glm::vec4& transform, const glm::vec4& color, uint32_t materialId)
+{
+	if (transforms.size() >= capacity) {
+		throw std::runtime_error("Instance batch is full");
+	}
+
+	transforms.push_back(transform);
+	colors.push_back(pack_color(color));
+	materialIds.push_back(materialId);
+
+	return (uint32_t) transforms.size() - 1;
+}
+
+void InstanceBatch::clear()
+{
+	transforms.clear();
+	colors.clear();
+	materialIds.clear();
+}
+
+void InstanceBatch::upload()
+{
+	uploadedCount = (uint32_t) transforms.size();
+	if (uploadedCount == 0) return;
+
+	VkDeviceSize transformBytes = sizeof(glm::vec4) * uploadedCount;
+	VkDeviceSize colorBytes = sizeof(uint32_t) * uploadedCount;
+	VkDeviceSize materialBytes = sizeof(uint32_t) * uploadedCount;
+
+	// one staging buffer with the arrays back to back, all copied in the same submission
+	Buffer stagingBuffer = create_buffer(transformBytes + colorBytes + materialBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	char* staging = static_cast<char*>(stagingBuffer.allocation.mapped);
+	std::memcpy(staging, transforms.data(), (size_t) transformBytes);
+	std::memcpy(staging + transformBytes, colors.data(), (size_t) colorBytes);
+	std::memcpy(staging + transformBytes + colorBytes, materialIds.data(), (size_t) materialBytes);
+
+	// read by the vertex shader on the graphics queue, so it's copied there rather than handed over from the
+	// transfer queue
+	VkCommandBuffer commandBuffer = begin_single_time_commands(CommandPool);
+
+	VkBufferCopy transformRegion = {};
+	transformRegion.size = transformBytes;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, transformBuffer.buffer, 1, &transformRegion);
+
+	VkBufferCopy colorRegion = {};
+	colorRegion.srcOffset = transformBytes;
+	colorRegion.size = colorBytes;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, colorBuffer.buffer, 1, &colorRegion);
+
+	VkBufferCopy materialRegion = {};
+	materialRegion.srcOffset = transformBytes + colorBytes;
+	materialRegion.size = materialBytes;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, materialBuffer.buffer, 1, &materialRegion);
+
+	end_single_time_commands(CommandPool, GraphicsQueue, commandBuffer);
+
+	destroy_buffer(stagingBuffer);
+}
+
+void InstanceBatch::record(VkCommandBuffer commandBuffer) const
+{
+	if (uploadedCount == 0) return;
+
+	Bindless.push_constants(commandBuffer, &bufferIndices, sizeof(bufferIndices));
+
+	bind_mesh(commandBuffer, *mesh);
+	vkCmdDrawIndexed(commandBuffer, indexCount, uploadedCount, firstIndex, 0, 0);
+}
+
+void create_instanced_objects()
+{
+	TRACE_ZONE("create_instanced_objects");
+
+	if (InstancedObjectCount == 0) return;
+
+	// a single white triangle filling -1 to 1, coloured and placed by its instance
+	std::vector<Vertex> vertices = {
+		{ glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f) },
+		{ glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(1.0f) },
+		{ glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec3(1.0f) }
+	};
+	std::vector<uint32_t> indices = { 0, 1, 2 };
+	InstanceMesh = create_mesh(vertices, indices);
+
+	InstancedObjects.create(InstanceMesh, 0, InstanceMesh.indexCount, InstancedObjectCount);
+
+	// a grid over the same area as the scene mesh, each instance filling its cell
+	uint32_t gridSize = (uint32_t) std::ceil(std::sqrt((double) InstancedObjectCount));
+	float cellSize = 1.8f / gridSize;
+	for (uint32_t i = 0; i < InstancedObjectCount; i++) {
+		float u = ((i % gridSize) + 0.5f) / gridSize;
+		float v = ((i / gridSize) + 0.5f) / gridSize;
+
+		glm::vec4 transform(-0.9f + u * 1.8f, -0.9f + v * 1.8f, 0.0f, cellSize * 0.5f);
+		glm::vec4 color(u, 1.0f - v, 0.5f, 1.0f);
+		InstancedObjects.add(transform, color, i % 2);
+	}
+
+	InstancedObjects.upload();
+
+	// drawn over the scene without a depth test like the particles, everything is at the same depth
+	InstancedPipeline = build_graphics_pipeline("instanced.vert", "singleTriangle.frag", Vertex::get_layout(),
+		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, Bindless.pipelineLayout, false);
+
+	LOG_INFO("Created {} instanced object(s) drawn with a single draw", InstancedObjects.instance_count());
+}
+
+void record_instanced_objects(VkCommandBuffer commandBuffer)
+{
+	if (InstancedObjects.instance_count() == 0) return;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, InstancedPipeline);
+	InstancedObjects.record(commandBuffer);
+}
+
+void destroy_instanced_objects()
+{
+	if (InstancedPipeline == VK_NULL_HANDLE) return;
+
+	vkDestroyPipeline(Device, InstancedPipeline, nullptr);
+	InstancedPipeline = VK_NULL_HANDLE;
+
+	InstancedObjects.destroy();
+	destroy_mesh(InstanceMesh);
+}
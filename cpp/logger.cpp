@@ -0,0 +1,186 @@
+#include "logger.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+// Bounded multi producer, single consumer ring. Every slot has a sequence number saying whose turn it is: a producer
+// that claimed position p may fill the slot once its sequence is p, and publishes it by setting it to p + 1, after
+// which the logging thread formats it and hands the slot to the producer one lap later by setting it to p + capacity.
+// Producers only ever contend on the compare exchange of LogEnqueuePosition, nothing takes a lock.
+static constexpr uint64_t LogRingCapacity = 1024;
+
+static std::unique_ptr<LogRecord[]> LogRecords;
+static std::unique_ptr<std::atomic<uint64_t>[]> LogSequences;
+alignas(64) static std::atomic<uint64_t> LogEnqueuePosition{ 0 };
+// only touched by the logging thread
+alignas(64) static uint64_t LogDequeuePosition = 0;
+
+static std::atomic<bool> LoggerRunning{ false };
+static std::thread LoggerThread;
+
+static const std::chrono::steady_clock::time_point LogStart = std::chrono::steady_clock::now();
+
+// used while the logging thread isn't running
+static thread_local LogRecord SynchronousRecord;
+
+LogLevel MinimumLogLevel = LogLevel::Info;
+
+static const char* LogLevelNames[] = { "debug", "info", "warning", "error" };
+
+static void write_log_argument(std::ostringstream& message, const LogRecord& record, const LogArgument& argument) {
+	switch (argument.type) {
+	case LogArgumentType::Signed:
+		message << argument.signedValue;
+		break;
+	case LogArgumentType::Unsigned:
+		message << argument.unsignedValue;
+		break;
+	case LogArgumentType::Float:
+		message << argument.floatValue;
+		break;
+	case LogArgumentType::Bool:
+		message << (argument.unsignedValue ? "true" : "false");
+		break;
+	case LogArgumentType::String:
+		message.write(record.strings + argument.stringOffset, argument.stringLength);
+		break;
+	}
+}
+
+static void write_log_record(const LogRecord& record) {
+	std::ostringstream message;
+	message << std::fixed << std::setprecision(3) << "[" << (record.timeNs / 1e9) << "] ["
+		<< LogLevelNames[(uint32_t) record.level] << "] ";
+	message << std::defaultfloat << std::setprecision(6);
+
+	uint32_t nextArgument = 0;
+	for (const char* c = record.format; *c != '\0'; c++) {
+		if ((c[0] == '{') && (c[1] == '}') && (nextArgument < record.argumentCount)) {
+			write_log_argument(message, record, record.arguments[nextArgument++]);
+			c++;
+		} else {
+			message << *c;
+		}
+	}
+	message << '\n';
+
+	if (record.level >= LogLevel::Warning) {
+		// keep the order of what's already been written to stdout
+		std::cout.flush();
+		std::cerr << message.str();
+	} else {
+		std::cout << message.str();
+	}
+}
+
+static void logger_loop() {
+	while (true) {
+		uint64_t index = LogDequeuePosition & (LogRingCapacity - 1);
+		uint64_t sequence = LogSequences[index].load(std::memory_order_acquire);
+
+		if (sequence == LogDequeuePosition + 1) {
+			write_log_record(LogRecords[index]);
+
+			LogSequences[index].store(LogDequeuePosition + LogRingCapacity, std::memory_order_release);
+			LogDequeuePosition++;
+			continue;
+		}
+
+		// caught up, a single flush for everything written since the last time
+		std::cout.flush();
+
+		// a producer that claimed a slot before the stop still gets written, as the positions won't match until it's published
+		if (!LoggerRunning.load(std::memory_order_acquire) &&
+			(LogDequeuePosition == LogEnqueuePosition.load(std::memory_order_acquire))) {
+			break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void start_logger() {
+	if (LoggerRunning.load(std::memory_order_relaxed)) return;
+
+	if (!LogRecords) {
+		LogRecords.reset(new LogRecord[LogRingCapacity]);
+		LogSequences.reset(new std::atomic<uint64_t>[LogRingCapacity]);
+	}
+
+	// the ring is empty whenever the logging thread isn't running, so it can start over from the beginning
+	for (uint64_t i = 0; i < LogRingCapacity; i++) {
+		LogSequences[i].store(i, std::memory_order_relaxed);
+	}
+	LogEnqueuePosition.store(0, std::memory_order_relaxed);
+	LogDequeuePosition = 0;
+
+	LoggerRunning.store(true, std::memory_order_release);
+	LoggerThread = std::thread(logger_loop);
+}
+
+void stop_logger() {
+	if (!LoggerRunning.load(std::memory_order_relaxed)) return;
+
+	LoggerRunning.store(false, std::memory_order_release);
+	LoggerThread.join();
+}
+
+LogLevel parse_log_level(const std::string& name) {
+	for (uint32_t i = 0; i < sizeof(LogLevelNames) / sizeof(LogLevelNames[0]); i++) {
+		if (name == LogLevelNames[i]) return (LogLevel) i;
+	}
+
+	throw std::runtime_error("Unknown log level " + name);
+}
+
+LogRecord& begin_log_record(LogLevel level, const char* format) {
+	LogRecord* record = &SynchronousRecord;
+
+	if (LoggerRunning.load(std::memory_order_acquire)) {
+		uint64_t position = LogEnqueuePosition.load(std::memory_order_relaxed);
+
+		while (true) {
+			uint64_t index = position & (LogRingCapacity - 1);
+			int64_t difference = (int64_t) LogSequences[index].load(std::memory_order_acquire) - (int64_t) position;
+
+			if (difference == 0) {
+				if (LogEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					record = &LogRecords[index];
+					break;
+				}
+			} else if (difference < 0) {
+				// full, give the logging thread a chance to catch up rather than dropping the message
+				std::this_thread::yield();
+				position = LogEnqueuePosition.load(std::memory_order_relaxed);
+			} else {
+				// another producer got there first
+				position = LogEnqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	record->level = level;
+	record->argumentCount = 0;
+	record->stringSize = 0;
+	record->timeNs = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - LogStart).count();
+	record->format = format;
+
+	return *record;
+}
+
+void end_log_record(LogRecord& record) {
+	if (&record == &SynchronousRecord) {
+		write_log_record(record);
+		return;
+	}
+
+	// the slot's sequence can't change while it's claimed, so it's still the claimed position
+	std::atomic<uint64_t>& sequence = LogSequences[&record - LogRecords.get()];
+	sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
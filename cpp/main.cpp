@@ -1,115 +1,125 @@
 #include "main.hpp"
 
-const int WIDTH = 800;
-const int HEIGHT = 600;
+// record the draw list with increasing thread counts and exit instead of rendering
+bool BenchmarkRecording = false;
+// cull a million objects with every CPU culling kernel and exit instead of rendering
+bool BenchmarkCulling = false;
+// batch up to a hundred thousand sprites and exit instead of rendering
+bool BenchmarkSprites = false;
+// stream a few hundred MB through the upload queue and exit instead of rendering
+bool BenchmarkUploads = false;
+// fragment device memory, compact it and exit instead of rendering
+bool BenchmarkDefragmentation = false;
+
+// where to write a Chrome trace of the run, tracing is off when empty
+std::string TraceFilename;
+
+int main(int argc, char** argv) {
+    start_logger();
 
-GLFWwindow* Window;
-
-int main() {
     try {
+        parse_arguments(argc, argv);
+
+        set_trace_thread_name("main");
+
         init_window();
 
         init_vulkan();
         
-        main_loop();
+        if (BenchmarkRecording) {
+            benchmark_recording(20);
+        } else if (BenchmarkCulling) {
+            benchmark_culling(1000000, 20);
+        } else if (BenchmarkSprites) {
+            benchmark_sprite_batching(20);
+        } else if (BenchmarkUploads) {
+            benchmark_uploads();
+        } else if (BenchmarkDefragmentation) {
+            benchmark_defragmentation();
+        } else {
+            main_loop();
+        }
 
         cleanup();
-    } catch (const std::runtime_error& error) {
-        std::cerr << error.what() << std::endl;
+
+        if (!TraceFilename.empty()) {
+            write_trace(TraceFilename);
+        }
+    } catch (const std::exception& error) {
+        LOG_ERROR("{}", error.what());
+        stop_logger();
 
         return EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
-}
-
-void init_window() {
-    glfwInit();
-
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-    Window = glfwCreateWindow(WIDTH, HEIGHT, "vk-renderer", nullptr, nullptr);
-}
-
-void init_vulkan() {
-    create_instance();
-
-    setup_debug_callback();
-
-	create_surface();
-
-    pick_physical_device();
-
-	create_logical_device();
-
-	create_swap_chain(WIDTH, HEIGHT);
-
-	create_image_views();
-
-	create_render_pass();
-
-	create_graphics_pipeline();
-
-	create_framebuffers();
+    stop_logger();
 
-	create_command_pool();
-
-	create_command_buffers();
-
-	create_semaphores();
+    return EXIT_SUCCESS;
 }
 
-void create_surface()
-{
-	if (glfwCreateWindowSurface(Instance, Window, nullptr, &Surface) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create window surface");
+void parse_arguments(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+
+		if ((argument == "--frames-in-flight") && (i + 1 < argc)) {
+			FramesInFlight = parse_uint32_argument(argument, argv[++i]);
+		} else if (argument == "--headless") {
+			Headless = true;
+		} else if ((argument == "--frames") && (i + 1 < argc)) {
+			HeadlessFrameCount = parse_uint64_argument(argument, argv[++i]);
+		} else if ((argument == "--shader-dir") && (i + 1 < argc)) {
+			ShaderOverrideDirectory = argv[++i];
+		} else if ((argument == "--mesh-triangles") && (i + 1 < argc)) {
+			MeshTriangleCount = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--instances") && (i + 1 < argc)) {
+			InstanceCount = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--instanced-objects") && (i + 1 < argc)) {
+			InstancedObjectCount = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--sprites") && (i + 1 < argc)) {
+			SpriteCount = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--upload-stream") && (i + 1 < argc)) {
+			UploadStreamMegabytes = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--particles") && (i + 1 < argc)) {
+			ParticleCount = parse_uint32_argument(argument, argv[++i]);
+		} else if (argument == "--no-async-compute") {
+			AsyncComputeEnabled = false;
+		} else if (argument == "--gpu-culling") {
+			GpuCullingEnabled = true;
+		} else if (argument == "--cpu-culling") {
+			CpuCullingEnabled = true;
+		} else if ((argument == "--cull-kernel") && (i + 1 < argc)) {
+			CpuCullingKernel = parse_culling_kernel(argv[++i]);
+		} else if (argument == "--no-depth-test") {
+			DepthTestEnabled = false;
+		} else if (argument == "--object-uniforms") {
+			ObjectData = ObjectDataPath::UniformBuffer;
+		} else if (argument == "--animate-objects") {
+			ObjectAnimationEnabled = true;
+		} else if (argument == "--no-draw-sorting") {
+			DrawSortingEnabled = false;
+		} else if ((argument == "--draws") && (i + 1 < argc)) {
+			DrawCount = parse_uint32_argument(argument, argv[++i]);
+		} else if ((argument == "--record-threads") && (i + 1 < argc)) {
+			RecordingThreadCount = parse_uint32_argument(argument, argv[++i]);
+		} else if (argument == "--pipeline-statistics") {
+			PipelineStatisticsEnabled = true;
+		} else if ((argument == "--trace") && (i + 1 < argc)) {
+			TraceFilename = argv[++i];
+			start_tracing();
+		} else if ((argument == "--log-level") && (i + 1 < argc)) {
+			MinimumLogLevel = parse_log_level(argv[++i]);
+		} else if (argument == "--benchmark-recording") {
+			BenchmarkRecording = true;
+		} else if (argument == "--benchmark-culling") {
+			BenchmarkCulling = true;
+		} else if (argument == "--benchmark-sprites") {
+			BenchmarkSprites = true;
+		} else if (argument == "--benchmark-uploads") {
+			BenchmarkUploads = true;
+		} else if (argument == "--benchmark-defragmentation") {
+			BenchmarkDefragmentation = true;
+		} else {
+			throw std::runtime_error("Unknown argument " + argument);
+		}
 	}
 }
-
-void main_loop() {
-    while(!glfwWindowShouldClose(Window)) {
-        glfwPollEvents();
-
-		draw_frame();
-    }
-
-	vkDeviceWaitIdle(Device);
-}
-
-void draw_frame() {
-	uint32_t imageIndex = 0;
-	vkAcquireNextImageKHR(Device, SwapChain, std::numeric_limits<uint64_t>::max(), ImageAvailableSemaphore,
-		VK_NULL_HANDLE, &imageIndex);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &ImageAvailableSemaphore;
-
-	VkPipelineStageFlags waitForStages[] = { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
-	submitInfo.pWaitDstStageMask = waitForStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &CommandBuffers[imageIndex];
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &RenderFinishSemaphore;
-
-	vkQueueSubmit(GraphicsQueue, 1, &submitInfo, NULL);
-
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = &SwapChain;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = &RenderFinishSemaphore;
-	presentInfo.pImageIndices = &imageIndex;
-
-	vkQueuePresentKHR(PresentQueue, &presentInfo);
-}
-
-void cleanup() {
-	vulkan_cleanup();
-
-    glfwDestroyWindow(Window);
-
-    glfwTerminate();
-}
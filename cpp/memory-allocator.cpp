@@ -0,0 +1,837 @@
+#include "memory-allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "vulkan-utils.hpp"
+
+MemoryAllocator Allocator;
+
+static uint32_t find_lowest_set_bit(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanForward64(&index, value);
+	return (uint32_t) index;
+#else
+	return (uint32_t) __builtin_ctzll(value);
+#endif
+}
+
+static uint32_t find_highest_set_bit(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanReverse64(&index, value);
+	return (uint32_t) index;
+#else
+	return 63 - (uint32_t) __builtin_clzll(value);
+#endif
+}
+
+// Vulkan alignments are always powers of two
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// TlsfBlockMetadata
+
+void TlsfBlockMetadata::init(VkDeviceSize size, VkDeviceSize bufferImageGranularity)
+{
+	blockSize = size;
+	granularity = std::max<VkDeviceSize>(bufferImageGranularity, 1);
+	usedBytes = 0;
+	allocationCount = 0;
+
+	firstNode = create_node();
+	firstNode->offset = 0;
+	firstNode->size = size;
+	insert_free(firstNode);
+}
+
+void TlsfBlockMetadata::destroy()
+{
+	TlsfNode* node = firstNode;
+	while (node) {
+		TlsfNode* next = node->nextPhysical;
+		delete node;
+		node = next;
+	}
+	firstNode = nullptr;
+
+	for (auto spareNode : spareNodes) {
+		delete spareNode;
+	}
+	spareNodes.clear();
+
+	firstLevelBitmap = 0;
+	std::memset(secondLevelBitmaps, 0, sizeof(secondLevelBitmaps));
+	std::memset(freeLists, 0, sizeof(freeLists));
+}
+
+TlsfNode* TlsfBlockMetadata::allocate(VkDeviceSize size, VkDeviceSize alignment, AllocationType type,
+	VkDeviceSize limit)
+{
+	if ((size == 0) || (size > blockSize)) return nullptr;
+
+	// the list for this size class can hold ranges a little smaller than size, every list after it only has
+	// ranges that are big enough, so the first one that also satisfies alignment/granularity is taken
+	uint32_t firstLevel = 0;
+	uint32_t secondLevel = 0;
+	get_list_index(size, firstLevel, secondLevel);
+
+	uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+	while (true) {
+		while (secondLevelMap) {
+			uint32_t listIndex = find_lowest_set_bit(secondLevelMap);
+
+			for (TlsfNode* node = freeLists[firstLevel][listIndex]; node; node = node->nextFree) {
+				VkDeviceSize offset = 0;
+				if (!fits(node, size, alignment, type, limit, offset)) continue;
+
+				remove_free(node);
+
+				// keep the alignment padding as a free range of its own
+				if (offset > node->offset) {
+					TlsfNode* padding = node;
+					node = split(padding, offset - padding->offset);
+					insert_free(padding);
+				}
+
+				if (node->size > size) {
+					insert_free(split(node, size));
+				}
+
+				node->type = type;
+				usedBytes += node->size;
+				allocationCount++;
+
+				return node;
+			}
+
+			secondLevelMap &= secondLevelMap - 1;
+		}
+
+		uint64_t firstLevelMap = (firstLevel + 1 < 64) ? (firstLevelBitmap & (~0ull << (firstLevel + 1))) : 0;
+		if (!firstLevelMap) return nullptr;
+
+		firstLevel = find_lowest_set_bit(firstLevelMap);
+		secondLevelMap = secondLevelBitmaps[firstLevel];
+	}
+}
+
+void TlsfBlockMetadata::free(TlsfNode* node)
+{
+	usedBytes -= node->size;
+	allocationCount--;
+	node->type = AllocationType::Free;
+
+	// no two free ranges are ever left next to each other
+	if (node->nextPhysical && node->nextPhysical->is_free()) {
+		remove_free(node->nextPhysical);
+		merge_with_next(node);
+	}
+
+	if (node->previousPhysical && node->previousPhysical->is_free()) {
+		TlsfNode* previous = node->previousPhysical;
+		remove_free(previous);
+		merge_with_next(previous);
+		node = previous;
+	}
+
+	insert_free(node);
+}
+
+VkDeviceSize TlsfBlockMetadata::largest_free_range() const
+{
+	if (!firstLevelBitmap) return 0;
+
+	uint32_t firstLevel = find_highest_set_bit(firstLevelBitmap);
+	uint32_t secondLevel = find_highest_set_bit(secondLevelBitmaps[firstLevel]);
+
+	VkDeviceSize largest = 0;
+	for (TlsfNode* node = freeLists[firstLevel][secondLevel]; node; node = node->nextFree) {
+		largest = std::max(largest, node->size);
+	}
+
+	return largest;
+}
+
+void TlsfBlockMetadata::get_list_index(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel) const
+{
+	if (size < (1ull << SmallSizeLog2)) {
+		firstLevel = 0;
+		secondLevel = (uint32_t) (size >> (SmallSizeLog2 - SecondLevelLog2));
+	} else {
+		uint32_t highestBit = find_highest_set_bit(size);
+		firstLevel = highestBit - SmallSizeLog2 + 1;
+		secondLevel = (uint32_t) (size >> (highestBit - SecondLevelLog2)) ^ SecondLevelCount;
+	}
+}
+
+bool TlsfBlockMetadata::fits(const TlsfNode* node, VkDeviceSize size, VkDeviceSize alignment, AllocationType type,
+	VkDeviceSize limit, VkDeviceSize& offset) const
+{
+	VkDeviceSize candidate = align_up(node->offset, alignment);
+
+	const TlsfNode* previous = node->previousPhysical;
+	if (previous && !previous->is_free() && is_granularity_conflict(previous->type, type) &&
+		on_same_page(previous->offset + previous->size - 1, candidate)) {
+		candidate = align_up(candidate, granularity);
+	}
+
+	VkDeviceSize end = candidate + size;
+	if ((end > node->offset + node->size) || (end > limit)) return false;
+
+	const TlsfNode* next = node->nextPhysical;
+	if (next && !next->is_free() && is_granularity_conflict(type, next->type) &&
+		on_same_page(end - 1, next->offset)) {
+		return false;
+	}
+
+	offset = candidate;
+	return true;
+}
+
+bool TlsfBlockMetadata::is_granularity_conflict(AllocationType first, AllocationType second) const
+{
+	if (granularity == 1) return false;
+
+	return (first == AllocationType::ImageOptimal) != (second == AllocationType::ImageOptimal);
+}
+
+bool TlsfBlockMetadata::on_same_page(VkDeviceSize firstEnd, VkDeviceSize secondStart) const
+{
+	return (firstEnd & ~(granularity - 1)) == (secondStart & ~(granularity - 1));
+}
+
+void TlsfBlockMetadata::insert_free(TlsfNode* node)
+{
+	uint32_t firstLevel = 0;
+	uint32_t secondLevel = 0;
+	get_list_index(node->size, firstLevel, secondLevel);
+
+	node->type = AllocationType::Free;
+	node->previousFree = nullptr;
+	node->nextFree = freeLists[firstLevel][secondLevel];
+	if (node->nextFree) {
+		node->nextFree->previousFree = node;
+	}
+	freeLists[firstLevel][secondLevel] = node;
+
+	firstLevelBitmap |= 1ull << firstLevel;
+	secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+void TlsfBlockMetadata::remove_free(TlsfNode* node)
+{
+	uint32_t firstLevel = 0;
+	uint32_t secondLevel = 0;
+	get_list_index(node->size, firstLevel, secondLevel);
+
+	if (node->previousFree) {
+		node->previousFree->nextFree = node->nextFree;
+	} else {
+		freeLists[firstLevel][secondLevel] = node->nextFree;
+	}
+
+	if (node->nextFree) {
+		node->nextFree->previousFree = node->previousFree;
+	}
+
+	if (!freeLists[firstLevel][secondLevel]) {
+		secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+		if (!secondLevelBitmaps[firstLevel]) {
+			firstLevelBitmap &= ~(1ull << firstLevel);
+		}
+	}
+
+	node->previousFree = nullptr;
+	node->nextFree = nullptr;
+}
+
+TlsfNode* TlsfBlockMetadata::split(TlsfNode* node, VkDeviceSize firstSize)
+{
+	TlsfNode* second = create_node();
+	second->offset = node->offset + firstSize;
+	second->size = node->size - firstSize;
+
+	second->previousPhysical = node;
+	second->nextPhysical = node->nextPhysical;
+	if (second->nextPhysical) {
+		second->nextPhysical->previousPhysical = second;
+	}
+
+	node->nextPhysical = second;
+	node->size = firstSize;
+
+	return second;
+}
+
+void TlsfBlockMetadata::merge_with_next(TlsfNode* node)
+{
+	TlsfNode* next = node->nextPhysical;
+
+	node->size += next->size;
+	node->nextPhysical = next->nextPhysical;
+	if (node->nextPhysical) {
+		node->nextPhysical->previousPhysical = node;
+	}
+
+	release_node(next);
+}
+
+TlsfNode* TlsfBlockMetadata::create_node()
+{
+	if (spareNodes.empty()) {
+		return new TlsfNode();
+	}
+
+	TlsfNode* node = spareNodes.back();
+	spareNodes.pop_back();
+	*node = TlsfNode();
+
+	return node;
+}
+
+void TlsfBlockMetadata::release_node(TlsfNode* node)
+{
+	spareNodes.push_back(node);
+}
+
+// MemoryAllocator
+
+void MemoryAllocator::init(VkDevice device, const VkPhysicalDeviceProperties& deviceProps,
+	const VkPhysicalDeviceMemoryProperties& memoryProperties)
+{
+	this->device = device;
+	this->memoryProperties = memoryProperties;
+
+	bufferImageGranularity = std::max<VkDeviceSize>(deviceProps.limits.bufferImageGranularity, 1);
+	nonCoherentAtomSize = std::max<VkDeviceSize>(deviceProps.limits.nonCoherentAtomSize, 1);
+	maxDeviceAllocationCount = deviceProps.limits.maxMemoryAllocationCount;
+	deviceAllocationCount = 0;
+}
+
+void MemoryAllocator::destroy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& typeBlocks : blocks) {
+		for (auto& block : typeBlocks) {
+			if (!block->metadata.empty()) {
+				LOG_WARNING("Memory block released with {} allocation(s) still in it", block->metadata.allocation_count());
+			}
+
+			if (block->mapped) {
+				vkUnmapMemory(device, block->memory);
+			}
+			vkFreeMemory(device, block->memory, nullptr);
+			block->metadata.destroy();
+		}
+
+		typeBlocks.clear();
+	}
+
+	deviceAllocationCount = 0;
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+	AllocationType type)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// memory types are ordered by preference, so fall back to the next compatible one if a type is exhausted
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if (!(requirements.memoryTypeBits & (1u << i)) ||
+			((memoryProperties.memoryTypes[i].propertyFlags & properties) != properties)) {
+			continue;
+		}
+
+		Allocation allocation;
+		if (try_allocate(i, requirements, type, allocation)) {
+			return allocation;
+		}
+	}
+
+	throw std::runtime_error("Could not allocate " + std::to_string(requirements.size) + " bytes of device memory");
+}
+
+void MemoryAllocator::free(Allocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	free_locked(allocation);
+}
+
+void MemoryAllocator::flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (memoryProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+		return;
+	}
+
+	// flushed ranges have to be aligned to nonCoherentAtomSize, but can't run past the end of the block
+	VkDeviceSize start = allocation.offset + offset;
+	VkDeviceSize end = (size == VK_WHOLE_SIZE) ? (allocation.offset + allocation.size) : (start + size);
+
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = start & ~(nonCoherentAtomSize - 1);
+	range.size = std::min(align_up(end, nonCoherentAtomSize), allocation.block->metadata.size()) - range.offset;
+
+	vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+uint32_t MemoryAllocator::defragment(const std::vector<Buffer*>& buffers, VkCommandPool commandPool, VkQueue queue)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// blocks of each type ordered fullest first, a buffer is only ever moved into a block ahead of its own
+	// (or further towards the start of its own), so the emptiest blocks drain and can be released
+	std::vector<MemoryBlock*> blockOrder[VK_MAX_MEMORY_TYPES];
+	std::unordered_map<MemoryBlock*, size_t> blockRank;
+	for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++) {
+		for (auto& block : blocks[type]) {
+			if (!block->dedicated) {
+				blockOrder[type].push_back(block.get());
+			}
+		}
+
+		std::stable_sort(blockOrder[type].begin(), blockOrder[type].end(), [](MemoryBlock* first, MemoryBlock* second) {
+			return first->metadata.used_bytes() > second->metadata.used_bytes();
+		});
+
+		for (size_t rank = 0; rank < blockOrder[type].size(); rank++) {
+			blockRank[blockOrder[type][rank]] = rank;
+		}
+	}
+
+	std::vector<Buffer*> candidates;
+	for (auto buffer : buffers) {
+		if (buffer->allocation.block && !buffer->allocation.block->dedicated) {
+			candidates.push_back(buffer);
+		}
+	}
+
+	// empty the least used blocks first, from the back
+	std::sort(candidates.begin(), candidates.end(), [&blockRank](Buffer* first, Buffer* second) {
+		size_t firstRank = blockRank[first->allocation.block];
+		size_t secondRank = blockRank[second->allocation.block];
+		if (firstRank != secondRank) return firstRank > secondRank;
+
+		return first->allocation.offset > second->allocation.offset;
+	});
+
+	struct Move {
+		Buffer* buffer;
+		VkBuffer newBuffer;
+		Allocation newAllocation;
+	};
+	std::vector<Move> moves;
+
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+	for (auto buffer : candidates) {
+		const Allocation& source = buffer->allocation;
+
+		bool hostVisible = source.mapped != nullptr;
+		bool copyable = (buffer->usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) &&
+			(buffer->usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		if (!hostVisible && !copyable) continue;
+
+		VkBufferCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		createInfo.size = buffer->size;
+		createInfo.usage = buffer->usage;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkBuffer newBuffer = VK_NULL_HANDLE;
+		if (vkCreateBuffer(device, &createInfo, nullptr, &newBuffer) != VK_SUCCESS) continue;
+
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(device, newBuffer, &requirements);
+
+		auto& order = blockOrder[source.memoryTypeIndex];
+		size_t sourceRank = blockRank[source.block];
+
+		MemoryBlock* destination = nullptr;
+		TlsfNode* node = nullptr;
+		for (size_t rank = 0; (rank <= sourceRank) && !node; rank++) {
+			VkDeviceSize limit = (order[rank] == source.block) ? source.offset : std::numeric_limits<VkDeviceSize>::max();
+
+			destination = order[rank];
+			node = destination->metadata.allocate(requirements.size, requirements.alignment, AllocationType::Buffer, limit);
+		}
+
+		if (!node) {
+			vkDestroyBuffer(device, newBuffer, nullptr);
+			continue;
+		}
+
+		Allocation newAllocation;
+		newAllocation.memory = destination->memory;
+		newAllocation.offset = node->offset;
+		newAllocation.size = node->size;
+		newAllocation.mapped = destination->mapped ? (static_cast<char*>(destination->mapped) + node->offset) : nullptr;
+		newAllocation.memoryTypeIndex = destination->memoryTypeIndex;
+		newAllocation.block = destination;
+		newAllocation.node = node;
+
+		// the node goes straight back to its block, releasing blocks here would pull them out from under blockOrder
+		if (vkBindBufferMemory(device, newBuffer, newAllocation.memory, newAllocation.offset) != VK_SUCCESS) {
+			destination->metadata.free(node);
+			vkDestroyBuffer(device, newBuffer, nullptr);
+			continue;
+		}
+
+		if (hostVisible) {
+			std::memcpy(newAllocation.mapped, source.mapped, (size_t) buffer->size);
+			flush(newAllocation, 0, VK_WHOLE_SIZE);
+		} else {
+			if (commandBuffer == VK_NULL_HANDLE) {
+				commandBuffer = begin_single_time_commands(commandPool);
+			}
+
+			VkBufferCopy region = {};
+			region.size = buffer->size;
+			vkCmdCopyBuffer(commandBuffer, buffer->buffer, newBuffer, 1, &region);
+		}
+
+		moves.push_back({ buffer, newBuffer, newAllocation });
+	}
+
+	if (commandBuffer != VK_NULL_HANDLE) {
+		end_single_time_commands(commandPool, queue, commandBuffer);
+	}
+
+	uint32_t blocksBefore = 0;
+	for (auto& typeBlocks : blocks) {
+		blocksBefore += (uint32_t) typeBlocks.size();
+	}
+
+	for (auto& move : moves) {
+		vkDestroyBuffer(device, move.buffer->buffer, nullptr);
+		free_locked(move.buffer->allocation);
+
+		move.buffer->buffer = move.newBuffer;
+		move.buffer->allocation = move.newAllocation;
+	}
+
+	uint32_t blocksAfter = 0;
+	for (auto& typeBlocks : blocks) {
+		blocksAfter += (uint32_t) typeBlocks.size();
+	}
+
+	LOG_INFO("Defragmentation moved {} buffer(s) and released {} memory block(s)", moves.size(), blocksBefore - blocksAfter);
+
+	return (uint32_t) moves.size();
+}
+
+AllocatorStatistics MemoryAllocator::get_statistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	AllocatorStatistics statistics;
+	VkDeviceSize freeBytes = 0;
+
+	for (auto& typeBlocks : blocks) {
+		for (auto& block : typeBlocks) {
+			const auto& metadata = block->metadata;
+
+			statistics.blockCount++;
+			statistics.allocationCount += metadata.allocation_count();
+			statistics.bytesAllocated += metadata.size();
+			statistics.bytesUsed += metadata.used_bytes();
+			statistics.largestFreeRange = std::max(statistics.largestFreeRange, metadata.largest_free_range());
+
+			freeBytes += metadata.size() - metadata.used_bytes();
+		}
+	}
+
+	if (freeBytes > 0) {
+		statistics.fragmentation = 1.f - ((float) statistics.largestFreeRange / (float) freeBytes);
+	}
+
+	return statistics;
+}
+
+void MemoryAllocator::print_statistics()
+{
+	auto statistics = get_statistics();
+
+	const double megabyte = 1024.0 * 1024.0;
+	LOG_INFO("Memory allocator: {} block(s), {} allocation(s), {} MB used of {} MB allocated, largest free range {} MB, "
+		"{}% fragmented", statistics.blockCount, statistics.allocationCount, statistics.bytesUsed / megabyte,
+		statistics.bytesAllocated / megabyte, statistics.largestFreeRange / megabyte, statistics.fragmentation * 100.f);
+}
+
+VkDeviceSize MemoryAllocator::preferred_block_size(uint32_t memoryTypeIndex) const
+{
+	const VkDeviceSize megabyte = 1024 * 1024;
+
+	// small heaps (like the 256MB device local + host visible one) get smaller blocks so one block
+	// doesn't claim most of the heap
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+	if (heapSize <= 1024 * megabyte) {
+		return align_up(heapSize / 8, megabyte);
+	}
+
+	return 256 * megabyte;
+}
+
+bool MemoryAllocator::try_allocate(uint32_t memoryTypeIndex, const VkMemoryRequirements& requirements,
+	AllocationType type, Allocation& allocation)
+{
+	VkDeviceSize blockSize = preferred_block_size(memoryTypeIndex);
+	bool dedicated = requirements.size > blockSize / 2;
+
+	MemoryBlock* block = nullptr;
+	TlsfNode* node = nullptr;
+
+	if (!dedicated) {
+		for (auto& candidate : blocks[memoryTypeIndex]) {
+			if (candidate->dedicated) continue;
+
+			node = candidate->metadata.allocate(requirements.size, requirements.alignment, type);
+			if (node) {
+				block = candidate.get();
+				break;
+			}
+		}
+	}
+
+	if (!node) {
+		block = create_block(memoryTypeIndex, dedicated ? requirements.size : blockSize, dedicated);
+
+		// the heap may not have room for a whole block any more, try smaller ones before giving up
+		while (!block && !dedicated && (blockSize / 2 >= requirements.size)) {
+			blockSize /= 2;
+			block = create_block(memoryTypeIndex, blockSize, false);
+		}
+
+		if (!block) return false;
+
+		node = block->metadata.allocate(requirements.size, requirements.alignment, type);
+		if (!node) return false;
+	}
+
+	allocation.memory = block->memory;
+	allocation.offset = node->offset;
+	allocation.size = node->size;
+	allocation.mapped = block->mapped ? (static_cast<char*>(block->mapped) + node->offset) : nullptr;
+	allocation.memoryTypeIndex = memoryTypeIndex;
+	allocation.block = block;
+	allocation.node = node;
+
+	return true;
+}
+
+MemoryBlock* MemoryAllocator::create_block(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated)
+{
+	if (deviceAllocationCount >= maxDeviceAllocationCount) return nullptr;
+
+	VkMemoryAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = size;
+	allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+	auto block = std::make_unique<MemoryBlock>();
+	if (vkAllocateMemory(device, &allocateInfo, nullptr, &block->memory) != VK_SUCCESS) {
+		return nullptr;
+	}
+
+	if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+			vkFreeMemory(device, block->memory, nullptr);
+			return nullptr;
+		}
+	}
+
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->dedicated = dedicated;
+	block->metadata.init(size, bufferImageGranularity);
+
+	deviceAllocationCount++;
+	blocks[memoryTypeIndex].push_back(std::move(block));
+
+	return blocks[memoryTypeIndex].back().get();
+}
+
+void MemoryAllocator::free_locked(Allocation& allocation)
+{
+	if (!allocation.block) return;
+
+	MemoryBlock* block = allocation.block;
+	block->metadata.free(allocation.node);
+	allocation = Allocation();
+
+	if (block->metadata.empty()) {
+		release_empty_blocks(block->memoryTypeIndex);
+	}
+}
+
+void MemoryAllocator::release_empty_blocks(uint32_t memoryTypeIndex)
+{
+	// one empty shared block is kept around so a resource freed and recreated every frame doesn't
+	// allocate and free device memory every frame too
+	bool keptEmptyBlock = false;
+
+	auto& typeBlocks = blocks[memoryTypeIndex];
+	for (auto it = typeBlocks.begin(); it != typeBlocks.end();) {
+		MemoryBlock* block = it->get();
+
+		if (!block->metadata.empty() || (!block->dedicated && !keptEmptyBlock)) {
+			keptEmptyBlock = keptEmptyBlock || block->metadata.empty();
+			++it;
+			continue;
+		}
+
+		if (block->mapped) {
+			vkUnmapMemory(device, block->memory);
+		}
+		vkFreeMemory(device, block->memory, nullptr);
+		block->metadata.destroy();
+
+		deviceAllocationCount--;
+		it = typeBlocks.erase(it);
+	}
+}
+
+// TransientRingBuffer
+
+void TransientRingBuffer::create(VkDeviceSize capacity, VkBufferUsageFlags usage, uint32_t frameCount)
+{
+	ringBuffer = create_buffer(capacity, usage,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	head = 0;
+	usedBytes = 0;
+	currentFrame = 0;
+	frameUsage.assign(frameCount, 0);
+}
+
+void TransientRingBuffer::destroy()
+{
+	destroy_buffer(ringBuffer);
+	frameUsage.clear();
+}
+
+void TransientRingBuffer::begin_frame(uint32_t frameIndex)
+{
+	release_frame(frameIndex);
+	currentFrame = frameIndex;
+}
+
+void TransientRingBuffer::release_frame(uint32_t frameIndex)
+{
+	// frames complete in order, so the space this frame used last time is always the oldest in the ring
+	usedBytes -= frameUsage[frameIndex];
+	frameUsage[frameIndex] = 0;
+
+	if (usedBytes == 0) {
+		head = 0;
+	}
+}
+
+TransientAllocation TransientRingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	TransientAllocation allocation;
+	if (!try_allocate(size, alignment, allocation)) {
+		throw std::runtime_error("Transient ring buffer is full");
+	}
+
+	return allocation;
+}
+
+bool TransientRingBuffer::try_allocate(VkDeviceSize size, VkDeviceSize alignment, TransientAllocation& allocation)
+{
+	// align_up only works for powers of two
+	assert((alignment & (alignment - 1)) == 0);
+
+	VkDeviceSize capacity = ringBuffer.size;
+	VkDeviceSize tail = (head + capacity - usedBytes) % capacity;
+
+	// bytes consumed includes any padding and, when wrapping, the unused end of the ring
+	VkDeviceSize offset = align_up(head, std::max<VkDeviceSize>(alignment, 1));
+	VkDeviceSize consumed = 0;
+
+	if (usedBytes == capacity) {
+		return false;
+	} else if ((usedBytes == 0) || (tail < head)) {
+		// live data is [tail, head), free space is [head, capacity) followed by [0, tail)
+		if (offset + size <= capacity) {
+			consumed = (offset - head) + size;
+		} else if (size <= ((usedBytes == 0) ? capacity : tail)) {
+			consumed = (capacity - head) + size;
+			offset = 0;
+		} else {
+			return false;
+		}
+	} else {
+		// live data wraps around the end, free space is [head, tail)
+		if (offset + size > tail) {
+			return false;
+		}
+		consumed = (offset - head) + size;
+	}
+
+	head = offset + size;
+	usedBytes += consumed;
+	frameUsage[currentFrame] += consumed;
+
+	allocation.buffer = ringBuffer.buffer;
+	allocation.offset = offset;
+	allocation.mapped = static_cast<char*>(ringBuffer.allocation.mapped) + offset;
+
+	return true;
+}
+
+void benchmark_defragmentation()
+{
+	const uint32_t bufferCount = 768;
+	const VkDeviceSize bufferSize = 1ull << 20;
+
+	std::vector<Buffer> buffers(bufferCount);
+	for (auto& buffer : buffers) {
+		buffer = create_buffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	// keeping every third buffer leaves every block two thirds empty in holes no bigger than two buffers
+	std::vector<Buffer*> kept;
+	for (uint32_t i = 0; i < bufferCount; i++) {
+		if (i % 3 == 0) {
+			kept.push_back(&buffers[i]);
+		} else {
+			destroy_buffer(buffers[i]);
+		}
+	}
+
+	const double megabyte = 1024.0 * 1024.0;
+	auto log_statistics = [megabyte](const char* when, const AllocatorStatistics& statistics) {
+		LOG_INFO("  {}: {} block(s), {} MB used of {} MB allocated, largest free range {} MB, {}% fragmented", when,
+			statistics.blockCount, statistics.bytesUsed / megabyte, statistics.bytesAllocated / megabyte,
+			statistics.largestFreeRange / megabyte, statistics.fragmentation * 100.f);
+	};
+
+	LOG_INFO("Defragmenting {} buffer(s) of {} KB:", kept.size(), bufferSize >> 10);
+	log_statistics("before", Allocator.get_statistics());
+
+	auto defragmentStart = std::chrono::steady_clock::now();
+	uint32_t moved = Allocator.defragment(kept, CommandPool, GraphicsQueue);
+	double defragmentMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - defragmentStart).count();
+
+	log_statistics("after", Allocator.get_statistics());
+	LOG_INFO("  moved {} buffer(s) in {} ms", moved, defragmentMs);
+
+	for (auto buffer : kept) {
+		destroy_buffer(*buffer);
+	}
+}
@@ -0,0 +1,204 @@
+#include "mesh.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+
+#include "vulkan-utils.hpp"
+
+uint32_t MeshTriangleCount = 1;
+Mesh SceneMesh;
+
+VertexLayout Vertex::get_layout()
+{
+	VertexLayout layout;
+
+	VkVertexInputBindingDescription binding = {};
+	binding.binding = 0;
+	binding.stride = sizeof(Vertex);
+	binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	layout.bindings.push_back(binding);
+
+	VkVertexInputAttributeDescription position = {};
+	position.binding = 0;
+	position.location = 0;
+	position.format = VK_FORMAT_R32G32B32_SFLOAT;
+	position.offset = offsetof(Vertex, position);
+	layout.attributes.push_back(position);
+
+	VkVertexInputAttributeDescription color = {};
+	color.binding = 0;
+	color.location = 1;
+	color.format = VK_FORMAT_R32G32B32_SFLOAT;
+	color.offset = offsetof(Vertex, color);
+	layout.attributes.push_back(color);
+
+	return layout;
+}
+
+Mesh create_mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	Mesh mesh;
+	mesh.vertexCount = (uint32_t) vertices.size();
+	mesh.indexCount = (uint32_t) indices.size();
+
+	VkDeviceSize vertexBytes = sizeof(Vertex) * vertices.size();
+	VkDeviceSize indexBytes = sizeof(uint32_t) * indices.size();
+
+	// both go up through one staging buffer and one submit, vertices first then indices
+	Buffer stagingBuffer = create_buffer(vertexBytes + indexBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	char* stagingData = static_cast<char*>(stagingBuffer.allocation.mapped);
+	std::memcpy(stagingData, vertices.data(), (size_t) vertexBytes);
+	std::memcpy(stagingData + vertexBytes, indices.data(), (size_t) indexBytes);
+
+	mesh.vertexBuffer = create_buffer(vertexBytes,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	mesh.indexBuffer = create_buffer(indexBytes,
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkCommandBuffer commandBuffer = begin_single_time_commands(TransferCommandPool);
+
+	VkBufferCopy vertexRegion = {};
+	vertexRegion.srcOffset = 0;
+	vertexRegion.size = vertexBytes;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, mesh.vertexBuffer.buffer, 1, &vertexRegion);
+
+	VkBufferCopy indexRegion = {};
+	indexRegion.srcOffset = vertexBytes;
+	indexRegion.size = indexBytes;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, mesh.indexBuffer.buffer, 1, &indexRegion);
+
+	// copied on the transfer queue, so a dedicated transfer family has to hand the buffers over to graphics
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+	VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+
+	if (queueFamilyIndices.has_dedicated_transfer()) {
+		uint32_t transferFamily = queueFamilyIndices.transferFamily;
+		uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily;
+
+		record_buffer_release(commandBuffer, mesh.vertexBuffer, transferFamily, graphicsFamily,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		record_buffer_release(commandBuffer, mesh.indexBuffer, transferFamily, graphicsFamily,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+		acquireCommandBuffer = begin_single_time_commands(CommandPool);
+		record_buffer_acquire(acquireCommandBuffer, mesh.vertexBuffer, transferFamily, graphicsFamily,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		record_buffer_acquire(acquireCommandBuffer, mesh.indexBuffer, transferFamily, graphicsFamily,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+	}
+
+	end_transfer_commands(commandBuffer, acquireCommandBuffer);
+
+	destroy_buffer(stagingBuffer);
+
+	return mesh;
+}
+
+void create_triangle_grid(uint32_t triangleCount, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
+	if (triangleCount <= 1) {
+		vertices = {
+			{ { 0.0f, -0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+			{ { 0.5f, 0.5f, 0.0f }, { 0.0f, 1.0f, 0.0f } },
+			{ { -0.5f, 0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } }
+		};
+		indices = { 0, 1, 2 };
+
+		return;
+	}
+
+	// two triangles per cell, cells share their corner vertices
+	uint32_t cellCount = (triangleCount + 1) / 2;
+	uint32_t columns = (uint32_t) std::ceil(std::sqrt((double) cellCount));
+	uint32_t rows = (cellCount + columns - 1) / columns;
+
+	const float extent = 1.8f;
+	vertices.reserve((size_t) (columns + 1) * (rows + 1));
+	for (uint32_t y = 0; y <= rows; y++) {
+		for (uint32_t x = 0; x <= columns; x++) {
+			float u = (float) x / columns;
+			float v = (float) y / rows;
+
+			Vertex vertex;
+			vertex.position = glm::vec3(-0.9f + u * extent, -0.9f + v * extent, 0.0f);
+			vertex.color = glm::vec3(u, v, 1.0f - u);
+			vertices.push_back(vertex);
+		}
+	}
+
+	// clockwise on screen to match the pipeline's front face
+	indices.reserve((size_t) triangleCount * 3);
+	for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+		uint32_t cell = triangle / 2;
+		uint32_t topLeft = (cell / columns) * (columns + 1) + (cell % columns);
+		uint32_t topRight = topLeft + 1;
+		uint32_t bottomLeft = topLeft + columns + 1;
+		uint32_t bottomRight = bottomLeft + 1;
+
+		if (triangle % 2 == 0) {
+			indices.insert(indices.end(), { topLeft, topRight, bottomRight });
+		} else {
+			indices.insert(indices.end(), { topLeft, bottomRight, bottomLeft });
+		}
+	}
+}
+
+void create_scene_mesh()
+{
+	TRACE_ZONE("create_scene_mesh");
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	create_triangle_grid(MeshTriangleCount, vertices, indices);
+
+	SceneMesh = create_mesh(vertices, indices);
+
+	LOG_INFO("Uploaded mesh with {} vertices and {} triangles", SceneMesh.vertexCount, SceneMesh.triangle_count());
+
+	// while the vertices are still around to bound each draw with
+	build_draw_list(SceneMesh, vertices, indices, DrawCount);
+}
+
+glm::vec4 compute_bounding_sphere(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	uint32_t firstIndex, uint32_t indexCount)
+{
+	if (indexCount == 0) return glm::vec4(0.0f);
+
+	glm::vec3 minimum = vertices[indices[firstIndex]].position;
+	glm::vec3 maximum = minimum;
+	for (uint32_t i = firstIndex + 1; i < firstIndex + indexCount; i++) {
+		const glm::vec3& position = vertices[indices[i]].position;
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+
+	glm::vec3 centre = (minimum + maximum) * 0.5f;
+	return glm::vec4(centre, glm::length(maximum - centre));
+}
+
+void bind_mesh(VkCommandBuffer commandBuffer, const Mesh& mesh)
+{
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void destroy_mesh(Mesh& mesh)
+{
+	if (mesh.vertexBuffer.buffer != VK_NULL_HANDLE) {
+		destroy_buffer(mesh.vertexBuffer);
+	}
+	if (mesh.indexBuffer.buffer != VK_NULL_HANDLE) {
+		destroy_buffer(mesh.indexBuffer);
+	}
+
+	mesh = Mesh();
+}
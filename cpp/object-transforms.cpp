@@ -0,0 +1,152 @@
+#include "object-transforms.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+std::vector<glm::mat4> ObjectTransforms;
+bool ObjectAnimationEnabled = false;
+ObjectDataPath ObjectData = ObjectDataPath::PushConstants;
+TransientRingBuffer ObjectUniformRing;
+ObjectFrameData FrameObjects;
+
+// fixed like the particles' so runs are repeatable
+static const float AnimationTimeStep = 1.0f / 60.0f;
+static float AnimationSeconds = 0.0f;
+
+static_assert(sizeof(ObjectUniforms) == sizeof(glm::mat4), "ObjectUniforms is copied straight from ObjectTransforms");
+
+void create_object_data()
+{
+	TRACE_ZONE("create_object_data");
+
+	ObjectTransforms.assign(DrawList.size(), glm::mat4(1.0f));
+	AnimationSeconds = 0.0f;
+
+	if (Culling.is_enabled()) {
+		// the draws are written by the GPU, they can't have their own push constants or dynamic offsets
+		if (ObjectAnimationEnabled || (ObjectData != ObjectDataPath::PushConstants)) {
+			LOG_WARNING("Objects can't be moved when culling on the GPU, they're drawn where they are");
+		}
+		ObjectAnimationEnabled = false;
+		ObjectData = ObjectDataPath::PushConstants;
+		return;
+	}
+
+	if (sizeof(ObjectUniforms) > BindlessDescriptors::PushConstantBytes) {
+		ObjectData = ObjectDataPath::UniformBuffer;
+	}
+
+	if (ObjectData == ObjectDataPath::PushConstants) {
+		LOG_INFO("Pushing the data of {} object(s) before each draw", ObjectTransforms.size());
+		return;
+	}
+
+	VkDeviceSize alignment = PhysicalDeviceCapabilities.properties.limits.minUniformBufferOffsetAlignment;
+	VkDeviceSize stride = ((sizeof(ObjectUniforms) + alignment - 1) / alignment) * alignment;
+	// at least one object's worth even with nothing to draw, as the ring and the draw set's range can't be empty
+	VkDeviceSize frameBytes = stride * std::max<size_t>(ObjectTransforms.size(), 1);
+
+	VkDeviceSize capacity = TransientRingBuffer::capacity_for(frameBytes, FramesInFlight);
+	if (capacity > std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error("Too many objects for dynamic uniform buffer offsets");
+	}
+
+	ObjectUniformRing.create(capacity, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, FramesInFlight);
+	FrameObjects = ObjectFrameData();
+	FrameObjects.stride = (uint32_t) stride;
+
+	LOG_INFO("Writing the data of {} object(s) to a {} byte uniform ring, {} bytes apart", ObjectTransforms.size(),
+		capacity, stride);
+}
+
+void update_object_transforms()
+{
+	if (!ObjectAnimationEnabled) return;
+
+	TRACE_ZONE("update_object_transforms");
+
+	AnimationSeconds += AnimationTimeStep;
+
+	for (size_t i = 0; i < ObjectTransforms.size(); i++) {
+		const glm::vec4& centre = DrawList[i].boundingSphere;
+
+		// a rotation about z through the centre, which leaves the bounding sphere where it was
+		float angle = AnimationSeconds * (0.5f + (float) (i % 7) * 0.25f);
+		float cosine = std::cos(angle);
+		float sine = std::sin(angle);
+
+		glm::mat4& transform = ObjectTransforms[i];
+		transform[0][0] = cosine;
+		transform[0][1] = sine;
+		transform[1][0] = -sine;
+		transform[1][1] = cosine;
+		transform[3][0] = centre.x - (cosine * centre.x - sine * centre.y);
+		transform[3][1] = centre.y - (sine * centre.x + cosine * centre.y);
+	}
+}
+
+void write_object_uniforms(uint32_t frameIndex)
+{
+	if (ObjectData != ObjectDataPath::UniformBuffer) return;
+
+	TRACE_ZONE("write_object_uniforms");
+
+	VkDeviceSize alignment = PhysicalDeviceCapabilities.properties.limits.minUniformBufferOffsetAlignment;
+	uint32_t stride = FrameObjects.stride;
+
+	ObjectUniformRing.begin_frame(frameIndex);
+	TransientAllocation allocation = ObjectUniformRing.allocate((VkDeviceSize) stride * ObjectTransforms.size(), alignment);
+
+	char* destination = static_cast<char*>(allocation.mapped);
+	if (stride == sizeof(ObjectUniforms)) {
+		std::memcpy(destination, ObjectTransforms.data(), sizeof(ObjectUniforms) * ObjectTransforms.size());
+	} else {
+		for (size_t i = 0; i < ObjectTransforms.size(); i++) {
+			std::memcpy(destination + i * stride, &ObjectTransforms[i], sizeof(ObjectUniforms));
+		}
+	}
+
+	FrameObjects.baseOffset = (uint32_t) allocation.offset;
+	FrameObjects.descriptorSet = Frames.frames[frameIndex].descriptorAllocator.allocate(Bindless.drawSetLayout);
+
+	// the dynamic offset picks the object, the descriptor itself only ever covers one
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = ObjectUniformRing.buffer();
+	bufferInfo.offset = 0;
+	bufferInfo.range = sizeof(ObjectUniforms);
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = FrameObjects.descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+	vkUpdateDescriptorSets(Device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void record_object_data(VkCommandBuffer commandBuffer, uint32_t drawIndex)
+{
+	if (ObjectData == ObjectDataPath::PushConstants) {
+		Bindless.push_constants(commandBuffer, &ObjectTransforms[drawIndex], sizeof(ObjectUniforms));
+	} else {
+		uint32_t dynamicOffset = FrameObjects.baseOffset + drawIndex * FrameObjects.stride;
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Bindless.pipelineLayout,
+			BindlessDescriptors::DrawSet, 1, &FrameObjects.descriptorSet, 1, &dynamicOffset);
+	}
+}
+
+void destroy_object_data()
+{
+	if (ObjectData == ObjectDataPath::UniformBuffer) {
+		ObjectUniformRing.destroy();
+	}
+
+	ObjectTransforms.clear();
+	FrameObjects = ObjectFrameData();
+}
@@ -0,0 +1,208 @@
+#include "particles.hpp"
+
+#include <cstddef>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+uint32_t ParticleCount = 0;
+float ParticleTimeStep = 1.0f / 60.0f;
+ParticleSystem Particles;
+bool AsyncComputeEnabled = true;
+
+// signalled by the last frame submitted once it's done drawing the particles, the next step waits on it
+static VkSemaphore ParticlesReleasedSemaphore = VK_NULL_HANDLE;
+
+static_assert(sizeof(ParticleSimulationConstants) <= BindlessDescriptors::PushConstantBytes,
+	"Particle simulation constants don't fit");
+
+VertexLayout Particle::get_layout()
+{
+	VertexLayout layout;
+
+	VkVertexInputBindingDescription binding = {};
+	binding.binding = 0;
+	binding.stride = sizeof(Particle);
+	binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	layout.bindings.push_back(binding);
+
+	VkVertexInputAttributeDescription position = {};
+	position.binding = 0;
+	position.location = 0;
+	position.format = VK_FORMAT_R32G32_SFLOAT;
+	position.offset = offsetof(Particle, position);
+	layout.attributes.push_back(position);
+
+	VkVertexInputAttributeDescription color = {};
+	color.binding = 0;
+	color.location = 1;
+	color.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	color.offset = offsetof(Particle, color);
+	layout.attributes.push_back(color);
+
+	return layout;
+}
+
+bool particles_simulated_async()
+{
+	return (ParticleCount > 0) && AsyncComputeEnabled &&
+		PhysicalDeviceCapabilities.queueFamilyIndices.has_async_compute();
+}
+
+static void dispatch_particles(VkCommandBuffer commandBuffer, bool initialise)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Particles.computePipeline);
+
+	ParticleSimulationConstants constants = {};
+	constants.deltaSeconds = ParticleTimeStep;
+	constants.particleCount = Particles.particleCount;
+	constants.initialise = initialise ? 1 : 0;
+	constants.particleBuffer = Particles.particleBufferIndex;
+	Bindless.push_constants(commandBuffer, &constants, sizeof(constants));
+
+	uint32_t workgroupCount = (Particles.particleCount + ParticleSystem::WorkgroupSize - 1) / ParticleSystem::WorkgroupSize;
+	vkCmdDispatch(commandBuffer, workgroupCount, 1, 1);
+}
+
+void create_particle_system()
+{
+	TRACE_ZONE("create_particle_system");
+
+	if (ParticleCount == 0) return;
+
+	uint32_t workgroupCount = (ParticleCount + ParticleSystem::WorkgroupSize - 1) / ParticleSystem::WorkgroupSize;
+	if (workgroupCount > PhysicalDeviceCapabilities.properties.limits.maxComputeWorkGroupCount[0]) {
+		throw std::runtime_error("Too many particles for a single dispatch on this device");
+	}
+
+	Particles.particleCount = ParticleCount;
+	Particles.particleBuffer = create_buffer(sizeof(Particle) * ParticleCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	Particles.particleBufferIndex = Bindless.register_storage_buffer(Particles.particleBuffer);
+
+	Particles.computePipeline = create_compute_pipeline("particles.comp", Bindless.pipelineLayout);
+
+	// drawn over the scene without a depth test, the points are all at the same depth anyway
+	Particles.graphicsPipeline = build_graphics_pipeline("particle.vert", "particle.frag", Particle::get_layout(),
+		VK_PRIMITIVE_TOPOLOGY_POINT_LIST, Bindless.pipelineLayout, false);
+
+	// seeded on the GPU, so a million particles don't have to go through a staging buffer. The first frame's
+	// simulation barrier orders its step after this, or the acquire matching the release here when async.
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+	VkCommandBuffer commandBuffer = begin_single_time_commands(CommandPool);
+	Bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+	dispatch_particles(commandBuffer, true);
+	if (particles_simulated_async()) {
+		record_buffer_release(commandBuffer, Particles.particleBuffer, queueFamilyIndices.graphicsFamily,
+			queueFamilyIndices.computeFamily, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	}
+	end_single_time_commands(CommandPool, GraphicsQueue, commandBuffer);
+
+	LOG_INFO("Created particle system with {} particles{}", Particles.particleCount,
+		particles_simulated_async() ? ", simulated on the compute queue" : "");
+}
+
+void record_particle_simulation(VkCommandBuffer commandBuffer)
+{
+	if (!Particles.is_enabled()) return;
+
+	dispatch_particles(commandBuffer, false);
+}
+
+void submit_particle_simulation(FrameSync& frame)
+{
+	TRACE_ZONE("submit_particle_simulation");
+
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+
+	// the frame's fence covers the step too, the frame's submission waited on it
+	vkResetCommandPool(Device, frame.computeCommandPool, 0);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(frame.computeCommandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin particle simulation command buffer");
+	}
+
+	record_buffer_acquire(frame.computeCommandBuffer, Particles.particleBuffer, queueFamilyIndices.graphicsFamily,
+		queueFamilyIndices.computeFamily, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	Bindless.bind(frame.computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+	dispatch_particles(frame.computeCommandBuffer, false);
+
+	record_buffer_release(frame.computeCommandBuffer, Particles.particleBuffer, queueFamilyIndices.computeFamily,
+		queueFamilyIndices.graphicsFamily, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	if (vkEndCommandBuffer(frame.computeCommandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record particle simulation command buffer");
+	}
+
+	// nothing to wait on for the first step, the seeding was waited on
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = (ParticlesReleasedSemaphore != VK_NULL_HANDLE) ? 1 : 0;
+	submitInfo.pWaitSemaphores = &ParticlesReleasedSemaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &frame.computeCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &frame.simulationFinishSemaphore;
+
+	if (vkQueueSubmit(ComputeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit particle simulation");
+	}
+
+	ParticlesReleasedSemaphore = frame.particlesReleasedSemaphore;
+}
+
+void record_particle_acquire(VkCommandBuffer commandBuffer)
+{
+	if (!Particles.is_enabled() || !particles_simulated_async()) return;
+
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+	record_buffer_acquire(commandBuffer, Particles.particleBuffer, queueFamilyIndices.computeFamily,
+		queueFamilyIndices.graphicsFamily, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+}
+
+void record_particle_release(VkCommandBuffer commandBuffer)
+{
+	if (!Particles.is_enabled() || !particles_simulated_async()) return;
+
+	// only read here, the semaphore the next step waits on is all the ordering it needs
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+	record_buffer_release(commandBuffer, Particles.particleBuffer, queueFamilyIndices.graphicsFamily,
+		queueFamilyIndices.computeFamily, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0);
+}
+
+void record_particle_draw(VkCommandBuffer commandBuffer)
+{
+	if (!Particles.is_enabled()) return;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Particles.graphicsPipeline);
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &Particles.particleBuffer.buffer, &offset);
+
+	vkCmdDraw(commandBuffer, Particles.particleCount, 1, 0, 0);
+}
+
+void destroy_particle_system()
+{
+	if (!Particles.is_enabled()) return;
+
+	vkDestroyPipeline(Device, Particles.graphicsPipeline, nullptr);
+	vkDestroyPipeline(Device, Particles.computePipeline, nullptr);
+
+	Bindless.release_storage_buffer(Particles.particleBufferIndex);
+	destroy_buffer(Particles.particleBuffer);
+
+	Particles = ParticleSystem();
+	ParticlesReleasedSemaphore = VK_NULL_HANDLE;
+}
@@ -0,0 +1,901 @@
+#include "render-graph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+RenderGraph FrameGraph;
+uint32_t ScenePass = 0;
+
+// Everything a ResourceUsage implies
+struct UsageInfo {
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	// what images are in while they're used, undefined for buffers
+	VkImageLayout layout;
+	VkImageUsageFlags imageUsage;
+	bool reads;
+	bool writes;
+	bool attachment;
+};
+
+// A pass' accesses of one resource merged together
+struct PassAccess {
+	uint32_t resource;
+	UsageInfo info;
+	bool clear;
+	VkClearValue clearValue;
+};
+
+// Where a resource (or a group of aliased transient images) was last written and read
+struct SyncState {
+	VkPipelineStageFlags writeStages = 0;
+	VkAccessFlags writeAccess = 0;
+	VkPipelineStageFlags readStages = 0;
+	// the stages the last write has been made visible to
+	VkPipelineStageFlags visibleStages = 0;
+};
+
+static const VkAccessFlags WriteAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+	VK_ACCESS_MEMORY_WRITE_BIT;
+
+static UsageInfo get_usage_info(ResourceUsage usage)
+{
+	switch (usage) {
+	case ResourceUsage::ColorAttachment:
+		return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true, true, true };
+	case ResourceUsage::DepthAttachment:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true, true, true };
+	case ResourceUsage::FragmentShaderRead:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, true, false, false };
+	case ResourceUsage::ComputeShaderRead:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, true, false, false };
+	case ResourceUsage::ComputeShaderWrite:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, false, true, false };
+	case ResourceUsage::ComputeShaderReadWrite:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, true, true, false };
+	case ResourceUsage::VertexBufferRead:
+		return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, 0, true, false, false };
+	case ResourceUsage::IndirectBufferRead:
+		return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, 0, true, false, false };
+	case ResourceUsage::TransferWrite:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, false, true, false };
+	}
+
+	throw std::runtime_error("Unknown resource usage");
+}
+
+static std::vector<PassAccess> get_pass_accesses(const RenderGraphPass& pass, const std::vector<RenderGraphResource>& resources)
+{
+	std::vector<PassAccess> accesses;
+
+	for (const auto& access : pass.accesses) {
+		UsageInfo info = get_usage_info(access.usage);
+		// cleared attachments don't care what was there before
+		if (access.clear) {
+			info.reads = false;
+		}
+
+		auto existing = std::find_if(accesses.begin(), accesses.end(),
+			[&](const PassAccess& other) { return other.resource == access.resource; });
+
+		if (existing == accesses.end()) {
+			accesses.push_back({ access.resource, info, access.clear, access.clearValue });
+			continue;
+		}
+
+		if (resources[access.resource].isImage && (existing->info.layout != info.layout)) {
+			throw std::runtime_error("Pass " + pass.name + " uses " + resources[access.resource].name +
+				" in two different layouts");
+		}
+
+		existing->info.stages |= info.stages;
+		existing->info.access |= info.access;
+		existing->info.imageUsage |= info.imageUsage;
+		existing->info.reads = existing->info.reads || info.reads;
+		existing->info.writes = existing->info.writes || info.writes;
+		existing->info.attachment = existing->info.attachment || info.attachment;
+		existing->clear = existing->clear || access.clear;
+		if (access.clear) {
+			existing->clearValue = access.clearValue;
+		}
+	}
+
+	return accesses;
+}
+
+// Moves state past access, filling in barrier with what the access has to wait on. Returns false when it doesn't
+// have to wait on anything.
+static bool synchronise(SyncState& state, VkImageLayout& layout, bool isImage, const UsageInfo& info,
+	RenderGraphBarrier& barrier)
+{
+	VkImageLayout newLayout = isImage ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+	bool layoutChange = (layout != newLayout);
+
+	barrier.oldLayout = layout;
+	barrier.newLayout = newLayout;
+	barrier.dstStages = info.stages;
+	barrier.dstAccess = info.access;
+	layout = newLayout;
+
+	// a layout transition writes the image, so it's ordered like any other write
+	if (info.writes || layoutChange) {
+		// waits for the reads to finish as well as the writes, but only the writes have anything to make visible
+		barrier.srcStages = state.writeStages | state.readStages;
+		barrier.srcAccess = state.writeAccess;
+
+		state.writeStages = info.stages;
+		state.writeAccess = info.writes ? (info.access & WriteAccessMask) : 0;
+		state.readStages = info.reads ? info.stages : 0;
+		state.visibleStages = info.stages;
+
+		if (barrier.srcStages == 0) {
+			barrier.srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			return layoutChange;
+		}
+
+		return true;
+	}
+
+	state.readStages |= info.stages;
+
+	// reads only wait on the last write, and only once per stage. A layout transition on its own counts as a write
+	// with nothing to make visible, so later stages still have to wait for it to finish.
+	if ((state.writeStages == 0) || ((state.visibleStages & info.stages) == info.stages)) {
+		return false;
+	}
+
+	barrier.srcStages = state.writeStages;
+	barrier.srcAccess = state.writeAccess;
+	state.visibleStages |= info.stages;
+
+	return true;
+}
+
+static bool has_memory_type(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties)
+{
+	const auto& memoryProperties = PhysicalDeviceCapabilities.memoryProperties;
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((memoryTypeBits & (1u << i)) &&
+			((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// RenderGraphPass
+
+void RenderGraphPass::use(uint32_t resource, ResourceUsage usage)
+{
+	RenderGraphAccess access;
+	access.resource = resource;
+	access.usage = usage;
+	accesses.push_back(access);
+}
+
+void RenderGraphPass::clear(uint32_t resource, ResourceUsage usage, VkClearValue clearValue)
+{
+	RenderGraphAccess access;
+	access.resource = resource;
+	access.usage = usage;
+	access.clear = true;
+	access.clearValue = clearValue;
+	accesses.push_back(access);
+}
+
+// RenderGraph
+
+uint32_t RenderGraph::import_image(const std::string& name, VkFormat format, VkImageAspectFlags aspect,
+	VkImageLayout finalLayout)
+{
+	RenderGraphResource resource;
+	resource.name = name;
+	resource.isImage = true;
+	resource.imported = true;
+	resource.format = format;
+	resource.aspect = aspect;
+	resource.finalLayout = finalLayout;
+	resources.push_back(resource);
+
+	return (uint32_t) resources.size() - 1;
+}
+
+uint32_t RenderGraph::import_buffer(const std::string& name, const Buffer* buffer)
+{
+	RenderGraphResource resource;
+	resource.name = name;
+	resource.imported = true;
+	resource.buffer = buffer;
+	resources.push_back(resource);
+
+	return (uint32_t) resources.size() - 1;
+}
+
+uint32_t RenderGraph::create_transient_image(const std::string& name, VkFormat format, VkImageAspectFlags aspect)
+{
+	RenderGraphResource resource;
+	resource.name = name;
+	resource.isImage = true;
+	resource.format = format;
+	resource.aspect = aspect;
+	resources.push_back(resource);
+
+	return (uint32_t) resources.size() - 1;
+}
+
+RenderGraphPass& RenderGraph::add_pass(const std::string& name, RenderGraphPassType type,
+	std::function<void(VkCommandBuffer, uint32_t)> record)
+{
+	RenderGraphPass pass;
+	pass.name = name;
+	pass.type = type;
+	pass.record = std::move(record);
+	passes.push_back(std::move(pass));
+
+	return passes.back();
+}
+
+void RenderGraph::compile()
+{
+	TRACE_ZONE("RenderGraph::compile");
+
+	cull_passes();
+	assign_alias_groups();
+	derive_barriers();
+
+	uint32_t keptPasses = 0;
+	uint32_t barrierCount = 0;
+	for (const auto& pass : passes) {
+		if (pass.culled) {
+			LOG_DEBUG("Culled render graph pass {}, nothing uses what it writes", pass.name);
+			continue;
+		}
+
+		keptPasses++;
+		barrierCount += (uint32_t) pass.barriers.size();
+	}
+
+	LOG_INFO("Compiled render graph: {} of {} pass(es), {} barrier(s) between them, {} transient alias group(s)",
+		keptPasses, passes.size(), barrierCount, aliasGroupCount);
+}
+
+void RenderGraph::cull_passes()
+{
+	// walks backwards from the imported images, keeping the passes that write something a kept pass later reads
+	std::vector<bool> needed(resources.size(), false);
+
+	for (size_t i = passes.size(); i-- > 0;) {
+		auto& pass = passes[i];
+		auto accesses = get_pass_accesses(pass, resources);
+
+		bool keep = false;
+		for (const auto& access : accesses) {
+			const auto& resource = resources[access.resource];
+			if (access.info.writes && (needed[access.resource] || (resource.imported && resource.isImage))) {
+				keep = true;
+			}
+		}
+
+		pass.culled = !keep;
+		if (!keep) continue;
+
+		// whatever was there before a write that doesn't read it is never seen
+		for (const auto& access : accesses) {
+			if (access.info.writes && !access.info.reads) {
+				needed[access.resource] = false;
+			}
+		}
+
+		for (const auto& access : accesses) {
+			if (access.info.reads) {
+				needed[access.resource] = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::assign_alias_groups()
+{
+	for (auto& resource : resources) {
+		resource.usage = 0;
+		resource.firstPass = -1;
+		resource.lastPass = -1;
+	}
+
+	std::vector<bool> attachmentOnly(resources.size(), true);
+
+	for (int32_t i = 0; i < (int32_t) passes.size(); i++) {
+		if (passes[i].culled) continue;
+
+		for (const auto& access : get_pass_accesses(passes[i], resources)) {
+			auto& resource = resources[access.resource];
+
+			resource.usage |= access.info.imageUsage;
+			if (resource.firstPass < 0) {
+				resource.firstPass = i;
+			}
+			resource.lastPass = i;
+
+			if (!access.info.attachment) {
+				attachmentOnly[access.resource] = false;
+			}
+		}
+	}
+
+	// a transient image that's only ever an attachment of a single render pass is never loaded or stored, so tiled
+	// GPUs can keep it in tile memory and never back it with real memory at all
+	std::vector<uint32_t> transientImages;
+	for (uint32_t i = 0; i < resources.size(); i++) {
+		auto& resource = resources[i];
+		if (resource.imported || (resource.firstPass < 0)) continue;
+
+		if (attachmentOnly[i] && (resource.firstPass == resource.lastPass)) {
+			resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
+
+		transientImages.push_back(i);
+	}
+
+	std::sort(transientImages.begin(), transientImages.end(),
+		[this](uint32_t first, uint32_t second) { return resources[first].firstPass < resources[second].firstPass; });
+
+	// greedy interval colouring, each image joins the first group whose images are all dead by the time it's needed
+	struct AliasGroup {
+		int32_t lastPass;
+		bool transientAttachment;
+	};
+	std::vector<AliasGroup> groups;
+
+	for (uint32_t index : transientImages) {
+		auto& resource = resources[index];
+		bool transientAttachment = (resource.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+
+		auto group = std::find_if(groups.begin(), groups.end(), [&](const AliasGroup& candidate) {
+			return (candidate.lastPass < resource.firstPass) && (candidate.transientAttachment == transientAttachment);
+		});
+
+		if (group == groups.end()) {
+			groups.push_back({ resource.lastPass, transientAttachment });
+			group = groups.end() - 1;
+		}
+
+		group->lastPass = resource.lastPass;
+		resource.aliasGroup = (uint32_t) (group - groups.begin());
+	}
+
+	aliasGroupCount = (uint32_t) groups.size();
+}
+
+void RenderGraph::derive_barriers()
+{
+	// aliased images share their group's state, so the first user of the memory waits on the last one
+	auto syncIndex = [this](uint32_t resource) {
+		return resources[resource].imported ? resource : (uint32_t) resources.size() + resources[resource].aliasGroup;
+	};
+
+	std::vector<SyncState> states(resources.size() + aliasGroupCount);
+	std::vector<VkImageLayout> layouts(resources.size());
+
+	// every frame runs the same passes on the same resources, so the state a frame starts in is the state the one
+	// before it finished in. The first round only works that out, the second records the barriers.
+	for (uint32_t round = 0; round < 2; round++) {
+		for (uint32_t i = 0; i < resources.size(); i++) {
+			// transient images' contents never outlive the frame
+			layouts[i] = resources[i].imported ? resources[i].finalLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+
+		for (uint32_t passIndex = 0; passIndex < passes.size(); passIndex++) {
+			auto& pass = passes[passIndex];
+			if (pass.culled) continue;
+
+			pass.barriers.clear();
+			pass.attachments.clear();
+			pass.clearValues.clear();
+
+			std::vector<RenderGraphBarrier> attachmentBarriers;
+			std::vector<VkImageLayout> finalLayouts;
+
+			for (const auto& access : get_pass_accesses(pass, resources)) {
+				const auto& resource = resources[access.resource];
+				bool attachment = access.info.attachment && (pass.type == RenderGraphPassType::Graphics);
+
+				RenderGraphBarrier barrier;
+				barrier.resource = access.resource;
+				bool needed = synchronise(states[syncIndex(access.resource)], layouts[access.resource], resource.isImage,
+					access.info, barrier);
+
+				if (attachment) {
+					// the render pass transitions its attachments itself, and leaves imported images ready for
+					// whatever happens to them after the frame
+					VkImageLayout finalLayout = access.info.layout;
+					if (resource.imported && (resource.lastPass == (int32_t) passIndex)) {
+						finalLayout = resource.finalLayout;
+						layouts[access.resource] = finalLayout;
+					}
+
+					pass.attachments.push_back(access.resource);
+					pass.clearValues.push_back(access.clearValue);
+					attachmentBarriers.push_back(barrier);
+					finalLayouts.push_back(finalLayout);
+				} else if (needed && (round == 1)) {
+					pass.barriers.push_back(barrier);
+				}
+			}
+
+			if ((round == 1) && (pass.type == RenderGraphPassType::Graphics)) {
+				create_render_pass(passIndex, attachmentBarriers, finalLayouts);
+			}
+		}
+	}
+}
+
+void RenderGraph::create_render_pass(uint32_t passIndex, const std::vector<RenderGraphBarrier>& attachmentBarriers,
+	const std::vector<VkImageLayout>& finalLayouts)
+{
+	auto& pass = passes[passIndex];
+	auto accesses = get_pass_accesses(pass, resources);
+
+	std::vector<VkAttachmentDescription> descriptions;
+	std::vector<VkAttachmentReference> colorReferences;
+	VkAttachmentReference depthReference = {};
+	bool hasDepth = false;
+
+	// everything the attachments were last used for has to finish before the pass touches them
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+
+	for (uint32_t i = 0; i < pass.attachments.size(); i++) {
+		uint32_t resourceIndex = pass.attachments[i];
+		const auto& resource = resources[resourceIndex];
+		const auto& barrier = attachmentBarriers[i];
+
+		auto access = std::find_if(accesses.begin(), accesses.end(),
+			[&](const PassAccess& candidate) { return candidate.resource == resourceIndex; });
+
+		VkAttachmentDescription description = {};
+		description.format = resource.format;
+		description.samples = VK_SAMPLE_COUNT_1_BIT;
+
+		if (access->clear) {
+			description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		} else if (!resource.imported && (resource.firstPass == (int32_t) passIndex)) {
+			description.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		} else {
+			description.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		}
+
+		// only written out if something reads it afterwards, so tiled GPUs can drop it at the end of the pass
+		bool stored = resource.imported || (resource.lastPass > (int32_t) passIndex);
+		description.storeOp = stored ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		description.initialLayout = (description.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) ?
+			barrier.oldLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+		description.finalLayout = finalLayouts[i];
+		descriptions.push_back(description);
+
+		VkAttachmentReference reference = {};
+		reference.attachment = i;
+		reference.layout = access->info.layout;
+
+		if (access->info.imageUsage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			if (hasDepth) {
+				throw std::runtime_error("Pass " + pass.name + " has more than one depth attachment");
+			}
+
+			depthReference = reference;
+			hasDepth = true;
+		} else {
+			colorReferences.push_back(reference);
+		}
+
+		dependency.srcStageMask |= barrier.srcStages;
+		dependency.srcAccessMask |= barrier.srcAccess;
+		dependency.dstStageMask |= barrier.dstStages;
+		dependency.dstAccessMask |= barrier.dstAccess;
+	}
+
+	if (dependency.srcStageMask == 0) {
+		dependency.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	}
+	if (dependency.dstStageMask == 0) {
+		dependency.dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	}
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = (uint32_t) colorReferences.size();
+	subpass.pColorAttachments = colorReferences.data();
+	subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+	VkRenderPassCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	createInfo.attachmentCount = (uint32_t) descriptions.size();
+	createInfo.pAttachments = descriptions.data();
+	createInfo.subpassCount = 1;
+	createInfo.pSubpasses = &subpass;
+	createInfo.dependencyCount = 1;
+	createInfo.pDependencies = &dependency;
+
+	if (vkCreateRenderPass(Device, &createInfo, nullptr, &pass.renderPass) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create render pass for " + pass.name);
+	}
+}
+
+void RenderGraph::set_imported_images(uint32_t resource, const std::vector<VkImage>& images,
+	const std::vector<VkImageView>& views)
+{
+	resources[resource].images = images;
+	resources[resource].views = views;
+}
+
+void RenderGraph::create_targets(VkExtent2D targetExtent)
+{
+	TRACE_ZONE("RenderGraph::create_targets");
+
+	extent = targetExtent;
+
+	// each group gets one allocation that fits the largest of its images
+	std::vector<VkMemoryRequirements> groupRequirements(aliasGroupCount, { 0, 1, ~0u });
+	std::vector<bool> groupTransientAttachment(aliasGroupCount, false);
+	VkDeviceSize unaliasedBytes = 0;
+	uint32_t transientImageCount = 0;
+
+	for (auto& resource : resources) {
+		if (resource.imported || (resource.firstPass < 0)) continue;
+
+		VkImageCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		createInfo.imageType = VK_IMAGE_TYPE_2D;
+		createInfo.format = resource.format;
+		createInfo.extent = { extent.width, extent.height, 1 };
+		createInfo.mipLevels = 1;
+		createInfo.arrayLayers = 1;
+		createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		createInfo.usage = resource.usage;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		resource.images.resize(1);
+		if (vkCreateImage(Device, &createInfo, nullptr, &resource.images[0]) != VK_SUCCESS) {
+			throw std::runtime_error("Could not create transient image " + resource.name);
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(Device, resource.images[0], &requirements);
+
+		auto& groupRequirement = groupRequirements[resource.aliasGroup];
+		groupRequirement.size = std::max(groupRequirement.size, requirements.size);
+		groupRequirement.alignment = std::max(groupRequirement.alignment, requirements.alignment);
+		groupRequirement.memoryTypeBits &= requirements.memoryTypeBits;
+		groupTransientAttachment[resource.aliasGroup] = (resource.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+
+		unaliasedBytes += requirements.size;
+		transientImageCount++;
+	}
+
+	VkDeviceSize aliasedBytes = 0;
+	uint32_t lazyGroupCount = 0;
+	transientAllocations.resize(aliasGroupCount);
+
+	for (uint32_t group = 0; group < aliasGroupCount; group++) {
+		const auto& requirements = groupRequirements[group];
+		if (requirements.memoryTypeBits == 0) {
+			throw std::runtime_error("The transient images of render graph alias group " + std::to_string(group) +
+				" have no memory type in common");
+		}
+
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		if (groupTransientAttachment[group] &&
+			has_memory_type(requirements.memoryTypeBits, properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+			properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			lazyGroupCount++;
+		}
+
+		transientAllocations[group] = Allocator.allocate(requirements, properties, AllocationType::ImageOptimal);
+		aliasedBytes += requirements.size;
+	}
+
+	for (auto& resource : resources) {
+		if (resource.imported || (resource.firstPass < 0)) continue;
+
+		const auto& allocation = transientAllocations[resource.aliasGroup];
+		if (vkBindImageMemory(Device, resource.images[0], allocation.memory, allocation.offset) != VK_SUCCESS) {
+			destroy_targets();
+			throw std::runtime_error("Could not bind transient image memory");
+		}
+
+		VkImageViewCreateInfo viewCreateInfo = {};
+		viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewCreateInfo.image = resource.images[0];
+		viewCreateInfo.format = resource.format;
+		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCreateInfo.subresourceRange.aspectMask = resource.aspect;
+		viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+		viewCreateInfo.subresourceRange.baseMipLevel = 0;
+		viewCreateInfo.subresourceRange.layerCount = 1;
+		viewCreateInfo.subresourceRange.levelCount = 1;
+
+		resource.views.resize(1);
+		if (vkCreateImageView(Device, &viewCreateInfo, nullptr, &resource.views[0]) != VK_SUCCESS) {
+			throw std::runtime_error("Could not create transient image view " + resource.name);
+		}
+	}
+
+	for (auto& pass : passes) {
+		if (pass.culled || (pass.type != RenderGraphPassType::Graphics)) continue;
+
+		size_t framebufferCount = 1;
+		for (uint32_t attachment : pass.attachments) {
+			framebufferCount = std::max(framebufferCount, resources[attachment].views.size());
+		}
+
+		pass.framebuffers.resize(framebufferCount);
+		for (size_t i = 0; i < framebufferCount; i++) {
+			std::vector<VkImageView> views;
+			for (uint32_t attachment : pass.attachments) {
+				const auto& attachmentViews = resources[attachment].views;
+				views.push_back(attachmentViews[i % attachmentViews.size()]);
+			}
+
+			VkFramebufferCreateInfo createInfo = {};
+			createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			createInfo.renderPass = pass.renderPass;
+			createInfo.attachmentCount = (uint32_t) views.size();
+			createInfo.pAttachments = views.data();
+			createInfo.width = extent.width;
+			createInfo.height = extent.height;
+			createInfo.layers = 1;
+
+			if (vkCreateFramebuffer(Device, &createInfo, nullptr, &pass.framebuffers[i]) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create framebuffer for " + pass.name);
+			}
+		}
+	}
+
+	LOG_INFO("Render graph transient images: {} image(s) in {} bytes ({} bytes unaliased), {} of {} group(s) lazily allocated",
+		transientImageCount, aliasedBytes, unaliasedBytes, lazyGroupCount, aliasGroupCount);
+}
+
+void RenderGraph::destroy_targets()
+{
+	for (auto& pass : passes) {
+		for (auto& framebuffer : pass.framebuffers) {
+			vkDestroyFramebuffer(Device, framebuffer, nullptr);
+		}
+		pass.framebuffers.clear();
+	}
+
+	for (auto& resource : resources) {
+		if (resource.imported) {
+			// owned by whoever imported them
+			resource.images.clear();
+			resource.views.clear();
+			continue;
+		}
+
+		for (auto& view : resource.views) {
+			vkDestroyImageView(Device, view, nullptr);
+		}
+		resource.views.clear();
+
+		for (auto& image : resource.images) {
+			vkDestroyImage(Device, image, nullptr);
+		}
+		resource.images.clear();
+	}
+
+	for (auto& allocation : transientAllocations) {
+		Allocator.free(allocation);
+	}
+	transientAllocations.clear();
+}
+
+void RenderGraph::record_barriers(VkCommandBuffer commandBuffer, const RenderGraphPass& pass, uint32_t imageIndex)
+{
+	if (pass.barriers.empty()) return;
+
+	bufferBarriers.clear();
+	imageBarriers.clear();
+
+	VkPipelineStageFlags srcStages = 0;
+	VkPipelineStageFlags dstStages = 0;
+
+	for (const auto& barrier : pass.barriers) {
+		const auto& resource = resources[barrier.resource];
+
+		srcStages |= barrier.srcStages;
+		dstStages |= barrier.dstStages;
+
+		if (resource.isImage) {
+			VkImageMemoryBarrier imageBarrier = {};
+			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.srcAccessMask = barrier.srcAccess;
+			imageBarrier.dstAccessMask = barrier.dstAccess;
+			imageBarrier.oldLayout = barrier.oldLayout;
+			imageBarrier.newLayout = barrier.newLayout;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = resource.images[imageIndex % resource.images.size()];
+			imageBarrier.subresourceRange.aspectMask = resource.aspect;
+			imageBarrier.subresourceRange.baseMipLevel = 0;
+			imageBarrier.subresourceRange.levelCount = 1;
+			imageBarrier.subresourceRange.baseArrayLayer = 0;
+			imageBarrier.subresourceRange.layerCount = 1;
+			imageBarriers.push_back(imageBarrier);
+		} else {
+			VkBufferMemoryBarrier bufferBarrier = {};
+			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferBarrier.srcAccessMask = barrier.srcAccess;
+			bufferBarrier.dstAccessMask = barrier.dstAccess;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = resource.buffer->buffer;
+			bufferBarrier.offset = 0;
+			bufferBarrier.size = VK_WHOLE_SIZE;
+			bufferBarriers.push_back(bufferBarrier);
+		}
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr,
+		(uint32_t) bufferBarriers.size(), bufferBarriers.data(), (uint32_t) imageBarriers.size(), imageBarriers.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex)
+{
+	for (const auto& pass : passes) {
+		if (pass.culled) continue;
+
+		uint32_t scope = Profiler.begin_scope(commandBuffer, pass.name);
+		record_barriers(commandBuffer, pass, imageIndex);
+
+		if (pass.type == RenderGraphPassType::Graphics) {
+			if (pass.pipelineStatistics) {
+				Profiler.begin_pipeline_statistics(commandBuffer);
+			}
+
+			VkRenderPassBeginInfo beginInfo = {};
+			beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			beginInfo.renderPass = pass.renderPass;
+			beginInfo.framebuffer = pass.framebuffers[imageIndex % pass.framebuffers.size()];
+			beginInfo.renderArea.offset = { 0, 0 };
+			beginInfo.renderArea.extent = extent;
+			beginInfo.clearValueCount = (uint32_t) pass.clearValues.size();
+			beginInfo.pClearValues = pass.clearValues.data();
+
+			vkCmdBeginRenderPass(commandBuffer, &beginInfo, pass.contents);
+			pass.record(commandBuffer, frameIndex);
+			vkCmdEndRenderPass(commandBuffer);
+
+			if (pass.pipelineStatistics) {
+				Profiler.end_pipeline_statistics(commandBuffer);
+			}
+		} else {
+			pass.record(commandBuffer, frameIndex);
+		}
+
+		Profiler.end_scope(commandBuffer, scope);
+	}
+}
+
+void RenderGraph::destroy()
+{
+	destroy_targets();
+
+	for (auto& pass : passes) {
+		vkDestroyRenderPass(Device, pass.renderPass, nullptr);
+	}
+
+	passes.clear();
+	resources.clear();
+	aliasGroupCount = 0;
+}
+
+// Renderer
+
+static uint32_t Backbuffer = 0;
+
+void create_render_graph()
+{
+	TRACE_ZONE("create_render_graph");
+
+	// offscreen targets are left ready to be copied out rather than presented
+	Backbuffer = FrameGraph.import_image("backbuffer", SurfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT,
+		Headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	uint32_t depth = FrameGraph.create_transient_image("depth", PhysicalDeviceCapabilities.depthFormat,
+		VK_IMAGE_ASPECT_DEPTH_BIT);
+
+	// the particle system is created after the graph, as its pipeline needs the scene's render pass. An async step
+	// is submitted on its own, so the graph only sees the draw.
+	uint32_t particles = 0;
+	if (ParticleCount > 0) {
+		particles = FrameGraph.import_buffer("particles", &Particles.particleBuffer);
+	}
+	if ((ParticleCount > 0) && !particles_simulated_async()) {
+		auto& simulationPass = FrameGraph.add_pass("particle simulation", RenderGraphPassType::Compute,
+			[](VkCommandBuffer commandBuffer, uint32_t) { record_particle_simulation(commandBuffer); });
+		simulationPass.use(particles, ResourceUsage::ComputeShaderReadWrite);
+	}
+
+	uint32_t draws = 0;
+	uint32_t drawCount = 0;
+	if (Culling.is_enabled()) {
+		draws = FrameGraph.import_buffer("culled draws", &Culling.drawBuffer);
+		drawCount = FrameGraph.import_buffer("culled draw count", &Culling.drawCountBuffer);
+
+		if (Culling.is_compacting()) {
+			auto& resetPass = FrameGraph.add_pass("reset draw count", RenderGraphPassType::Compute,
+				[](VkCommandBuffer commandBuffer, uint32_t) { record_draw_count_reset(commandBuffer); });
+			resetPass.use(drawCount, ResourceUsage::TransferWrite);
+		}
+
+		auto& cullingPass = FrameGraph.add_pass("gpu culling", RenderGraphPassType::Compute,
+			[](VkCommandBuffer commandBuffer, uint32_t) { record_gpu_culling(commandBuffer); });
+		cullingPass.use(draws, ResourceUsage::ComputeShaderWrite);
+		if (Culling.is_compacting()) {
+			cullingPass.use(drawCount, ResourceUsage::ComputeShaderReadWrite);
+		}
+	}
+
+	auto& scenePass = FrameGraph.add_pass("scene pass", RenderGraphPassType::Graphics,
+		[](VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+			auto& frame = Frames.frames[frameIndex];
+			vkCmdExecuteCommands(commandBuffer, (uint32_t) frame.secondaryCommandBuffers.size(),
+				frame.secondaryCommandBuffers.data());
+		});
+	scenePass.contents = VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
+	scenePass.pipelineStatistics = true;
+
+	VkClearValue colorClear = {};
+	colorClear.color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+	VkClearValue depthClear = {};
+	depthClear.depthStencil = { 1.0f, 0 };
+
+	scenePass.clear(Backbuffer, ResourceUsage::ColorAttachment, colorClear);
+	scenePass.clear(depth, ResourceUsage::DepthAttachment, depthClear);
+	if (ParticleCount > 0) {
+		scenePass.use(particles, ResourceUsage::VertexBufferRead);
+	}
+	if (Culling.is_enabled()) {
+		scenePass.use(draws, ResourceUsage::IndirectBufferRead);
+		if (Culling.is_compacting()) {
+			scenePass.use(drawCount, ResourceUsage::IndirectBufferRead);
+		}
+	}
+
+	ScenePass = FrameGraph.pass_count() - 1;
+
+	FrameGraph.compile();
+
+	RenderPass = FrameGraph.pass(ScenePass).renderPass;
+}
+
+void create_render_graph_targets()
+{
+	FrameGraph.set_imported_images(Backbuffer, get_target_images(), ImageViews);
+	FrameGraph.create_targets(SurfaceExtent);
+}
+
+void destroy_render_graph()
+{
+	FrameGraph.destroy();
+	RenderPass = VK_NULL_HANDLE;
+}
@@ -0,0 +1,331 @@
+#include "renderer.hpp"
+
+#include <cctype>
+
+uint32_t InitialWidth = 800;
+uint32_t InitialHeight = 600;
+
+GLFWwindow* Window = nullptr;
+
+// set by GLFW when the window changes size, as not every platform reports it through the swap chain
+bool FramebufferResized = false;
+
+uint64_t HeadlessFrameCount = 1000;
+
+FrameStatistics Statistics;
+
+void init_window() {
+	TRACE_ZONE("init_window");
+
+	if (Headless) return;
+
+    glfwInit();
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    Window = glfwCreateWindow(InitialWidth, InitialHeight, "vk-renderer", nullptr, nullptr);
+
+	glfwSetFramebufferSizeCallback(Window, framebuffer_resize_callback);
+}
+
+void init_vulkan() {
+    TRACE_ZONE("init_vulkan");
+
+    create_instance();
+
+    setup_debug_callback();
+
+	if (!Headless) {
+		create_surface();
+	}
+
+    pick_physical_device();
+
+	create_logical_device();
+
+	create_memory_allocator();
+
+	if (Headless) {
+		create_offscreen_targets(InitialWidth, InitialHeight);
+	} else {
+		create_swap_chain(InitialWidth, InitialHeight);
+	}
+
+	create_image_views();
+
+	create_pipeline_cache();
+
+	create_command_pool();
+
+	create_upload_queue();
+
+	create_bindless_descriptors();
+
+	create_scene_mesh();
+
+	create_gpu_culling();
+
+	create_object_data();
+
+	create_render_graph();
+
+	create_graphics_pipeline(Vertex::get_layout());
+
+	create_render_graph_targets();
+
+	create_instanced_objects();
+
+	create_particle_system();
+
+	create_sprite_overlay();
+
+	create_recording_threads();
+
+	create_sync_objects();
+
+	create_command_buffers();
+
+	create_gpu_profiler();
+}
+
+void create_surface()
+{
+	if (glfwCreateWindowSurface(Instance, Window, nullptr, &Surface) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create window surface");
+	}
+}
+
+void main_loop() {
+	auto loopStart = std::chrono::steady_clock::now();
+
+	while (Headless ? (Statistics.frameCount < HeadlessFrameCount) : !glfwWindowShouldClose(Window)) {
+		if (!Headless) {
+			TRACE_ZONE("glfwPollEvents");
+			glfwPollEvents();
+		}
+
+		draw_frame();
+	}
+
+	{
+		TRACE_ZONE("vkDeviceWaitIdle");
+		vkDeviceWaitIdle(Device);
+	}
+
+	Statistics.totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+	print_frame_statistics();
+}
+
+void draw_frame() {
+	TRACE_ZONE("draw_frame");
+
+	auto& frame = Frames.current();
+
+	// don't let the CPU get more than FramesInFlight frames ahead of the GPU
+	auto waitStart = std::chrono::steady_clock::now();
+	{
+		TRACE_ZONE("wait for frame fence");
+		vkWaitForFences(Device, 1, &frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+
+	uint32_t imageIndex = 0;
+	if (Headless) {
+		imageIndex = Frames.currentFrame;
+	} else {
+		VkResult acquireResult = VK_SUCCESS;
+		{
+			TRACE_ZONE("vkAcquireNextImageKHR");
+			acquireResult = vkAcquireNextImageKHR(Device, SwapChain, std::numeric_limits<uint64_t>::max(),
+				frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		}
+
+		// nothing has been submitted for this frame yet, so its fence is still signalled and it can simply be retried
+		if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+			handle_window_resize();
+			return;
+		} else if ((acquireResult != VK_SUCCESS) && (acquireResult != VK_SUBOPTIMAL_KHR)) {
+			throw std::runtime_error("Failed to acquire swapchain image");
+		}
+	}
+
+	// the swap chain can hand back an image that an older frame is still rendering to
+	if (Frames.imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+		TRACE_ZONE("wait for image fence");
+		vkWaitForFences(Device, 1, &Frames.imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	Frames.imagesInFlight[imageIndex] = frame.inFlightFence;
+	Statistics.fenceWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+
+	// only ever looks at the uploads' fences, never waits on them
+	Uploads.poll();
+
+	auto recordStart = std::chrono::steady_clock::now();
+	record_frame(Frames.currentFrame, imageIndex);
+	Statistics.recordSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - recordStart).count();
+
+	// ahead of the frame, so anything uploaded while recording is on its way as soon as possible
+	update_upload_stream();
+	Uploads.submit();
+
+	VkSemaphore waitSemaphores[2] = {};
+	VkPipelineStageFlags waitForStages[2] = {};
+	VkSemaphore signalSemaphores[2] = {};
+	uint32_t waitSemaphoreCount = 0;
+	uint32_t signalSemaphoreCount = 0;
+
+	// offscreen targets are never acquired from or presented to a swap chain, so there is nothing to wait on/signal.
+	// Only the colour writes need the image, everything before that can start straight away.
+	if (!Headless) {
+		waitSemaphores[waitSemaphoreCount] = frame.imageAvailableSemaphore;
+		waitForStages[waitSemaphoreCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		signalSemaphores[signalSemaphoreCount++] = frame.renderFinishSemaphore;
+	}
+
+	// the step only holds up the particle draw, the rest of the frame overlaps it
+	if (particles_simulated_async()) {
+		submit_particle_simulation(frame);
+		waitSemaphores[waitSemaphoreCount] = frame.simulationFinishSemaphore;
+		waitForStages[waitSemaphoreCount++] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		signalSemaphores[signalSemaphoreCount++] = frame.particlesReleasedSemaphore;
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = waitSemaphoreCount;
+	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.pWaitDstStageMask = waitForStages;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &frame.commandBuffer;
+	submitInfo.signalSemaphoreCount = signalSemaphoreCount;
+	submitInfo.pSignalSemaphores = signalSemaphores;
+
+	vkResetFences(Device, 1, &frame.inFlightFence);
+
+	VkResult submitResult = VK_SUCCESS;
+	{
+		TRACE_ZONE("vkQueueSubmit");
+		submitResult = vkQueueSubmit(GraphicsQueue, 1, &submitInfo, frame.inFlightFence);
+	}
+
+	if (submitResult != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit draw command buffer");
+	}
+
+	if (!Headless) {
+		VkPresentInfoKHR presentInfo = {};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &SwapChain;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = &frame.renderFinishSemaphore;
+		presentInfo.pImageIndices = &imageIndex;
+
+		VkResult presentResult = VK_SUCCESS;
+		{
+			TRACE_ZONE("vkQueuePresentKHR");
+			presentResult = vkQueuePresentKHR(PresentQueue, &presentInfo);
+		}
+
+		if ((presentResult == VK_ERROR_OUT_OF_DATE_KHR) || (presentResult == VK_SUBOPTIMAL_KHR) || FramebufferResized) {
+			handle_window_resize();
+		} else if (presentResult != VK_SUCCESS) {
+			throw std::runtime_error("Failed to present swapchain image");
+		}
+	}
+
+	Frames.advance();
+	Statistics.frameCount++;
+}
+
+void framebuffer_resize_callback(GLFWwindow* window, int width, int height) {
+	FramebufferResized = true;
+}
+
+void handle_window_resize() {
+	FramebufferResized = false;
+
+	int width = 0;
+	int height = 0;
+	glfwGetFramebufferSize(Window, &width, &height);
+
+	// a minimised window has nothing to render into, so wait until it comes back
+	while (((width == 0) || (height == 0)) && !glfwWindowShouldClose(Window)) {
+		glfwWaitEvents();
+		glfwGetFramebufferSize(Window, &width, &height);
+	}
+
+	if (glfwWindowShouldClose(Window)) return;
+
+	recreate_swap_chain((uint32_t) width, (uint32_t) height);
+}
+
+void print_frame_statistics() {
+	if (Statistics.frameCount == 0) return;
+
+	double averageFrameMs = (Statistics.totalSeconds * 1000.0) / Statistics.frameCount;
+	double averageWaitMs = (Statistics.fenceWaitSeconds * 1000.0) / Statistics.frameCount;
+	double averageRecordMs = (Statistics.recordSeconds * 1000.0) / Statistics.frameCount;
+
+	LOG_INFO("Rendered {} frames with {} frame(s) in flight: {} ms/frame ({} fps), {} ms/frame blocked waiting on the GPU, "
+		"{} ms/frame recording", Statistics.frameCount, FramesInFlight, averageFrameMs, Statistics.frameCount / Statistics.totalSeconds,
+		averageWaitMs, averageRecordMs);
+
+	double trianglesPerSecond = ((double) SceneMesh.triangle_count() * Statistics.frameCount) / Statistics.totalSeconds;
+	LOG_INFO("Drew {} triangles per frame, {} million triangles/s", SceneMesh.triangle_count(), trianglesPerSecond / 1000000.0);
+
+	if (Particles.is_enabled()) {
+		double particlesPerSecond = ((double) Particles.particleCount * Statistics.frameCount) / Statistics.totalSeconds;
+		LOG_INFO("Simulated {} particles per frame, {} million particles/s", Particles.particleCount,
+			particlesPerSecond / 1000000.0);
+	}
+
+	const UploadStatistics& uploadStatistics = Uploads.statistics();
+	if (uploadStatistics.batchesSubmitted > 0) {
+		double uploadedMegabytes = (double) uploadStatistics.bytesCompleted / (1024.0 * 1024.0);
+		LOG_INFO("Uploaded {} MB in {} batch(es) of {} copies, {} MB/s, {} upload(s) deferred", uploadedMegabytes,
+			uploadStatistics.batchesSubmitted, uploadStatistics.copiesSubmitted, uploadedMegabytes / Statistics.totalSeconds,
+			uploadStatistics.uploadsDeferred);
+	}
+
+	Profiler.print_statistics();
+}
+
+void cleanup() {
+	vulkan_cleanup();
+
+	if (Headless) return;
+
+    glfwDestroyWindow(Window);
+
+    glfwTerminate();
+}
+
+uint32_t parse_uint32_argument(const std::string& argument, const std::string& value) {
+	uint64_t parsed = parse_uint64_argument(argument, value);
+	if (parsed > std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error("Value for " + argument + " is too large: " + value);
+	}
+
+	return (uint32_t) parsed;
+}
+
+uint64_t parse_uint64_argument(const std::string& argument, const std::string& value) {
+	// stoull happily wraps negative numbers around and ignores anything after the digits
+	if (value.empty() || !std::isdigit((unsigned char) value[0])) {
+		throw std::runtime_error("Invalid value for " + argument + ": " + value);
+	}
+
+	size_t parsedLength = 0;
+	uint64_t parsed = 0;
+	try {
+		parsed = std::stoull(value, &parsedLength);
+	} catch (const std::exception&) {
+		throw std::runtime_error("Invalid value for " + argument + ": " + value);
+	}
+
+	if (parsedLength != value.size()) {
+		throw std::runtime_error("Invalid value for " + argument + ": " + value);
+	}
+
+	return parsed;
+}
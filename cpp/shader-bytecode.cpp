@@ -0,0 +1,59 @@
+#include "shader-bytecode.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#include "logger.hpp"
+
+#include "embedded-shaders.hpp"
+
+std::string ShaderOverrideDirectory;
+
+ShaderBytecode get_shader_bytecode(const std::string& name)
+{
+	ShaderBytecode shader = {};
+
+	if (!ShaderOverrideDirectory.empty()) {
+		shader.loadedCode = read_shader_bytecode(ShaderOverrideDirectory + "/" + name + ".spv");
+		shader.size = shader.loadedCode.size() * sizeof(uint32_t);
+
+		return shader;
+	}
+
+	for (const auto& embeddedShader : EmbeddedShaders) {
+		if (name == embeddedShader.name) {
+			shader.embeddedCode = embeddedShader.code;
+			shader.size = embeddedShader.size;
+
+			return shader;
+		}
+	}
+
+	throw std::runtime_error("No embedded shader called " + name);
+}
+
+std::vector<uint32_t> read_shader_bytecode(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open shader " + filename);
+	}
+
+	size_t fileSize = (size_t) file.tellg();
+	if ((fileSize == 0) || (fileSize % sizeof(uint32_t) != 0)) {
+		throw std::runtime_error("Shader " + filename + " is not a whole number of SPIR-V words");
+	}
+
+	// read straight into words rather than chars, so the code is aligned the way vkCreateShaderModule expects
+	std::vector<uint32_t> fileContents(fileSize / sizeof(uint32_t));
+
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(fileContents.data()), fileSize);
+
+	file.close();
+
+	LOG_DEBUG("Loaded shader {} with size {}", filename, fileSize);
+
+	return fileContents;
+}
@@ -0,0 +1,408 @@
+#include "sprite-batch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+uint32_t SpriteCount = 0;
+SpriteBatcher Sprites;
+
+static VkPipeline SpritePipeline = VK_NULL_HANDLE;
+static uint32_t SpriteFrame = 0;
+
+// a checkerboard generated at startup, registered with Bindless for the overlay's textured quads
+static Image SpriteTexture;
+static VkImageView SpriteTextureView = VK_NULL_HANDLE;
+static VkSampler SpriteSampler = VK_NULL_HANDLE;
+static uint32_t SpriteTextureIndex = SpriteBatcher::NoTexture;
+
+VertexLayout SpriteVertex::get_layout()
+{
+	VertexLayout layout;
+
+	VkVertexInputBindingDescription binding = {};
+	binding.binding = 0;
+	binding.stride = sizeof(SpriteVertex);
+	binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	layout.bindings.push_back(binding);
+
+	VkVertexInputAttributeDescription position = {};
+	position.binding = 0;
+	position.location = 0;
+	position.format = VK_FORMAT_R32G32_SFLOAT;
+	position.offset = offsetof(SpriteVertex, position);
+	layout.attributes.push_back(position);
+
+	VkVertexInputAttributeDescription uv = {};
+	uv.binding = 0;
+	uv.location = 1;
+	uv.format = VK_FORMAT_R32G32_SFLOAT;
+	uv.offset = offsetof(SpriteVertex, uv);
+	layout.attributes.push_back(uv);
+
+	VkVertexInputAttributeDescription color = {};
+	color.binding = 0;
+	color.location = 2;
+	color.format = VK_FORMAT_R8G8B8A8_UNORM;
+	color.offset = offsetof(SpriteVertex, color);
+	layout.attributes.push_back(color);
+
+	VkVertexInputAttributeDescription texture = {};
+	texture.binding = 0;
+	texture.location = 3;
+	texture.format = VK_FORMAT_R32_UINT;
+	texture.offset = offsetof(SpriteVertex, texture);
+	layout.attributes.push_back(texture);
+
+	return layout;
+}
+
+void SpriteBatcher::create(uint32_t maxQuadsPerFrame, uint32_t frameCount, VkPipeline pipeline)
+{
+	this->maxQuadsPerFrame = maxQuadsPerFrame;
+	pipelines.assign(1, pipeline);
+
+	VkDeviceSize frameBytes = sizeof(SpriteVertex) * 4 * (VkDeviceSize) maxQuadsPerFrame;
+	vertexRing.create(TransientRingBuffer::capacity_for(frameBytes, frameCount), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		frameCount);
+
+	std::vector<uint32_t> indices;
+	indices.reserve((size_t) maxQuadsPerFrame * 6);
+	for (uint32_t quad = 0; quad < maxQuadsPerFrame; quad++) {
+		uint32_t firstVertex = quad * 4;
+		for (uint32_t corner : { 0u, 1u, 2u, 2u, 3u, 0u }) {
+			indices.push_back(firstVertex + corner);
+		}
+	}
+
+	VkDeviceSize indexBytes = sizeof(uint32_t) * indices.size();
+	indexBuffer = create_buffer(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	Buffer stagingBuffer = create_buffer(indexBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	std::memcpy(stagingBuffer.allocation.mapped, indices.data(), (size_t) indexBytes);
+
+	VkCommandBuffer commandBuffer = begin_single_time_commands(CommandPool);
+
+	VkBufferCopy region = {};
+	region.size = indexBytes;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, indexBuffer.buffer, 1, &region);
+
+	end_single_time_commands(CommandPool, GraphicsQueue, commandBuffer);
+
+	destroy_buffer(stagingBuffer);
+
+	quads.reserve(maxQuadsPerFrame);
+	sortedQuads.reserve(maxQuadsPerFrame);
+	sortScratch.reserve(maxQuadsPerFrame);
+}
+
+void SpriteBatcher::destroy()
+{
+	destroy_buffer(indexBuffer);
+	vertexRing.destroy();
+
+	*this = SpriteBatcher();
+}
+
+uint16_t SpriteBatcher::add_pipeline(VkPipeline pipeline)
+{
+	if (pipelines.size() > std::numeric_limits<uint16_t>::max()) {
+		throw std::runtime_error("Too many sprite pipelines");
+	}
+
+	pipelines.push_back(pipeline);
+	return (uint16_t) (pipelines.size() - 1);
+}
+
+void SpriteBatcher::begin_frame(uint32_t frameIndex)
+{
+	vertexRing.begin_frame(frameIndex);
+
+	quads.clear();
+	draws.clear();
+}
+
+void SpriteBatcher::add_quad(const SpriteQuad& quad)
+{
+	if (quads.size() >= maxQuadsPerFrame) {
+		throw std::runtime_error("Too many sprite quads in one frame");
+	}
+
+	quads.push_back(quad);
+}
+
+void SpriteBatcher::flush()
+{
+	TRACE_ZONE("SpriteBatcher::flush");
+
+	if (quads.empty()) return;
+
+	sortedQuads.resize(quads.size());
+	for (size_t i = 0; i < quads.size(); i++) {
+		const SpriteQuad& quad = quads[i];
+
+		sortedQuads[i].key = ((uint64_t) quad.layer << 48) | ((uint64_t) quad.pipeline << 32) | quad.texture;
+		sortedQuads[i].draw = (uint32_t) i;
+	}
+
+	// stable, so quads with the same key stay in the order they were added
+	radix_sort_draws(sortedQuads, sortScratch);
+
+	// the draws count vertices from the start of the allocation, so it only has to suit the attributes' formats
+	TransientAllocation allocation = vertexRing.allocate(sizeof(SpriteVertex) * 4 * quads.size(), 16);
+	vertexOffset = allocation.offset;
+
+	SpriteVertex* vertices = static_cast<SpriteVertex*>(allocation.mapped);
+	for (uint32_t i = 0; i < (uint32_t) sortedQuads.size(); i++) {
+		const SpriteQuad& quad = quads[sortedQuads[i].draw];
+
+		// clockwise on screen, as the pipelines cull counter clockwise faces
+		vertices[0] = { quad.min, quad.uvMin, quad.color, quad.texture };
+		vertices[1] = { glm::vec2(quad.max.x, quad.min.y), glm::vec2(quad.uvMax.x, quad.uvMin.y), quad.color, quad.texture };
+		vertices[2] = { quad.max, quad.uvMax, quad.color, quad.texture };
+		vertices[3] = { glm::vec2(quad.min.x, quad.max.y), glm::vec2(quad.uvMin.x, quad.uvMax.y), quad.color, quad.texture };
+		vertices += 4;
+
+		if (draws.empty() || (draws.back().pipeline != quad.pipeline)) {
+			draws.push_back({ quad.pipeline, i, 0 });
+		}
+		draws.back().quadCount++;
+	}
+}
+
+void SpriteBatcher::record(VkCommandBuffer commandBuffer) const
+{
+	if (draws.empty()) return;
+
+	VkBuffer vertexBuffer = vertexRing.buffer();
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &vertexOffset);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+	for (const auto& draw : draws) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[draw.pipeline]);
+		vkCmdDrawIndexed(commandBuffer, draw.quadCount * 6, 1, 0, (int32_t) (draw.firstQuad * 4), 0);
+	}
+}
+
+static void create_sprite_texture()
+{
+	const uint32_t size = 64;
+	const uint32_t squareSize = 8;
+
+	std::vector<uint32_t> pixels(size * size);
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			bool light = ((x / squareSize) + (y / squareSize)) % 2 == 0;
+			pixels[y * size + x] = light ? 0xffffffff : 0xff808080;
+		}
+	}
+
+	VkImageCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	createInfo.imageType = VK_IMAGE_TYPE_2D;
+	createInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	createInfo.extent = { size, size, 1 };
+	createInfo.mipLevels = 1;
+	createInfo.arrayLayers = 1;
+	createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	createInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	SpriteTexture = create_image(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	UploadTicket ticket = UploadQueue::NoTicket;
+	while (ticket == UploadQueue::NoTicket) {
+		ticket = Uploads.upload_image(SpriteTexture, createInfo.extent, VK_IMAGE_ASPECT_COLOR_BIT, pixels.data(),
+			sizeof(uint32_t) * pixels.size(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		if (ticket == UploadQueue::NoTicket) {
+			Uploads.poll();
+		}
+	}
+	// still starting up, so it's simpler to wait than to skip the textured quads until it's there
+	Uploads.wait(ticket);
+
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = SpriteTexture.image;
+	viewCreateInfo.format = createInfo.format;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+	viewCreateInfo.subresourceRange.levelCount = 1;
+
+	if (vkCreateImageView(Device, &viewCreateInfo, nullptr, &SpriteTextureView) != VK_SUCCESS) {
+		throw std::runtime_error("Could not create sprite texture view");
+	}
+
+	// nearest, so the squares stay sharp however small the quads are
+	VkSamplerCreateInfo samplerCreateInfo = {};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.maxLod = 0.0f;
+
+	if (vkCreateSampler(Device, &samplerCreateInfo, nullptr, &SpriteSampler) != VK_SUCCESS) {
+		throw std::runtime_error("Could not create sprite sampler");
+	}
+
+	SpriteTextureIndex = Bindless.register_sampled_image(SpriteTextureView, SpriteSampler);
+}
+
+void create_sprite_overlay()
+{
+	TRACE_ZONE("create_sprite_overlay");
+
+	if (SpriteCount == 0) return;
+
+	// sprite.frag picks each quad's texture with nonuniformEXT, which create_logical_device only enables when it can
+	if (!PhysicalDeviceCapabilities.descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing) {
+		LOG_WARNING("Device can't index sampled images non uniformly, not drawing sprites");
+		SpriteCount = 0;
+		return;
+	}
+
+	// drawn over everything else, so no depth test
+	SpritePipeline = build_graphics_pipeline("sprite.vert", "sprite.frag", SpriteVertex::get_layout(),
+		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, Bindless.pipelineLayout, false);
+
+	// and the panel behind them
+	Sprites.create(SpriteCount + 1, FramesInFlight, SpritePipeline);
+	SpriteFrame = 0;
+
+	create_sprite_texture();
+
+	LOG_INFO("Drawing an overlay of {} sprite(s)", SpriteCount);
+}
+
+void update_sprite_overlay(uint32_t frameIndex)
+{
+	if (SpriteCount == 0) return;
+
+	TRACE_ZONE("update_sprite_overlay");
+
+	Sprites.begin_frame(frameIndex);
+	SpriteFrame++;
+
+	// a panel in the top left corner, filled with a grid of cells whose colours scroll every frame, half of them
+	// tinting the checkerboard
+	const glm::vec2 panelMin(-0.95f, -0.95f);
+	const glm::vec2 panelMax(-0.45f, -0.45f);
+
+	SpriteQuad panel;
+	panel.min = panelMin;
+	panel.max = panelMax;
+	panel.color = 0xff202020;
+	panel.texture = SpriteTextureIndex;
+	Sprites.add_quad(panel);
+
+	uint32_t gridSize = (uint32_t) std::ceil(std::sqrt((double) SpriteCount));
+	glm::vec2 cellSize = (panelMax - panelMin) / (float) gridSize;
+	for (uint32_t i = 0; i < SpriteCount; i++) {
+		glm::vec2 cell((float) (i % gridSize), (float) (i / gridSize));
+
+		SpriteQuad quad;
+		quad.min = panelMin + cell * cellSize + cellSize * 0.1f;
+		quad.max = quad.min + cellSize * 0.8f;
+		uint32_t shade = (i + SpriteFrame) & 0xff;
+		quad.color = 0xff000000 | (shade << 16) | ((255 - shade) << 8) | 0x80;
+		quad.layer = 1;
+
+		// every other cell is textured, on a layer above the rest so both kinds of quad are batched every frame
+		if (i % 2 == 1) {
+			quad.texture = SpriteTextureIndex;
+			quad.layer = 2;
+		}
+		Sprites.add_quad(quad);
+	}
+
+	Sprites.flush();
+}
+
+void destroy_sprite_overlay()
+{
+	if (SpritePipeline == VK_NULL_HANDLE) return;
+
+	Sprites.destroy();
+
+	Bindless.release_sampled_image(SpriteTextureIndex);
+	SpriteTextureIndex = SpriteBatcher::NoTexture;
+	vkDestroySampler(Device, SpriteSampler, nullptr);
+	SpriteSampler = VK_NULL_HANDLE;
+	vkDestroyImageView(Device, SpriteTextureView, nullptr);
+	SpriteTextureView = VK_NULL_HANDLE;
+	destroy_image(SpriteTexture);
+
+	vkDestroyPipeline(Device, SpritePipeline, nullptr);
+	SpritePipeline = VK_NULL_HANDLE;
+}
+
+void benchmark_sprite_batching(uint32_t iterations)
+{
+	const uint32_t quadCounts[] = { 1000, 10000, 100000 };
+
+	// never recorded, so the pipelines don't have to exist
+	SpriteBatcher batcher;
+	batcher.create(quadCounts[2], 1, VK_NULL_HANDLE);
+	for (int i = 0; i < 3; i++) {
+		batcher.add_pipeline(VK_NULL_HANDLE);
+	}
+
+	// a UI's worth of mixed state, so the sort has something to do
+	std::mt19937 random(0);
+	std::uniform_real_distribution<float> position(-1.0f, 0.95f);
+	std::uniform_int_distribution<uint32_t> texture(0, 15);
+	std::uniform_int_distribution<uint32_t> pipeline(0, 3);
+	std::uniform_int_distribution<uint32_t> layer(0, 3);
+
+	std::vector<SpriteQuad> quads(quadCounts[2]);
+	for (auto& quad : quads) {
+		quad.min = glm::vec2(position(random), position(random));
+		quad.max = quad.min + glm::vec2(0.05f);
+		quad.texture = texture(random);
+		quad.pipeline = (uint16_t) pipeline(random);
+		quad.layer = (uint16_t) layer(random);
+	}
+
+	LOG_INFO("Batching sprites, best of {} run(s):", iterations);
+
+	for (uint32_t quadCount : quadCounts) {
+		double bestMs = std::numeric_limits<double>::max();
+
+		for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+			auto batchingStart = std::chrono::steady_clock::now();
+
+			batcher.begin_frame(0);
+			for (uint32_t i = 0; i < quadCount; i++) {
+				batcher.add_quad(quads[i]);
+			}
+			batcher.flush();
+
+			double batchingMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batchingStart).count();
+			bestMs = std::min(bestMs, batchingMs);
+		}
+
+		LOG_INFO("  {} quad(s): {} ms, {} quads/ms, {} draw(s)", quadCount, bestMs, quadCount / bestMs,
+			batcher.draw_count());
+	}
+
+	batcher.destroy();
+}
@@ -0,0 +1,173 @@
+#include "trace.hpp"
+
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdio>
+
+#include "logger.hpp"
+
+struct TraceEvent {
+	const char* name;
+	uint64_t startNs;
+	uint64_t endNs;
+};
+
+// The events of a single thread. Only the owning thread appends, publishing each event with a release store
+// of eventCount, so recording never takes a lock and write_trace can read a consistent prefix at any time.
+struct TraceThreadBuffer {
+	static constexpr uint32_t Capacity = 1 << 18;
+
+	uint32_t threadId = 0;
+	std::string threadName;
+	std::unique_ptr<TraceEvent[]> events;
+	std::atomic<uint32_t> eventCount{ 0 };
+	std::atomic<uint32_t> droppedCount{ 0 };
+};
+
+bool TracingEnabled = false;
+
+static std::chrono::steady_clock::time_point TraceStart;
+
+// buffers outlive their threads so nothing is lost when a thread exits before the trace is written
+static std::mutex TraceBuffersMutex;
+static std::vector<std::unique_ptr<TraceThreadBuffer>> TraceBuffers;
+static thread_local TraceThreadBuffer* ThreadTraceBuffer = nullptr;
+
+static TraceThreadBuffer* get_thread_trace_buffer()
+{
+	if (ThreadTraceBuffer) return ThreadTraceBuffer;
+
+	auto buffer = std::make_unique<TraceThreadBuffer>();
+	buffer->events.reset(new TraceEvent[TraceThreadBuffer::Capacity]);
+
+	std::lock_guard<std::mutex> lock(TraceBuffersMutex);
+	buffer->threadId = (uint32_t) TraceBuffers.size() + 1;
+	ThreadTraceBuffer = buffer.get();
+	TraceBuffers.push_back(std::move(buffer));
+
+	return ThreadTraceBuffer;
+}
+
+void write_json_string(std::ostream& stream, const char* text)
+{
+	stream << '"';
+
+	for (const char* c = text; *c != '\0'; c++) {
+		switch (*c) {
+		case '"':
+			stream << "\\\"";
+			break;
+		case '\\':
+			stream << "\\\\";
+			break;
+		case '\n':
+			stream << "\\n";
+			break;
+		case '\t':
+			stream << "\\t";
+			break;
+		default:
+			if ((unsigned char) *c < 0x20) {
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int) (unsigned char) *c);
+				stream << escaped;
+			} else {
+				stream << *c;
+			}
+		}
+	}
+
+	stream << '"';
+}
+
+void start_tracing()
+{
+	TraceStart = std::chrono::steady_clock::now();
+	TracingEnabled = true;
+}
+
+uint64_t trace_now()
+{
+	return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - TraceStart).count();
+}
+
+void record_trace_event(const char* name, uint64_t startNs, uint64_t endNs)
+{
+	TraceThreadBuffer* buffer = get_thread_trace_buffer();
+
+	uint32_t index = buffer->eventCount.load(std::memory_order_relaxed);
+	if (index >= TraceThreadBuffer::Capacity) {
+		buffer->droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	buffer->events[index] = { name, startNs, endNs };
+	buffer->eventCount.store(index + 1, std::memory_order_release);
+}
+
+void set_trace_thread_name(const std::string& name)
+{
+	if (!TracingEnabled) return;
+
+	TraceThreadBuffer* buffer = get_thread_trace_buffer();
+
+	std::lock_guard<std::mutex> lock(TraceBuffersMutex);
+	buffer->threadName = name;
+}
+
+void write_trace(const std::string& filename)
+{
+	if (!TracingEnabled) return;
+
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open " + filename + " for writing");
+	}
+
+	std::lock_guard<std::mutex> lock(TraceBuffersMutex);
+
+	uint64_t eventTotal = 0;
+	uint64_t droppedTotal = 0;
+	bool firstEvent = true;
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	for (const auto& buffer : TraceBuffers) {
+		if (!buffer->threadName.empty()) {
+			file << (firstEvent ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+				<< buffer->threadId << ",\"args\":{\"name\":";
+			write_json_string(file, buffer->threadName.c_str());
+			file << "}}";
+			firstEvent = false;
+		}
+
+		uint32_t eventCount = buffer->eventCount.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < eventCount; i++) {
+			const TraceEvent& event = buffer->events[i];
+
+			// complete events, timestamps in microseconds
+			file << (firstEvent ? "" : ",\n") << "{\"name\":";
+			write_json_string(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"ts\":" << (event.startNs / 1000.0) << ",\"dur\":"
+				<< ((event.endNs - event.startNs) / 1000.0) << "}";
+			firstEvent = false;
+		}
+
+		eventTotal += eventCount;
+		droppedTotal += buffer->droppedCount.load(std::memory_order_relaxed);
+	}
+
+	file << "\n]}\n";
+
+	LOG_INFO("Wrote {} trace events from {} thread(s) to {}", eventTotal, TraceBuffers.size(), filename);
+	if (droppedTotal > 0) {
+		LOG_WARNING("{} trace events dropped after a thread's buffer filled up", droppedTotal);
+	}
+}
@@ -0,0 +1,666 @@
+#include "upload-queue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "vulkan-utils.hpp"
+
+UploadQueue Uploads;
+uint32_t UploadStreamMegabytes = 0;
+
+// enough for the odd texture or mesh between frames, streaming asks for more
+static const VkDeviceSize DefaultStagingBytes = 16ull << 20;
+static const uint32_t UploadBatchCount = 4;
+
+// the stream's destination is split into a slot per batch, so an upload never writes over one still in flight
+static Buffer UploadStreamBuffer;
+static std::vector<uint8_t> UploadStreamData;
+static std::vector<UploadTicket> UploadStreamTickets;
+static uint32_t UploadStreamSlot = 0;
+
+void UploadQueue::create(VkDeviceSize stagingCapacity, uint32_t batchCount)
+{
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+	dedicatedTransfer = queueFamilyIndices.has_dedicated_transfer();
+
+	stagingRing.create(stagingCapacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, batchCount);
+	batchBytesLimit = stagingCapacity / batchCount;
+	// buffer to image copies need offsets that are a multiple of the texel size, 16 covers every colour format
+	imageCopyAlignment = std::max<VkDeviceSize>(16,
+		PhysicalDeviceCapabilities.properties.limits.optimalBufferCopyOffsetAlignment);
+
+	batches.resize(batchCount);
+	for (auto& batch : batches) {
+		VkCommandPoolCreateInfo poolCreateInfo = {};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolCreateInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+
+		if (vkCreateCommandPool(Device, &poolCreateInfo, nullptr, &batch.transferPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload command pool");
+		}
+
+		VkCommandBufferAllocateInfo bufferAllocateInfo = {};
+		bufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		bufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		bufferAllocateInfo.commandPool = batch.transferPool;
+		bufferAllocateInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(Device, &bufferAllocateInfo, &batch.transferCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate upload command buffer");
+		}
+
+		VkFenceCreateInfo fenceCreateInfo = {};
+		fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		if (vkCreateFence(Device, &fenceCreateInfo, nullptr, &batch.transferFence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload fence");
+		}
+
+		if (!dedicatedTransfer) continue;
+
+		poolCreateInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+		if (vkCreateCommandPool(Device, &poolCreateInfo, nullptr, &batch.acquirePool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload acquire command pool");
+		}
+
+		bufferAllocateInfo.commandPool = batch.acquirePool;
+		if (vkAllocateCommandBuffers(Device, &bufferAllocateInfo, &batch.acquireCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate upload acquire command buffer");
+		}
+
+		if (vkCreateFence(Device, &fenceCreateInfo, nullptr, &batch.acquireFence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload acquire fence");
+		}
+	}
+
+	gatheringBatch = 0;
+	gathering = false;
+	nextTicket = 1;
+	completedTicket = NoTicket;
+	uploadStatistics = UploadStatistics();
+}
+
+void UploadQueue::destroy()
+{
+	if (batches.empty()) return;
+
+	submit();
+	wait(nextTicket - 1);
+
+	for (auto& batch : batches) {
+		if (batch.state == BatchState::Acquiring) {
+			vkWaitForFences(Device, 1, &batch.acquireFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+
+		// destroying the pools frees their command buffers
+		vkDestroyFence(Device, batch.transferFence, nullptr);
+		vkDestroyCommandPool(Device, batch.transferPool, nullptr);
+
+		if (batch.acquirePool != VK_NULL_HANDLE) {
+			vkDestroyFence(Device, batch.acquireFence, nullptr);
+			vkDestroyCommandPool(Device, batch.acquirePool, nullptr);
+		}
+	}
+
+	stagingRing.destroy();
+
+	*this = UploadQueue();
+}
+
+UploadTicket UploadQueue::upload_buffer(const Buffer& buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	VkDeviceSize stagingOffset = 0;
+	if (!stage(data, size, 16, stagingOffset)) return NoTicket;
+
+	UploadBatch& batch = batches[gatheringBatch];
+	UploadTicket ticket = batch.ticket;
+
+	PendingBufferCopy copy = {};
+	copy.buffer = buffer.buffer;
+	copy.region.srcOffset = stagingOffset;
+	copy.region.dstOffset = offset;
+	copy.region.size = size;
+	copy.dstStage = dstStage;
+	copy.dstAccess = dstAccess;
+	batch.bufferCopies.push_back(copy);
+
+	// big enough that it should get going rather than wait for the end of the frame
+	if (batch.bytes >= batchBytesLimit) {
+		submit();
+	}
+
+	return ticket;
+}
+
+UploadTicket UploadQueue::upload_image(const Image& image, VkExtent3D extent, VkImageAspectFlags aspect, const void* data,
+	VkDeviceSize size, VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	VkDeviceSize stagingOffset = 0;
+	if (!stage(data, size, imageCopyAlignment, stagingOffset)) return NoTicket;
+
+	UploadBatch& batch = batches[gatheringBatch];
+	UploadTicket ticket = batch.ticket;
+
+	PendingImageCopy copy = {};
+	copy.image = image.image;
+	copy.region.bufferOffset = stagingOffset;
+	// tightly packed
+	copy.region.bufferRowLength = 0;
+	copy.region.bufferImageHeight = 0;
+	copy.region.imageSubresource.aspectMask = aspect;
+	copy.region.imageSubresource.mipLevel = 0;
+	copy.region.imageSubresource.baseArrayLayer = 0;
+	copy.region.imageSubresource.layerCount = 1;
+	copy.region.imageExtent = extent;
+	copy.finalLayout = finalLayout;
+	copy.dstStage = dstStage;
+	copy.dstAccess = dstAccess;
+	batch.imageCopies.push_back(copy);
+
+	if (batch.bytes >= batchBytesLimit) {
+		submit();
+	}
+
+	return ticket;
+}
+
+UploadQueue::UploadBatch* UploadQueue::gathering_batch()
+{
+	if (gathering) return &batches[gatheringBatch];
+
+	UploadBatch& batch = batches[gatheringBatch];
+	if (batch.state != BatchState::Free) return nullptr;
+
+	// the batch's staging space was given back when its transfer finished, this only makes it the one allocated from
+	stagingRing.begin_frame(gatheringBatch);
+
+	batch.state = BatchState::Gathering;
+	// only given a ticket once something's in it, so every ticket handed out is for a batch that will be submitted
+	batch.ticket = NoTicket;
+	batch.bytes = 0;
+	batch.bufferCopies.clear();
+	batch.imageCopies.clear();
+	gathering = true;
+
+	return &batch;
+}
+
+bool UploadQueue::stage(const void* data, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& stagingOffset)
+{
+	if (size > stagingRing.capacity()) {
+		throw std::runtime_error("Upload is bigger than the staging ring");
+	}
+
+	UploadBatch* batch = gathering_batch();
+	if (batch == nullptr) {
+		uploadStatistics.uploadsDeferred++;
+		return false;
+	}
+
+	TransientAllocation allocation;
+	if (!stagingRing.try_allocate(size, alignment, allocation)) {
+		// whatever's already gathered is what's holding the space up, so it may as well start moving
+		submit();
+		uploadStatistics.uploadsDeferred++;
+		return false;
+	}
+
+	std::memcpy(allocation.mapped, data, (size_t) size);
+
+	stagingOffset = allocation.offset;
+	batch->bytes += size;
+	if (batch->ticket == NoTicket) {
+		batch->ticket = nextTicket++;
+	}
+
+	return true;
+}
+
+void UploadQueue::submit()
+{
+	if (!gathering) return;
+
+	UploadBatch& batch = batches[gatheringBatch];
+	if (batch.bufferCopies.empty() && batch.imageCopies.empty()) return;
+
+	TRACE_ZONE("UploadQueue::submit");
+
+	record_transfer(batch);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.transferCommandBuffer;
+
+	vkResetFences(Device, 1, &batch.transferFence);
+	if (vkQueueSubmit(TransferQueue, 1, &submitInfo, batch.transferFence) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit upload batch");
+	}
+
+	batch.state = BatchState::Transferring;
+	gathering = false;
+	gatheringBatch = (gatheringBatch + 1) % (uint32_t) batches.size();
+
+	uploadStatistics.batchesSubmitted++;
+	uploadStatistics.copiesSubmitted += batch.bufferCopies.size() + batch.imageCopies.size();
+	uploadStatistics.bytesSubmitted += batch.bytes;
+}
+
+void UploadQueue::record_transfer(UploadBatch& batch)
+{
+	vkResetCommandPool(Device, batch.transferPool, 0);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkCommandBuffer commandBuffer = batch.transferCommandBuffer;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	// images start out undefined, so whatever was in them before doesn't have to be handed over
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	for (const auto& copy : batch.imageCopies) {
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = copy.image;
+		barrier.subresourceRange.aspectMask = copy.region.imageSubresource.aspectMask;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		imageBarriers.push_back(barrier);
+	}
+
+	if (!imageBarriers.empty()) {
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, (uint32_t) imageBarriers.size(), imageBarriers.data());
+	}
+
+	for (const auto& copy : batch.bufferCopies) {
+		vkCmdCopyBuffer(commandBuffer, stagingRing.buffer(), copy.buffer, 1, &copy.region);
+	}
+	for (const auto& copy : batch.imageCopies) {
+		vkCmdCopyBufferToImage(commandBuffer, stagingRing.buffer(), copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &copy.region);
+	}
+
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+
+	// with a dedicated family this is the release half of handing everything to graphics, and the acquire half
+	// makes the writes visible. Otherwise this is the graphics queue, and one barrier does both.
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	VkPipelineStageFlags dstStages = 0;
+	VkAccessFlags dstAccesses = 0;
+
+	for (const auto& copy : batch.bufferCopies) {
+		dstStages |= copy.dstStage;
+		dstAccesses |= copy.dstAccess;
+
+		if (!dedicatedTransfer) continue;
+
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = queueFamilyIndices.transferFamily;
+		barrier.dstQueueFamilyIndex = queueFamilyIndices.graphicsFamily;
+		barrier.buffer = copy.buffer;
+		barrier.offset = copy.region.dstOffset;
+		barrier.size = copy.region.size;
+		bufferBarriers.push_back(barrier);
+	}
+
+	imageBarriers.clear();
+	for (const auto& copy : batch.imageCopies) {
+		dstStages |= copy.dstStage;
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dedicatedTransfer ? 0 : copy.dstAccess;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = copy.finalLayout;
+		barrier.srcQueueFamilyIndex = dedicatedTransfer ? queueFamilyIndices.transferFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = dedicatedTransfer ? queueFamilyIndices.graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = copy.image;
+		barrier.subresourceRange.aspectMask = copy.region.imageSubresource.aspectMask;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		imageBarriers.push_back(barrier);
+	}
+
+	if (dedicatedTransfer) {
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr, (uint32_t) bufferBarriers.size(), bufferBarriers.data(),
+			(uint32_t) imageBarriers.size(), imageBarriers.data());
+	} else {
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = dstAccesses;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0,
+			batch.bufferCopies.empty() ? 0 : 1, &memoryBarrier, 0, nullptr,
+			(uint32_t) imageBarriers.size(), imageBarriers.data());
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record upload command buffer");
+	}
+}
+
+void UploadQueue::submit_acquire(UploadBatch& batch)
+{
+	vkResetCommandPool(Device, batch.acquirePool, 0);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkCommandBuffer commandBuffer = batch.acquireCommandBuffer;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+	VkPipelineStageFlags dstStages = 0;
+
+	// has to match the release exactly, apart from the access masks
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	for (const auto& copy : batch.bufferCopies) {
+		dstStages |= copy.dstStage;
+
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = copy.dstAccess;
+		barrier.srcQueueFamilyIndex = queueFamilyIndices.transferFamily;
+		barrier.dstQueueFamilyIndex = queueFamilyIndices.graphicsFamily;
+		barrier.buffer = copy.buffer;
+		barrier.offset = copy.region.dstOffset;
+		barrier.size = copy.region.size;
+		bufferBarriers.push_back(barrier);
+	}
+
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	for (const auto& copy : batch.imageCopies) {
+		dstStages |= copy.dstStage;
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = copy.dstAccess;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = copy.finalLayout;
+		barrier.srcQueueFamilyIndex = queueFamilyIndices.transferFamily;
+		barrier.dstQueueFamilyIndex = queueFamilyIndices.graphicsFamily;
+		barrier.image = copy.image;
+		barrier.subresourceRange.aspectMask = copy.region.imageSubresource.aspectMask;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		imageBarriers.push_back(barrier);
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages, 0,
+		0, nullptr, (uint32_t) bufferBarriers.size(), bufferBarriers.data(),
+		(uint32_t) imageBarriers.size(), imageBarriers.data());
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record upload acquire command buffer");
+	}
+
+	// the release has already finished, so unlike end_transfer_commands there's no semaphore to wait on and the
+	// graphics queue is never held up by the transfer queue
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	vkResetFences(Device, 1, &batch.acquireFence);
+	if (vkQueueSubmit(GraphicsQueue, 1, &submitInfo, batch.acquireFence) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit upload acquire");
+	}
+}
+
+void UploadQueue::poll()
+{
+	if (batches.empty()) return;
+
+	TRACE_ZONE("UploadQueue::poll");
+
+	uint32_t batchCount = (uint32_t) batches.size();
+	// staging space has to be given back in submission order, which starts after the newest batch
+	bool transferBlocked = false;
+
+	for (uint32_t i = 0; i < batchCount; i++) {
+		uint32_t batchIndex = (gatheringBatch + i) % batchCount;
+		UploadBatch& batch = batches[batchIndex];
+
+		if (batch.state == BatchState::Transferring) {
+			if (transferBlocked || (vkGetFenceStatus(Device, batch.transferFence) != VK_SUCCESS)) {
+				transferBlocked = true;
+				continue;
+			}
+
+			stagingRing.release_frame(batchIndex);
+			uploadStatistics.bytesCompleted += batch.bytes;
+
+			// anything submitted to the graphics queue after the acquire is ordered after it by its barrier
+			if (dedicatedTransfer) {
+				submit_acquire(batch);
+				batch.state = BatchState::Acquiring;
+			} else {
+				batch.state = BatchState::Free;
+			}
+
+			completedTicket = batch.ticket;
+		} else if (batch.state == BatchState::Acquiring) {
+			// only the acquire's command buffer is waiting on this, so it can finish in any order
+			if (vkGetFenceStatus(Device, batch.acquireFence) == VK_SUCCESS) {
+				batch.state = BatchState::Free;
+			}
+		}
+	}
+}
+
+void UploadQueue::wait(UploadTicket ticket)
+{
+	TRACE_ZONE("UploadQueue::wait");
+
+	// an empty batch never gets a ticket, so there's nothing to submit for one
+	if (gathering) {
+		const UploadBatch& openBatch = batches[gatheringBatch];
+		if ((openBatch.ticket != NoTicket) && (openBatch.ticket <= ticket)) {
+			submit();
+		}
+	}
+
+	std::vector<VkFence> fences;
+	for (const auto& batch : batches) {
+		if ((batch.state == BatchState::Transferring) && (batch.ticket <= ticket)) {
+			fences.push_back(batch.transferFence);
+		}
+	}
+
+	if (!fences.empty()) {
+		vkWaitForFences(Device, (uint32_t) fences.size(), fences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+
+	poll();
+}
+
+void create_upload_queue()
+{
+	TRACE_ZONE("create_upload_queue");
+
+	// room for every batch in flight to carry a frame's worth of the stream
+	VkDeviceSize streamBytes = (VkDeviceSize) UploadStreamMegabytes << 20;
+	Uploads.create(std::max(DefaultStagingBytes, streamBytes * UploadBatchCount), UploadBatchCount);
+
+	if (UploadStreamMegabytes > 0) {
+		UploadStreamBuffer = create_buffer(streamBytes * UploadBatchCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		UploadStreamData.resize((size_t) streamBytes);
+		for (size_t i = 0; i < UploadStreamData.size(); i++) {
+			UploadStreamData[i] = (uint8_t) i;
+		}
+
+		UploadStreamTickets.assign(UploadBatchCount, UploadQueue::NoTicket);
+		UploadStreamSlot = 0;
+
+		LOG_INFO("Streaming {} MB to the GPU every frame", UploadStreamMegabytes);
+	}
+}
+
+void update_upload_stream()
+{
+	if (UploadStreamMegabytes == 0) return;
+
+	TRACE_ZONE("update_upload_stream");
+
+	// skipped rather than waited on if the slot's last upload hasn't landed yet
+	if (!Uploads.is_complete(UploadStreamTickets[UploadStreamSlot])) return;
+
+	VkDeviceSize streamBytes = UploadStreamData.size();
+	UploadTicket ticket = Uploads.upload_buffer(UploadStreamBuffer, streamBytes * UploadStreamSlot,
+		UploadStreamData.data(), streamBytes, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	if (ticket == UploadQueue::NoTicket) return;
+
+	UploadStreamTickets[UploadStreamSlot] = ticket;
+	UploadStreamSlot = (UploadStreamSlot + 1) % UploadBatchCount;
+}
+
+void destroy_upload_queue()
+{
+	Uploads.destroy();
+
+	if (UploadStreamBuffer.buffer != VK_NULL_HANDLE) {
+		destroy_buffer(UploadStreamBuffer);
+	}
+	UploadStreamData.clear();
+	UploadStreamTickets.clear();
+}
+
+void benchmark_uploads()
+{
+	const VkDeviceSize totalBytes = 256ull << 20;
+	const VkDeviceSize stagingBytes = 64ull << 20;
+	const VkDeviceSize pieceSizes[] = { 64ull << 10, 1ull << 20, 16ull << 20 };
+
+	UploadQueue queue;
+	queue.create(stagingBytes, UploadBatchCount);
+
+	// as big as the ring, so by the time a piece of it is written again the batch that last wrote it has finished
+	Buffer destination = create_buffer(stagingBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	std::vector<uint8_t> source((size_t) pieceSizes[2]);
+	for (size_t i = 0; i < source.size(); i++) {
+		source[i] = (uint8_t) i;
+	}
+
+	LOG_INFO("Uploading {} MB through a {} MB staging ring:", totalBytes >> 20, stagingBytes >> 20);
+
+	for (VkDeviceSize pieceSize : pieceSizes) {
+		uint64_t batchesBefore = queue.statistics().batchesSubmitted;
+		uint64_t deferredBefore = queue.statistics().uploadsDeferred;
+
+		auto uploadStart = std::chrono::steady_clock::now();
+
+		UploadTicket lastTicket = UploadQueue::NoTicket;
+		VkDeviceSize offset = 0;
+		for (VkDeviceSize uploaded = 0; uploaded < totalBytes;) {
+			UploadTicket ticket = queue.upload_buffer(destination, offset, source.data(), pieceSize,
+				VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+			// the ring is full, a frame loop would carry on and try again next frame
+			if (ticket == UploadQueue::NoTicket) {
+				queue.poll();
+				continue;
+			}
+
+			lastTicket = ticket;
+			uploaded += pieceSize;
+			offset = (offset + pieceSize) % destination.size;
+		}
+		queue.wait(lastTicket);
+
+		double uploadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - uploadStart).count();
+
+		LOG_INFO("  {} KB pieces: {} MB/s, {} batch(es), {} upload(s) deferred", pieceSize >> 10,
+			(totalBytes >> 20) / uploadSeconds, queue.statistics().batchesSubmitted - batchesBefore,
+			queue.statistics().uploadsDeferred - deferredBefore);
+	}
+
+	// images go through the same ring, with a layout transition either side of each copy. As many of them as fit in
+	// the ring, for the same reason as the buffer.
+	const VkExtent3D imageExtent = { 1024, 1024, 1 };
+	const VkDeviceSize imageBytes = 4ull * imageExtent.width * imageExtent.height;
+
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	imageCreateInfo.extent = imageExtent;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	std::vector<Image> images((size_t) (stagingBytes / imageBytes));
+	for (auto& image : images) {
+		image = create_image(imageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	uint64_t batchesBefore = queue.statistics().batchesSubmitted;
+	uint64_t deferredBefore = queue.statistics().uploadsDeferred;
+
+	auto uploadStart = std::chrono::steady_clock::now();
+
+	UploadTicket lastTicket = UploadQueue::NoTicket;
+	size_t imageIndex = 0;
+	for (VkDeviceSize uploaded = 0; uploaded < totalBytes;) {
+		UploadTicket ticket = queue.upload_image(images[imageIndex], imageExtent, VK_IMAGE_ASPECT_COLOR_BIT,
+			source.data(), imageBytes, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_SHADER_READ_BIT);
+
+		if (ticket == UploadQueue::NoTicket) {
+			queue.poll();
+			continue;
+		}
+
+		lastTicket = ticket;
+		uploaded += imageBytes;
+		imageIndex = (imageIndex + 1) % images.size();
+	}
+	queue.wait(lastTicket);
+
+	double uploadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - uploadStart).count();
+
+	LOG_INFO("  {}x{} images: {} MB/s, {} batch(es), {} upload(s) deferred", imageExtent.width, imageExtent.height,
+		(totalBytes >> 20) / uploadSeconds, queue.statistics().batchesSubmitted - batchesBefore,
+		queue.statistics().uploadsDeferred - deferredBefore);
+
+	queue.destroy();
+	destroy_buffer(destination);
+	for (auto& image : images) {
+		destroy_image(image);
+	}
+}
@@ -3,32 +3,43 @@
 
 VkDebugReportCallbackEXT Callback;
 
+bool Headless = false;
+
 VkInstance Instance;
 VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
+DeviceCapabilities PhysicalDeviceCapabilities;
 VkDevice Device = VK_NULL_HANDLE;
-VkSurfaceKHR Surface;
+VkSurfaceKHR Surface = VK_NULL_HANDLE;
 
 VkSurfaceFormatKHR SurfaceFormat;
 VkExtent2D SurfaceExtent;
 
 VkSwapchainKHR SwapChain = VK_NULL_HANDLE;
+std::vector<Image> OffscreenImages;
 VkQueue GraphicsQueue = VK_NULL_HANDLE;
 VkQueue PresentQueue = VK_NULL_HANDLE;
+VkQueue TransferQueue = VK_NULL_HANDLE;
+VkQueue ComputeQueue = VK_NULL_HANDLE;
 std::vector<VkImageView> ImageViews;
-VkRenderPass RenderPass;
+bool DepthTestEnabled = true;
+VkRenderPass RenderPass = VK_NULL_HANDLE;
 VkPipeline Pipeline;
 VkPipelineLayout PipelineLayout;
 
-std::vector<VkFramebuffer> Framebuffers;
+VkPipelineCache PipelineCache = VK_NULL_HANDLE;
+bool PipelineCacheWarm = false;
+
 VkCommandPool CommandPool;
-std::vector<VkCommandBuffer> CommandBuffers;
+VkCommandPool TransferCommandPool = VK_NULL_HANDLE;
 
-VkSemaphore ImageAvailableSemaphore;
-VkSemaphore RenderFinishSemaphore;
+uint32_t FramesInFlight = 2;
+FrameContext Frames;
 
 // Creation
 
 void create_instance() {
+    TRACE_ZONE("create_instance");
+
     if (EnableValidationLayers && !check_validation_layers()) {
         throw std::runtime_error("Using validation layers, but could not find them all");
     }
@@ -52,7 +63,7 @@ void create_instance() {
         instanceInfo.enabledLayerCount = static_cast<uint32_t>(ValidationLayers.size());
         instanceInfo.ppEnabledLayerNames = ValidationLayers.data();
 
-        std::cout << "Using Validation Layers" << std::endl;
+        LOG_INFO("Using validation layers");
     } else {
         instanceInfo.enabledLayerCount = 0;
     }
@@ -62,11 +73,10 @@ void create_instance() {
     std::vector<VkExtensionProperties> availableExtensions(availableExtensionCount);
     vkEnumerateInstanceExtensionProperties(nullptr, &availableExtensionCount, availableExtensions.data());
 
-    std::cout << "Using these extensions:\n";
+    LOG_DEBUG("Available instance extensions:");
     for (const auto& extension : availableExtensions) {
-        std::cout << "\t" << extension.extensionName << " v" << extension.specVersion << "\n";
+        LOG_DEBUG("\t{} v{}", extension.extensionName, extension.specVersion);
     }
-    std::cout.flush();
 
     if (vkCreateInstance(&instanceInfo, nullptr, &Instance) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create Vulkan instance");
@@ -87,6 +97,8 @@ void setup_debug_callback() {
 }
 
 void pick_physical_device() {
+	TRACE_ZONE("pick_physical_device");
+
 	uint32_t deviceCount = 0;
 	vkEnumeratePhysicalDevices(Instance, &deviceCount, nullptr);
 
@@ -96,28 +108,70 @@ void pick_physical_device() {
 	std::vector<VkPhysicalDevice> devices(deviceCount);
 	vkEnumeratePhysicalDevices(Instance, &deviceCount, devices.data());
 
-	for (const auto& device : devices) {
-		if (is_device_suitable(device)) {
-			PhysicalDevice = device;
-			break;
+	const char* deviceOverride = std::getenv(DeviceOverrideVariable);
+	std::string_view deviceOverrideView = deviceOverride ? deviceOverride : "";
+	bool overrideIsIndex = !deviceOverrideView.empty() &&
+		std::all_of(deviceOverrideView.begin(), deviceOverrideView.end(), [](char c) { return (c >= '0') && (c <= '9'); });
+
+	std::vector<DeviceCapabilities> candidates;
+	candidates.reserve(deviceCount);
+
+	int chosenIndex = -1;
+	uint64_t bestScore = 0;
+	for (uint32_t i = 0; i < deviceCount; i++) {
+		candidates.push_back(query_device_capabilities(devices[i]));
+		const auto& capabilities = candidates.back();
+
+		bool suitable = is_device_suitable(capabilities);
+		uint64_t score = suitable ? score_device(capabilities) : 0;
+
+		LOG_INFO("Device {}: {} ({}, {} MB device local memory){}", i, capabilities.properties.deviceName,
+			get_device_type_name(capabilities.properties.deviceType), capabilities.deviceLocalBytes / (1024 * 1024),
+			suitable ? "" : ", not suitable");
+
+		if (!suitable) continue;
+
+		if (deviceOverride) {
+			bool matches = overrideIsIndex ? (std::strtoul(deviceOverride, nullptr, 10) == i) :
+				(std::string_view(capabilities.properties.deviceName).find(deviceOverrideView) != std::string_view::npos);
+
+			if (matches && (chosenIndex < 0)) {
+				chosenIndex = (int) i;
+			}
+		} else if ((chosenIndex < 0) || (score > bestScore)) {
+			chosenIndex = (int) i;
+			bestScore = score;
 		}
 	}
 
-	if (PhysicalDevice == VK_NULL_HANDLE) {
-		throw std::runtime_error(deviceCount + "device(s) found but none meet requirements");
+	if (chosenIndex < 0) {
+		if (deviceOverride) {
+			throw std::runtime_error(std::string("No suitable device matches ") + DeviceOverrideVariable + "=" + deviceOverride);
+		}
+
+		throw std::runtime_error(std::to_string(deviceCount) + " device(s) found but none meet requirements");
 	}
 
-	VkPhysicalDeviceProperties deviceProps;
-	vkGetPhysicalDeviceProperties(PhysicalDevice, &deviceProps);
-	std::cout << "Using device: " << deviceProps.deviceName << std::endl;
+	PhysicalDeviceCapabilities = std::move(candidates[chosenIndex]);
+	PhysicalDevice = PhysicalDeviceCapabilities.device;
+
+	LOG_INFO("Using device: {}{}", PhysicalDeviceCapabilities.properties.deviceName,
+		deviceOverride ? " (chosen by " + std::string(DeviceOverrideVariable) + ")" : "");
 }
 
 void create_logical_device()
 {
-	auto queueFamilyIndices = get_queue_family_indices(PhysicalDevice);
+	TRACE_ZONE("create_logical_device");
+
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
 
 	std::vector<VkDeviceQueueCreateInfo> requiredQueuesCreateInfo;
-	std::set<int> uniqueQueueFamilyIndices = { queueFamilyIndices.graphicsFamily, queueFamilyIndices.presentFamily };
+	std::set<int> uniqueQueueFamilyIndices = {
+		queueFamilyIndices.graphicsFamily, queueFamilyIndices.transferFamily, queueFamilyIndices.computeFamily
+	};
+	if (queueFamilyIndices.presentFamily >= 0) {
+		uniqueQueueFamilyIndices.insert(queueFamilyIndices.presentFamily);
+	}
 
 	float queuePriority = 1.0f;
 	for (const int& queueFamilyIndex : uniqueQueueFamilyIndices) {
@@ -132,13 +186,75 @@ void create_logical_device()
 
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 
+	if (PipelineStatisticsEnabled) {
+		const auto& supportedFeatures = PhysicalDeviceCapabilities.features;
+
+		// the scene is drawn from secondary command buffers, so they have to be able to inherit the query
+		if (supportedFeatures.pipelineStatisticsQuery && supportedFeatures.inheritedQueries) {
+			deviceFeatures.pipelineStatisticsQuery = VK_TRUE;
+			deviceFeatures.inheritedQueries = VK_TRUE;
+		} else {
+			LOG_WARNING("Device doesn't support pipeline statistics queries, not collecting them");
+			PipelineStatisticsEnabled = false;
+		}
+	}
+
+	auto extensions = get_required_device_extensions();
+
+	// optional, so CI and older software rasterisers can still run the scene. Everything that only works through
+	// Bindless is turned off without it.
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	BindlessEnabled = PhysicalDeviceCapabilities.supports_bindless();
+	if (BindlessEnabled) {
+		// only what Bindless uses, the rest stay off
+		const auto& supportedIndexing = PhysicalDeviceCapabilities.descriptorIndexingFeatures;
+		deviceFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+		indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+		indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		indexingFeatures.shaderStorageBufferArrayNonUniformIndexing = supportedIndexing.shaderStorageBufferArrayNonUniformIndexing;
+		indexingFeatures.shaderSampledImageArrayNonUniformIndexing = supportedIndexing.shaderSampledImageArrayNonUniformIndexing;
+
+		extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+	} else {
+		LOG_WARNING("Bindless descriptors aren't available, the device doesn't support {}. Drawing without GPU culling, "
+			"particles, instanced objects or sprites.", PhysicalDeviceCapabilities.missing_bindless_capability());
+
+		GpuCullingEnabled = false;
+		ParticleCount = 0;
+		InstancedObjectCount = 0;
+		SpriteCount = 0;
+	}
+
+	MultiDrawIndirectEnabled = false;
+	DrawIndirectCountEnabled = false;
+	if (GpuCullingEnabled) {
+		// both optional, without them the culled draws are drawn with their instance count zeroed
+		if (PhysicalDeviceCapabilities.features.multiDrawIndirect) {
+			deviceFeatures.multiDrawIndirect = VK_TRUE;
+			MultiDrawIndirectEnabled = true;
+		}
+
+		if (PhysicalDeviceCapabilities.has_extension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+			DrawIndirectCountEnabled = true;
+		}
+	}
+
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = BindlessEnabled ? &indexingFeatures : nullptr;
 	createInfo.pQueueCreateInfos = requiredQueuesCreateInfo.data();
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(requiredQueuesCreateInfo.size());
+
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = Extensions.size();
-	createInfo.ppEnabledExtensionNames = Extensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	if (EnableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(ValidationLayers.size());
@@ -153,25 +269,112 @@ void create_logical_device()
 	}
 
 	vkGetDeviceQueue(Device, queueFamilyIndices.graphicsFamily, 0, &GraphicsQueue);
-	std::cout << "Obtained graphics queue\n";
-	vkGetDeviceQueue(Device, queueFamilyIndices.presentFamily, 0, &PresentQueue);
-	std::cout << "Obtained present queue\n";
+	LOG_DEBUG("Obtained graphics queue");
+	if (!Headless) {
+		vkGetDeviceQueue(Device, queueFamilyIndices.presentFamily, 0, &PresentQueue);
+		LOG_DEBUG("Obtained present queue");
+	}
+
+	vkGetDeviceQueue(Device, queueFamilyIndices.transferFamily, 0, &TransferQueue);
+	vkGetDeviceQueue(Device, queueFamilyIndices.computeFamily, 0, &ComputeQueue);
 
-	std::cout.flush();
+	LOG_INFO("Queue families: graphics {}, transfer {}{}, compute {}{}", queueFamilyIndices.graphicsFamily,
+		queueFamilyIndices.transferFamily, queueFamilyIndices.has_dedicated_transfer() ? " (dedicated)" : "",
+		queueFamilyIndices.computeFamily, queueFamilyIndices.has_async_compute() ? " (async)" : "");
+}
+
+void create_memory_allocator()
+{
+	TRACE_ZONE("create_memory_allocator");
+
+	Allocator.init(Device, PhysicalDeviceCapabilities.properties, PhysicalDeviceCapabilities.memoryProperties);
+
+	LOG_DEBUG("Memory allocator created");
+}
+
+Buffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+{
+	Buffer buffer;
+	buffer.size = size;
+	buffer.usage = usage;
+
+	VkBufferCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	createInfo.size = size;
+	createInfo.usage = usage;
+	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(Device, &createInfo, nullptr, &buffer.buffer) != VK_SUCCESS) {
+		throw std::runtime_error("Could not create buffer");
+	}
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(Device, buffer.buffer, &memoryRequirements);
+
+	// the handle would leak if the memory couldn't be found or bound
+	try {
+		buffer.allocation = Allocator.allocate(memoryRequirements, properties, AllocationType::Buffer);
+	} catch (...) {
+		vkDestroyBuffer(Device, buffer.buffer, nullptr);
+		throw;
+	}
+
+	if (vkBindBufferMemory(Device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset) != VK_SUCCESS) {
+		Allocator.free(buffer.allocation);
+		vkDestroyBuffer(Device, buffer.buffer, nullptr);
+		throw std::runtime_error("Could not bind buffer memory");
+	}
+
+	return buffer;
+}
+
+Image create_image(const VkImageCreateInfo& createInfo, VkMemoryPropertyFlags properties)
+{
+	Image image;
+
+	if (vkCreateImage(Device, &createInfo, nullptr, &image.image) != VK_SUCCESS) {
+		throw std::runtime_error("Could not create image");
+	}
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(Device, image.image, &memoryRequirements);
+
+	auto allocationType = (createInfo.tiling == VK_IMAGE_TILING_OPTIMAL) ?
+		AllocationType::ImageOptimal : AllocationType::ImageLinear;
+	try {
+		image.allocation = Allocator.allocate(memoryRequirements, properties, allocationType);
+	} catch (...) {
+		vkDestroyImage(Device, image.image, nullptr);
+		throw;
+	}
+
+	if (vkBindImageMemory(Device, image.image, image.allocation.memory, image.allocation.offset) != VK_SUCCESS) {
+		Allocator.free(image.allocation);
+		vkDestroyImage(Device, image.image, nullptr);
+		throw std::runtime_error("Could not bind image memory");
+	}
+
+	return image;
 }
 
 void create_swap_chain(const uint32_t width, const uint32_t height)
 {
-	auto swapChainDetails = get_swap_chain_support_details(PhysicalDevice, Surface);
+	TRACE_ZONE("create_swap_chain");
+
+	const auto& surfaceSupport = PhysicalDeviceCapabilities.surfaceSupport;
+
+	// the formats and present modes are fixed, but the current extent follows the window
+	VkSurfaceCapabilitiesKHR surfaceCapabilities;
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(PhysicalDevice, Surface, &surfaceCapabilities);
 
-	auto selectedFormat = get_best_surface_format(swapChainDetails.formats);
-	auto selectedMode = get_best_present_mode(swapChainDetails.presentationModes);
-	auto selectedExtent = get_best_swap_extent(swapChainDetails.capabilities, width, height);
+	auto selectedFormat = get_best_surface_format(surfaceSupport.formats);
+	auto selectedMode = get_best_present_mode(surfaceSupport.presentationModes);
+	auto selectedExtent = get_best_swap_extent(surfaceCapabilities, width, height);
 
-	uint32_t imageCount = swapChainDetails.capabilities.minImageCount + 1;
-	if ((swapChainDetails.capabilities.maxImageCount != 0) &&
-		(imageCount > swapChainDetails.capabilities.maxImageCount)) {
-		imageCount = swapChainDetails.capabilities.maxImageCount;
+	uint32_t imageCount = surfaceCapabilities.minImageCount + 1;
+	if ((surfaceCapabilities.maxImageCount != 0) &&
+		(imageCount > surfaceCapabilities.maxImageCount)) {
+		imageCount = surfaceCapabilities.maxImageCount;
 	}
 
 	VkSwapchainCreateInfoKHR createInfo = {};
@@ -185,7 +388,7 @@ void create_swap_chain(const uint32_t width, const uint32_t height)
 	createInfo.imageArrayLayers = 1;
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-	auto queueFamilies = get_queue_family_indices(PhysicalDevice);
+	const auto& queueFamilies = PhysicalDeviceCapabilities.queueFamilyIndices;
 	if (queueFamilies.graphicsFamily != queueFamilies.presentFamily) {
 		createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
 		createInfo.queueFamilyIndexCount = 2;
@@ -199,29 +402,87 @@ void create_swap_chain(const uint32_t width, const uint32_t height)
 		createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	}
 
-	createInfo.preTransform = swapChainDetails.capabilities.currentTransform;
+	createInfo.preTransform = surfaceCapabilities.currentTransform;
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// handing over the swap chain being replaced lets the driver recycle its images
+	VkSwapchainKHR oldSwapChain = SwapChain;
+	createInfo.oldSwapchain = oldSwapChain;
 
 	if (vkCreateSwapchainKHR(Device, &createInfo, nullptr, &SwapChain) != VK_SUCCESS) {
 		throw std::runtime_error("Could not create swapchain");
 	}
 
-	std::cout << "Swapchain created successfully" << std::endl;
+	if (oldSwapChain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(Device, oldSwapChain, nullptr);
+	}
+
+	LOG_INFO("Swapchain created successfully");
 	SurfaceFormat = selectedFormat;
 	SurfaceExtent = selectedExtent;
 }
 
+void recreate_swap_chain(const uint32_t width, const uint32_t height)
+{
+	TRACE_ZONE("recreate_swap_chain");
+
+	auto recreationStart = std::chrono::steady_clock::now();
+
+	vkDeviceWaitIdle(Device);
+
+	// the render pass and pipeline don't depend on the extent (viewport and scissor are dynamic) and command
+	// buffers are recorded every frame, so only the objects built on top of the swap chain images need rebuilding
+	cleanup_swap_chain();
+
+	create_swap_chain(width, height);
+
+	create_image_views();
+
+	create_render_graph_targets();
+
+	Frames.imagesInFlight.assign(ImageViews.size(), VK_NULL_HANDLE);
+
+	double recreationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recreationStart).count();
+	LOG_INFO("Recreated swapchain at {}x{} in {} ms", SurfaceExtent.width, SurfaceExtent.height, recreationMs);
+}
+
+void create_offscreen_targets(const uint32_t width, const uint32_t height)
+{
+	TRACE_ZONE("create_offscreen_targets");
+
+	SurfaceFormat = { VK_FORMAT_R8G8B8A8_UNORM, VK_COLORSPACE_SRGB_NONLINEAR_KHR };
+	SurfaceExtent = { width, height };
+
+	// one target per frame in flight, so the frame's fence is enough to know its target is free again
+	OffscreenImages.resize(FramesInFlight);
+
+	for (uint32_t i = 0; i < FramesInFlight; i++) {
+		VkImageCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		createInfo.imageType = VK_IMAGE_TYPE_2D;
+		createInfo.format = SurfaceFormat.format;
+		createInfo.extent = { width, height, 1 };
+		createInfo.mipLevels = 1;
+		createInfo.arrayLayers = 1;
+		createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		createInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		OffscreenImages[i] = create_image(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	LOG_INFO("Created {} offscreen render targets", OffscreenImages.size());
+}
+
 void create_image_views()
 {
-	uint32_t imageCount = 0;
-	vkGetSwapchainImagesKHR(Device, SwapChain, &imageCount, nullptr);
+	TRACE_ZONE("create_image_views");
 
-	std::vector<VkImage> images(imageCount);
-	vkGetSwapchainImagesKHR(Device, SwapChain, &imageCount, images.data());
+	std::vector<VkImage> images = get_target_images();
 
-	ImageViews.resize(imageCount);
+	ImageViews.resize(images.size());
 
 	uint32_t i = 0;
 	for (auto& image : images) {
@@ -247,48 +508,66 @@ void create_image_views()
 		i++;
 	}
 
-	std::cout << "Created " << ImageViews.size() << " image views" << std::endl;
+	LOG_DEBUG("Created {} image views", ImageViews.size());
 }
 
-void create_render_pass()
+void create_pipeline_cache()
 {
-	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = SurfaceFormat.format;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	TRACE_ZONE("create_pipeline_cache");
 
-	VkAttachmentReference colorAttachmentRef = {};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	std::vector<char> cacheData;
 
-	VkSubpassDescription subpass = {};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
+	std::ifstream file(PipelineCacheFilename, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		cacheData.resize((size_t) file.tellg());
 
-	VkRenderPassCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	createInfo.attachmentCount = 1;
-	createInfo.pAttachments = &colorAttachment;
-	createInfo.subpassCount = 1;
-	createInfo.pSubpasses = &subpass;
+		file.seekg(0);
+		file.read(cacheData.data(), cacheData.size());
+		file.close();
 
-	if (vkCreateRenderPass(Device, &createInfo, nullptr, &RenderPass) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create render pass");
+		if (!is_pipeline_cache_compatible(cacheData)) {
+			LOG_WARNING("Discarding pipeline cache {}, it was made for a different device or driver", PipelineCacheFilename);
+			cacheData.clear();
+		}
 	}
 
-	std::cout << "Created render pass" << std::endl;
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = cacheData.size();
+	createInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+	if (vkCreatePipelineCache(Device, &createInfo, nullptr, &PipelineCache) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline cache");
+	}
+
+	PipelineCacheWarm = !cacheData.empty();
+	LOG_INFO("Created {} pipeline cache", PipelineCacheWarm ? "warm" : "cold");
+}
+
+void create_graphics_pipeline(const VertexLayout& vertexLayout)
+{
+	TRACE_ZONE("create_graphics_pipeline");
+
+	PipelineLayout = Bindless.pipelineLayout;
+
+	auto creationStart = std::chrono::steady_clock::now();
+
+	// the object's transform is either pushed or in a dynamic uniform buffer, depending on ObjectData
+	const char* vertexShaderName = (ObjectData == ObjectDataPath::UniformBuffer) ? "singleTriangleUniforms.vert" :
+		"singleTriangle.vert";
+
+	Pipeline = build_graphics_pipeline(vertexShaderName, "singleTriangle.frag", vertexLayout,
+		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, PipelineLayout, DepthTestEnabled);
+
+	double creationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - creationStart).count();
+	LOG_INFO("Created graphics pipeline in {} ms ({} pipeline cache)", creationMs, PipelineCacheWarm ? "warm" : "cold");
 }
 
-void create_graphics_pipeline()
+VkPipeline build_graphics_pipeline(const std::string& vertexShaderName, const std::string& fragmentShaderName,
+	const VertexLayout& vertexLayout, VkPrimitiveTopology topology, VkPipelineLayout layout, bool depthTest)
 {
-	auto vertexShader = read_shader_bytecode("shaders/vert.spv");
-	auto fragmentShader = read_shader_bytecode("shaders/frag.spv");
+	auto vertexShader = get_shader_bytecode(vertexShaderName);
+	auto fragmentShader = get_shader_bytecode(fragmentShaderName);
 
 	VkShaderModule vertexShaderModule = create_shader_module(vertexShader);
 	VkShaderModule fragmentShaderModule = create_shader_module(fragmentShader);
@@ -311,36 +590,30 @@ void create_graphics_pipeline()
 
 	VkPipelineVertexInputStateCreateInfo vertexInputPipelineStage = {};
 	vertexInputPipelineStage.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputPipelineStage.vertexBindingDescriptionCount = 0;
-	vertexInputPipelineStage.pVertexBindingDescriptions = nullptr;
-	vertexInputPipelineStage.vertexAttributeDescriptionCount = 0;
-	vertexInputPipelineStage.pVertexBindingDescriptions = nullptr;
+	vertexInputPipelineStage.vertexBindingDescriptionCount = (uint32_t) vertexLayout.bindings.size();
+	vertexInputPipelineStage.pVertexBindingDescriptions = vertexLayout.bindings.data();
+	vertexInputPipelineStage.vertexAttributeDescriptionCount = (uint32_t) vertexLayout.attributes.size();
+	vertexInputPipelineStage.pVertexAttributeDescriptions = vertexLayout.attributes.data();
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyPipelineStage = {};
 	inputAssemblyPipelineStage.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 	inputAssemblyPipelineStage.primitiveRestartEnable = VK_FALSE;
-	inputAssemblyPipelineStage.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssemblyPipelineStage.topology = topology;
 
+	// the viewport and scissor are set when recording, so a resize doesn't need a new pipeline
 	VkPipelineViewportStateCreateInfo viewportPipelineStage = {};
 	viewportPipelineStage.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-
-	VkViewport viewport = {};
-	viewport.x = 0;
-	viewport.y = 0;
-	viewport.width = (float) SurfaceExtent.width;
-	viewport.height = (float) SurfaceExtent.height;
-	viewport.minDepth = 0.f;
-	viewport.maxDepth = 1.f;
-
 	viewportPipelineStage.viewportCount = 1;
-	viewportPipelineStage.pViewports = &viewport;
+	viewportPipelineStage.scissorCount = 1;
 
-	VkRect2D viewportScissor = {};
-	viewportScissor.extent = SurfaceExtent;
-	viewportScissor.offset = { 0, 0 };
+	VkDynamicState dynamicStates[] = {
+		VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR
+	};
 
-	viewportPipelineStage.scissorCount = 1;
-	viewportPipelineStage.pScissors = &viewportScissor;
+	VkPipelineDynamicStateCreateInfo dynamicPipelineStage = {};
+	dynamicPipelineStage.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicPipelineStage.dynamicStateCount = 2;
+	dynamicPipelineStage.pDynamicStates = dynamicStates;
 
 	VkPipelineRasterizationStateCreateInfo rasterizationPipelineStage = {};
 	rasterizationPipelineStage.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -358,6 +631,15 @@ void create_graphics_pipeline()
 	multisamplingPipelineStage.alphaToOneEnable = VK_FALSE;
 	multisamplingPipelineStage.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
+	// less rather than less or equal, so of a stack of identical instances only the first one drawn is shaded
+	VkPipelineDepthStencilStateCreateInfo depthStencilPipelineStage = {};
+	depthStencilPipelineStage.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilPipelineStage.depthTestEnable = depthTest ? VK_TRUE : VK_FALSE;
+	depthStencilPipelineStage.depthWriteEnable = depthTest ? VK_TRUE : VK_FALSE;
+	depthStencilPipelineStage.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencilPipelineStage.depthBoundsTestEnable = VK_FALSE;
+	depthStencilPipelineStage.stencilTestEnable = VK_FALSE;
+
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
 	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
 		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -369,12 +651,6 @@ void create_graphics_pipeline()
 	colorBlendPipelineStage.attachmentCount = 1;
 	colorBlendPipelineStage.pAttachments = &colorBlendAttachment;
 
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	if (vkCreatePipelineLayout(Device, &pipelineLayoutCreateInfo, nullptr, &PipelineLayout)) {
-		throw std::runtime_error("Failed to create pipeline layout");
-	}
-
 	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
 	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineCreateInfo.stageCount = 2;
@@ -384,27 +660,90 @@ void create_graphics_pipeline()
 	pipelineCreateInfo.pViewportState = &viewportPipelineStage;
 	pipelineCreateInfo.pRasterizationState = &rasterizationPipelineStage;
 	pipelineCreateInfo.pMultisampleState = &multisamplingPipelineStage;
+	pipelineCreateInfo.pDepthStencilState = &depthStencilPipelineStage;
 	pipelineCreateInfo.pColorBlendState = &colorBlendPipelineStage;
-	pipelineCreateInfo.layout = PipelineLayout;
+	pipelineCreateInfo.pDynamicState = &dynamicPipelineStage;
+	pipelineCreateInfo.layout = layout;
 	pipelineCreateInfo.renderPass = RenderPass;
 	pipelineCreateInfo.subpass = 0;
 
-	if (vkCreateGraphicsPipelines(Device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &Pipeline) != VK_SUCCESS) {
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(Device, PipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+	vkDestroyShaderModule(Device, vertexShaderModule, nullptr);
+	vkDestroyShaderModule(Device, fragmentShaderModule, nullptr);
+
+	if (result != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create graphics pipeline");
 	}
 
-	std::cout << "Created graphics pipeline" << std::endl;
+	return pipeline;
+}
 
-	vkDestroyShaderModule(Device, vertexShaderModule, nullptr);
-	vkDestroyShaderModule(Device, fragmentShaderModule, nullptr);
+VkPipeline create_compute_pipeline(const std::string& shaderName, VkPipelineLayout layout)
+{
+	auto computeShader = get_shader_bytecode(shaderName);
+	VkShaderModule computeShaderModule = create_shader_module(computeShader);
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = computeShaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = layout;
+
+	VkPipeline pipeline;
+	VkResult result = vkCreateComputePipelines(Device, PipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+	vkDestroyShaderModule(Device, computeShaderModule, nullptr);
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute pipeline from " + shaderName);
+	}
+
+	return pipeline;
+}
+
+VkDescriptorSetLayout create_descriptor_set_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	VkDescriptorSetLayoutCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	createInfo.bindingCount = (uint32_t) bindings.size();
+	createInfo.pBindings = bindings.data();
+
+	VkDescriptorSetLayout setLayout;
+	if (vkCreateDescriptorSetLayout(Device, &createInfo, nullptr, &setLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor set layout");
+	}
+
+	return setLayout;
 }
 
-VkShaderModule create_shader_module(const std::vector<char>& shaderByteCode)
+VkPipelineLayout create_pipeline_layout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+	const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+	VkPipelineLayoutCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	createInfo.setLayoutCount = (uint32_t) setLayouts.size();
+	createInfo.pSetLayouts = setLayouts.data();
+	createInfo.pushConstantRangeCount = (uint32_t) pushConstantRanges.size();
+	createInfo.pPushConstantRanges = pushConstantRanges.data();
+
+	VkPipelineLayout pipelineLayout;
+	if (vkCreatePipelineLayout(Device, &createInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline layout");
+	}
+
+	return pipelineLayout;
+}
+
+VkShaderModule create_shader_module(const ShaderBytecode& shaderByteCode)
 {
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = shaderByteCode.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderByteCode.data());
+	createInfo.codeSize = shaderByteCode.size;
+	createInfo.pCode = shaderByteCode.data();
 
 	VkShaderModule shaderModule;
 	if (vkCreateShaderModule(Device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -414,127 +753,294 @@ VkShaderModule create_shader_module(const std::vector<char>& shaderByteCode)
 	return shaderModule;
 }
 
-std::vector<char> read_shader_bytecode(const std::string & filename) {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+void create_command_pool()
+{
+	TRACE_ZONE("create_command_pool");
 
-	if (!file.is_open()) {
-		throw std::runtime_error("Failed to open shader " + filename);
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+
+	VkCommandPoolCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	createInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+
+	if (vkCreateCommandPool(Device, &createInfo, nullptr, &CommandPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create graphics command pool");
 	}
 
-	size_t fileSize = (size_t) file.tellg();
-	std::vector<char> fileContents(fileSize);
+	// only ever used for short lived upload command buffers
+	VkCommandPoolCreateInfo transferCreateInfo = {};
+	transferCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	transferCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	transferCreateInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
 
-	file.seekg(0);
-	file.read(fileContents.data(), fileSize);
+	if (vkCreateCommandPool(Device, &transferCreateInfo, nullptr, &TransferCommandPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create transfer command pool");
+	}
 
-	file.close();
+	LOG_DEBUG("Command pools created");
+}
 
-	std::cout << "Loaded shader " << filename << " with size " << fileContents.size() << std::endl;
+VkCommandBuffer allocate_secondary_command_buffer(VkCommandPool commandPool)
+{
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	allocateInfo.commandPool = commandPool;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	if (vkAllocateCommandBuffers(Device, &allocateInfo, &commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create secondary command buffer");
+	}
 
-	return fileContents;
+	return commandBuffer;
 }
 
-void create_framebuffers()
+void create_command_buffers()
 {
-	Framebuffers.resize(ImageViews.size());
+	TRACE_ZONE("create_command_buffers");
 
-	size_t i = 0;
-	for (auto& imageView : ImageViews) {
-		VkFramebufferCreateInfo createInfo = {};
-		createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		createInfo.renderPass = RenderPass;
-		createInfo.attachmentCount = 1;
-		createInfo.pAttachments = &imageView;
-		createInfo.width = SurfaceExtent.width;
-		createInfo.height = SurfaceExtent.height;
-		createInfo.layers = 1;
-
-		if (vkCreateFramebuffer(Device, &createInfo, nullptr, &Framebuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create framebuffer number " + i);
+	const auto& queueFamilyIndices = PhysicalDeviceCapabilities.queueFamilyIndices;
+	uint32_t threadCount = RecordingThreads.thread_count();
+
+	// allocated once up front, recording a frame only resets the pools so there's no per frame allocation
+	for (uint32_t i = 0; i < Frames.frames.size(); i++) {
+		auto& frame = Frames.frames[i];
+
+		VkCommandPoolCreateInfo poolCreateInfo = {};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolCreateInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+
+		if (vkCreateCommandPool(Device, &poolCreateInfo, nullptr, &frame.commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create frame command pool");
 		}
 
-		i++;
+		VkCommandBufferAllocateInfo bufferAllocateInfo = {};
+		bufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		bufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		bufferAllocateInfo.commandPool = frame.commandPool;
+		bufferAllocateInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(Device, &bufferAllocateInfo, &frame.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create command buffers");
+		}
+
+		if (Culling.is_enabled()) {
+			frame.cullingCommandBuffer = allocate_secondary_command_buffer(frame.commandPool);
+			frame.secondaryCommandBuffers.push_back(frame.cullingCommandBuffer);
+		} else {
+			frame.secondaryCommandBuffers.resize(threadCount);
+			for (uint32_t thread = 0; thread < threadCount; thread++) {
+				frame.secondaryCommandBuffers[thread] = allocate_secondary_command_buffer(RecordingThreads.command_pool(i, thread));
+			}
+		}
+
+		if (InstancedObjects.instance_count() > 0) {
+			frame.instanceCommandBuffer = allocate_secondary_command_buffer(frame.commandPool);
+			frame.secondaryCommandBuffers.push_back(frame.instanceCommandBuffer);
+		}
+
+		if (Particles.is_enabled()) {
+			frame.particleCommandBuffer = allocate_secondary_command_buffer(frame.commandPool);
+			frame.secondaryCommandBuffers.push_back(frame.particleCommandBuffer);
+		}
+
+		if (SpriteCount > 0) {
+			frame.spriteCommandBuffer = allocate_secondary_command_buffer(frame.commandPool);
+			frame.secondaryCommandBuffers.push_back(frame.spriteCommandBuffer);
+		}
+
+		if (particles_simulated_async()) {
+			VkCommandPoolCreateInfo computePoolCreateInfo = {};
+			computePoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			computePoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			computePoolCreateInfo.queueFamilyIndex = queueFamilyIndices.computeFamily;
+
+			if (vkCreateCommandPool(Device, &computePoolCreateInfo, nullptr, &frame.computeCommandPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create frame compute command pool");
+			}
+
+			VkCommandBufferAllocateInfo computeAllocateInfo = {};
+			computeAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			computeAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			computeAllocateInfo.commandPool = frame.computeCommandPool;
+			computeAllocateInfo.commandBufferCount = 1;
+
+			if (vkAllocateCommandBuffers(Device, &computeAllocateInfo, &frame.computeCommandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create particle simulation command buffer");
+			}
+		}
+
+		frame.descriptorAllocator.create(FrameDescriptorSetsPerPool);
 	}
 
-	std::cout << "Created " << Framebuffers.size() << " framebuffers" << std::endl;
+	LOG_INFO("Command buffers created for {} frame(s), recorded every frame on {} thread(s)", Frames.frames.size(), threadCount);
 }
 
-void create_command_pool()
+VkCommandBuffer begin_single_time_commands(VkCommandPool commandPool)
 {
-	auto queueFamilyIndices = get_queue_family_indices(PhysicalDevice);
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandPool = commandPool;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(Device, &allocateInfo, &commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Could not allocate single time command buffer");
+	}
 
-	VkCommandPoolCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	createInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	if (vkCreateCommandPool(Device, &createInfo, nullptr, &CommandPool) != VK_SUCCESS) {
-		std::runtime_error("Failed to create graphics command pool");
-	}
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
-	std::cout << "Command pool created" << std::endl;
+	return commandBuffer;
 }
 
-void create_command_buffers()
+void end_single_time_commands(VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer)
 {
-	CommandBuffers.resize(Framebuffers.size());
+	vkEndCommandBuffer(commandBuffer);
 
-	VkCommandBufferAllocateInfo bufferAllocateInfo = {};
-	bufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	bufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	bufferAllocateInfo.commandPool = CommandPool;
-	bufferAllocateInfo.commandBufferCount = (uint32_t) CommandBuffers.size();
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
 
-	if (vkAllocateCommandBuffers(Device, &bufferAllocateInfo, CommandBuffers.data()) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create command buffers");
+	if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("Could not submit single time command buffer");
 	}
+	vkQueueWaitIdle(queue);
 
-	std::cout << "Command buffers created" << std::endl;
+	vkFreeCommandBuffers(Device, commandPool, 1, &commandBuffer);
+}
+
+void end_transfer_commands(VkCommandBuffer transferCommandBuffer, VkCommandBuffer acquireCommandBuffer)
+{
+	if (acquireCommandBuffer == VK_NULL_HANDLE) {
+		end_single_time_commands(TransferCommandPool, TransferQueue, transferCommandBuffer);
+		return;
+	}
 
-	for (size_t i = 0; i < CommandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo bufferBeginInfo = {};
-		bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	vkEndCommandBuffer(transferCommandBuffer);
+	vkEndCommandBuffer(acquireCommandBuffer);
 
-		vkBeginCommandBuffer(CommandBuffers[i], &bufferBeginInfo);
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		VkRenderPassBeginInfo beginRenderPassInfo = {};
-		beginRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		beginRenderPassInfo.renderPass = RenderPass;
-		beginRenderPassInfo.framebuffer = Framebuffers[i];
-		beginRenderPassInfo.renderArea.offset = { 0, 0 };
-		beginRenderPassInfo.renderArea.extent = SurfaceExtent;
-		
-		VkClearValue clearValue = { 0.0f, 0.0f, 0.0f, 1.0f};
-		beginRenderPassInfo.clearValueCount = 1;
-		beginRenderPassInfo.pClearValues = &clearValue;
+	VkSemaphore transferFinished;
+	if (vkCreateSemaphore(Device, &semaphoreCreateInfo, nullptr, &transferFinished) != VK_SUCCESS) {
+		throw std::runtime_error("Could not create transfer semaphore");
+	}
 
-		vkCmdBeginRenderPass(CommandBuffers[i], &beginRenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	VkSubmitInfo transferSubmitInfo = {};
+	transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	transferSubmitInfo.commandBufferCount = 1;
+	transferSubmitInfo.pCommandBuffers = &transferCommandBuffer;
+	transferSubmitInfo.signalSemaphoreCount = 1;
+	transferSubmitInfo.pSignalSemaphores = &transferFinished;
 
-		vkCmdBindPipeline(CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, Pipeline);
+	if (vkQueueSubmit(TransferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("Could not submit transfer command buffer");
+	}
 
-		vkCmdDraw(CommandBuffers[i], 3, 1, 0, 0);
+	// the acquire barriers carry the real dependency, this only has to hold them back until the release has executed
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 
-		vkCmdEndRenderPass(CommandBuffers[i]);
+	VkSubmitInfo acquireSubmitInfo = {};
+	acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	acquireSubmitInfo.waitSemaphoreCount = 1;
+	acquireSubmitInfo.pWaitSemaphores = &transferFinished;
+	acquireSubmitInfo.pWaitDstStageMask = &waitStage;
+	acquireSubmitInfo.commandBufferCount = 1;
+	acquireSubmitInfo.pCommandBuffers = &acquireCommandBuffer;
 
-		if (vkEndCommandBuffer(CommandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to record command buffers");
-		}
+	if (vkQueueSubmit(GraphicsQueue, 1, &acquireSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("Could not submit acquire command buffer");
 	}
+	vkQueueWaitIdle(GraphicsQueue);
+
+	vkDestroySemaphore(Device, transferFinished, nullptr);
+	vkFreeCommandBuffers(Device, TransferCommandPool, 1, &transferCommandBuffer);
+	vkFreeCommandBuffers(Device, CommandPool, 1, &acquireCommandBuffer);
+}
+
+void record_buffer_release(VkCommandBuffer commandBuffer, const Buffer& buffer, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags srcStage, VkAccessFlags srcAccess)
+{
+	if (srcFamily == dstFamily) return;
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = 0;
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.buffer = buffer.buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr, 1, &barrier, 0, nullptr);
+}
 
-	std::cout << "Command buffers recorded" << std::endl;
+void record_buffer_acquire(VkCommandBuffer commandBuffer, const Buffer& buffer, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	if (srcFamily == dstFamily) return;
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.buffer = buffer.buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+		0, nullptr, 1, &barrier, 0, nullptr);
 }
 
-void create_semaphores()
+void create_sync_objects()
 {
+	TRACE_ZONE("create_sync_objects");
+
+	if (FramesInFlight == 0) {
+		throw std::runtime_error("Need at least one frame in flight");
+	}
+
 	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	if ((vkCreateSemaphore(Device, &semaphoreCreateInfo, nullptr, &ImageAvailableSemaphore) ||
-		vkCreateSemaphore(Device, &semaphoreCreateInfo, nullptr, &RenderFinishSemaphore)) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create semaphores");
+	// created signalled so the first wait on each frame doesn't block forever
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	Frames.frames.resize(FramesInFlight);
+	Frames.imagesInFlight.assign(ImageViews.size(), VK_NULL_HANDLE);
+	Frames.currentFrame = 0;
+
+	for (auto& frame : Frames.frames) {
+		if ((vkCreateSemaphore(Device, &semaphoreCreateInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS) ||
+			(vkCreateSemaphore(Device, &semaphoreCreateInfo, nullptr, &frame.renderFinishSemaphore) != VK_SUCCESS) ||
+			(vkCreateFence(Device, &fenceCreateInfo, nullptr, &frame.inFlightFence) != VK_SUCCESS)) {
+			throw std::runtime_error("Failed to create frame synchronisation objects");
+		}
+
+		if (particles_simulated_async()) {
+			if ((vkCreateSemaphore(Device, &semaphoreCreateInfo, nullptr, &frame.simulationFinishSemaphore) != VK_SUCCESS) ||
+				(vkCreateSemaphore(Device, &semaphoreCreateInfo, nullptr, &frame.particlesReleasedSemaphore) != VK_SUCCESS)) {
+				throw std::runtime_error("Failed to create particle simulation semaphores");
+			}
+		}
 	}
 
-	std::cout << "Semaphores created" << std::endl;
+	LOG_DEBUG("Synchronisation objects created for {} frame(s) in flight", FramesInFlight);
 }
 
 // Queries
@@ -564,10 +1070,15 @@ bool check_validation_layers() {
 }
 
 std::vector<const char*> get_required_instance_extensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    std::vector<const char*> extensions;
+
+    // GLFW isn't initialised when headless, and the surface extensions it asks for aren't needed
+    if (!Headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (EnableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
@@ -576,70 +1087,253 @@ std::vector<const char*> get_required_instance_extensions() {
     return extensions;
 }
 
-bool check_device_extension_support(VkPhysicalDevice device)
+std::vector<const char*> get_required_device_extensions()
+{
+	std::vector<const char*> extensions;
+
+	if (!Headless) {
+		extensions.insert(extensions.end(), Extensions.begin(), Extensions.end());
+	}
+
+	return extensions;
+}
+
+DeviceCapabilities query_device_capabilities(VkPhysicalDevice device)
 {
+	DeviceCapabilities capabilities;
+	capabilities.device = device;
+
+	vkGetPhysicalDeviceProperties(device, &capabilities.properties);
+	vkGetPhysicalDeviceFeatures(device, &capabilities.features);
+	vkGetPhysicalDeviceMemoryProperties(device, &capabilities.memoryProperties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+	capabilities.queueFamilies.resize(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, capabilities.queueFamilies.data());
+
 	uint32_t extensionCount = 0;
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	capabilities.extensions.resize(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, capabilities.extensions.data());
+
+	capabilities.queueFamilyIndices = get_queue_family_indices(capabilities);
+
+	if (!Headless) {
+		capabilities.surfaceSupport = get_swap_chain_support_details(device, Surface);
+	}
+
+	for (uint32_t i = 0; i < capabilities.memoryProperties.memoryHeapCount; i++) {
+		const auto& heap = capabilities.memoryProperties.memoryHeaps[i];
+		if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			capabilities.deviceLocalBytes += heap.size;
+		}
+	}
+
+	capabilities.depthFormat = get_best_depth_format(device);
+
+	if (capabilities.has_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+		capabilities.descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		VkPhysicalDeviceFeatures2 features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &capabilities.descriptorIndexingFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		capabilities.descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &capabilities.descriptorIndexingProperties;
+		vkGetPhysicalDeviceProperties2(device, &properties);
+
+		// they'd point at the locals above once this returns
+		capabilities.descriptorIndexingFeatures.pNext = nullptr;
+		capabilities.descriptorIndexingProperties.pNext = nullptr;
+	}
+
+	return capabilities;
+}
+
+bool DeviceCapabilities::has_extension(std::string_view name) const
+{
+	return std::find_if(extensions.begin(), extensions.end(), [&name](const VkExtensionProperties& extension) {
+		return extension.extensionName == name;
+	}) != extensions.end();
+}
+
+bool DeviceCapabilities::supports_bindless() const
+{
+	return missing_bindless_capability() == nullptr;
+}
 
-	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+const char* DeviceCapabilities::missing_bindless_capability() const
+{
+	const auto& indexing = descriptorIndexingFeatures;
 
-	for (auto& requiredExtensionName : Extensions) {
-		std::string_view requiredExtensionNameView = requiredExtensionName;
+	if (!has_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) return VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+	if (!features.shaderStorageBufferArrayDynamicIndexing) return "shaderStorageBufferArrayDynamicIndexing";
+	if (!features.shaderSampledImageArrayDynamicIndexing) return "shaderSampledImageArrayDynamicIndexing";
+	if (!indexing.runtimeDescriptorArray) return "runtimeDescriptorArray";
+	if (!indexing.descriptorBindingPartiallyBound) return "descriptorBindingPartiallyBound";
+	if (!indexing.descriptorBindingStorageBufferUpdateAfterBind) return "descriptorBindingStorageBufferUpdateAfterBind";
+	if (!indexing.descriptorBindingSampledImageUpdateAfterBind) return "descriptorBindingSampledImageUpdateAfterBind";
 
-		bool notFound = std::find_if(availableExtensions.begin(), availableExtensions.end(),
-			[&requiredExtensionNameView](VkExtensionProperties extensionProperty) {
-			return extensionProperty.extensionName == requiredExtensionNameView;
-		}) == availableExtensions.end();
+	return nullptr;
+}
 
-		if (notFound) return false;
+bool check_device_extension_support(const DeviceCapabilities& capabilities)
+{
+	for (auto& requiredExtensionName : get_required_device_extensions()) {
+		if (!capabilities.has_extension(requiredExtensionName)) return false;
 	}
 
 	return true;
 }
 
-bool is_device_suitable(VkPhysicalDevice device) {
-    VkPhysicalDeviceProperties deviceProps;
-    vkGetPhysicalDeviceProperties(device, &deviceProps);
-    std::cout << "Testing suitability of device: " << deviceProps.deviceName << std::endl;
+bool is_device_suitable(const DeviceCapabilities& capabilities) {
+	if (capabilities.queueFamilyIndices.is_valid() && check_device_extension_support(capabilities)) {
+		if (Headless) return true;
 
-	if (get_queue_family_indices(device).is_valid() && check_device_extension_support(device)) {
-		auto swapChainDetails = get_swap_chain_support_details(device, Surface);
-		
-		return !swapChainDetails.formats.empty() && !swapChainDetails.presentationModes.empty();
+		return !capabilities.surfaceSupport.formats.empty() && !capabilities.surfaceSupport.presentationModes.empty();
 	}
 
 	return false;
 }
 
-QueueFamilyIndices get_queue_family_indices(VkPhysicalDevice device) {
-	QueueFamilyIndices queueFamilyIndices = {};
+uint64_t score_device(const DeviceCapabilities& capabilities)
+{
+	uint64_t typeRank = 0;
+	switch (capabilities.properties.deviceType) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		typeRank = 4;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		typeRank = 3;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		typeRank = 2;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU:
+		typeRank = 1;
+		break;
+	default:
+		break;
+	}
 
-    uint32_t availableQueueFamiliesCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &availableQueueFamiliesCount, nullptr);
-    std::cout << "Number of queue families for device: " << availableQueueFamiliesCount << std::endl;
+	// the device type always wins, then the amount of device local memory, then the largest supported render target
+	uint64_t deviceLocalMegabytes = std::min<uint64_t>(capabilities.deviceLocalBytes / (1024 * 1024), (1ull << 24) - 1);
+	uint64_t maxImageDimension = std::min<uint64_t>(capabilities.properties.limits.maxImageDimension2D, (1ull << 16) - 1);
 
-    std::vector<VkQueueFamilyProperties> availableQueueFamilies(availableQueueFamiliesCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &availableQueueFamiliesCount, availableQueueFamilies.data());
+	return (typeRank << 40) | (deviceLocalMegabytes << 16) | maxImageDimension;
+}
 
-    int i = 0;
-    for (const auto& queueFamily : availableQueueFamilies) {
-        if ((queueFamily.queueCount > 0) && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
-            queueFamilyIndices.graphicsFamily = i;
-        }
+const char* get_device_type_name(VkPhysicalDeviceType type)
+{
+	switch (type) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		return "discrete GPU";
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		return "integrated GPU";
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		return "virtual GPU";
+	case VK_PHYSICAL_DEVICE_TYPE_CPU:
+		return "CPU";
+	default:
+		return "other";
+	}
+}
+
+VkFormat get_best_depth_format(VkPhysicalDevice physicalDevice)
+{
+	// D16 has to be supported by every device, so there's always something to fall back to
+	const VkFormat candidates[] = {
+		VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM
+	};
+
+	for (VkFormat format : candidates) {
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			return format;
+		}
+	}
+
+	return VK_FORMAT_D16_UNORM;
+}
+
+bool is_pipeline_cache_compatible(const std::vector<char>& cacheData)
+{
+	// the header's layout is fixed by the spec, read field by field as older SDKs don't have a struct for it
+	const size_t headerBytes = 16 + VK_UUID_SIZE;
+	if (cacheData.size() < headerBytes) return false;
+
+	uint32_t headerSize = 0;
+	uint32_t headerVersion = 0;
+	uint32_t vendorID = 0;
+	uint32_t deviceID = 0;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+
+	std::memcpy(&headerSize, cacheData.data() + 0, sizeof(headerSize));
+	std::memcpy(&headerVersion, cacheData.data() + 4, sizeof(headerVersion));
+	std::memcpy(&vendorID, cacheData.data() + 8, sizeof(vendorID));
+	std::memcpy(&deviceID, cacheData.data() + 12, sizeof(deviceID));
+	std::memcpy(pipelineCacheUUID, cacheData.data() + 16, VK_UUID_SIZE);
+
+	const auto& deviceProps = PhysicalDeviceCapabilities.properties;
+
+	return (headerSize >= headerBytes) &&
+		(headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+		(vendorID == deviceProps.vendorID) &&
+		(deviceID == deviceProps.deviceID) &&
+		(std::memcmp(pipelineCacheUUID, deviceProps.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+}
+
+QueueFamilyIndices get_queue_family_indices(const DeviceCapabilities& capabilities) {
+	QueueFamilyIndices queueFamilyIndices = {};
+
+	// every family is looked at, the first one that fits is kept unless a later one fits better
+	for (int i = 0; i < (int) capabilities.queueFamilies.size(); i++) {
+		const auto& queueFamily = capabilities.queueFamilies[i];
+		if (queueFamily.queueCount == 0) continue;
+
+		bool graphics = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		bool compute = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+		bool transfer = (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0;
 
 		VkBool32 presentQueueSupported = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, Surface, &presentQueueSupported);
-		if (presentQueueSupported) {
+		if (!Headless) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(capabilities.device, i, Surface, &presentQueueSupported);
+		}
+
+		// presenting from the graphics family avoids sharing swap chain images between families
+		if (graphics && ((queueFamilyIndices.graphicsFamily < 0) ||
+			(presentQueueSupported && (queueFamilyIndices.graphicsFamily != queueFamilyIndices.presentFamily)))) {
+			queueFamilyIndices.graphicsFamily = i;
+		}
+
+		if (presentQueueSupported && ((queueFamilyIndices.presentFamily < 0) || (i == queueFamilyIndices.graphicsFamily))) {
 			queueFamilyIndices.presentFamily = i;
 		}
 
-		if (queueFamilyIndices.is_valid()) break;
+		// a transfer only family is usually the copy engine, which can stream data while the rest of the GPU renders
+		if (transfer && !graphics && !compute && (queueFamilyIndices.transferFamily < 0)) {
+			queueFamilyIndices.transferFamily = i;
+		}
+
+		if (compute && !graphics && (queueFamilyIndices.computeFamily < 0)) {
+			queueFamilyIndices.computeFamily = i;
+		}
+	}
 
-        i++;
-    }
-    
-    return queueFamilyIndices;
+	// graphics families always support compute and transfer too
+	if (queueFamilyIndices.transferFamily < 0) {
+		queueFamilyIndices.transferFamily = queueFamilyIndices.graphicsFamily;
+	}
+	if (queueFamilyIndices.computeFamily < 0) {
+		queueFamilyIndices.computeFamily = queueFamilyIndices.graphicsFamily;
+	}
+
+	return queueFamilyIndices;
 }
 
 // Cleanup
@@ -681,7 +1375,7 @@ VkSurfaceFormatKHR get_best_surface_format(const std::vector<VkSurfaceFormatKHR>
 		}
 	}
 
-	std::cout << "Device does not directly support preferred surface format, picking first one" << std::endl;
+	LOG_WARNING("Device does not directly support preferred surface format, picking first one");
 	return formats[0];
 }
 
@@ -700,7 +1394,7 @@ VkPresentModeKHR get_best_present_mode(const std::vector<VkPresentModeKHR>& pres
 		}
 	}
 
-	std::cout << "Using present mode " << chosenMode << std::endl;
+	LOG_INFO("Using present mode {}", chosenMode);
 	return chosenMode;
 }
 
@@ -723,28 +1417,162 @@ VkExtent2D get_best_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities,
 	}
 }
 
-void vulkan_cleanup() {
-    destroy_debug_report_callback_EXT(Instance, Callback);
+std::vector<VkImage> get_target_images()
+{
+	std::vector<VkImage> images;
 
-	vkDestroySemaphore(Device, ImageAvailableSemaphore, nullptr);
-	vkDestroySemaphore(Device, RenderFinishSemaphore, nullptr);
+	if (Headless) {
+		for (auto& offscreenImage : OffscreenImages) {
+			images.push_back(offscreenImage.image);
+		}
+	} else {
+		uint32_t imageCount = 0;
+		vkGetSwapchainImagesKHR(Device, SwapChain, &imageCount, nullptr);
 
-	vkDestroyCommandPool(Device, CommandPool, nullptr);
+		images.resize(imageCount);
+		vkGetSwapchainImagesKHR(Device, SwapChain, &imageCount, images.data());
+	}
+
+	return images;
+}
+
+uint32_t find_memory_type(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	const auto& memoryProperties = PhysicalDeviceCapabilities.memoryProperties;
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) &&
+			((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Could not find a suitable memory type");
+}
+
+void save_pipeline_cache()
+{
+	TRACE_ZONE("save_pipeline_cache");
 
-	for (auto& framebuffer : Framebuffers) {
-		vkDestroyFramebuffer(Device, framebuffer, nullptr);
+	if (PipelineCache == VK_NULL_HANDLE) return;
+
+	size_t cacheSize = 0;
+	vkGetPipelineCacheData(Device, PipelineCache, &cacheSize, nullptr);
+
+	std::vector<char> cacheData(cacheSize);
+	if (vkGetPipelineCacheData(Device, PipelineCache, &cacheSize, cacheData.data()) != VK_SUCCESS) {
+		LOG_WARNING("Failed to read back pipeline cache, not saving it");
+		return;
+	}
+
+	// write to the side and swap in, so a crash half way through can't leave a truncated cache behind
+	std::string temporaryFilename = PipelineCacheFilename + ".tmp";
+	std::ofstream file(temporaryFilename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		LOG_WARNING("Failed to open {} for writing", temporaryFilename);
+		return;
+	}
+
+	file.write(cacheData.data(), cacheSize);
+	file.close();
+
+	// a short write (a full disk, say) would swap a truncated cache in, so the old one is kept instead
+	if (file.fail()) {
+		LOG_WARNING("Failed to write {}, keeping the previous pipeline cache", temporaryFilename);
+		std::remove(temporaryFilename.c_str());
+		return;
+	}
+
+	if (std::rename(temporaryFilename.c_str(), PipelineCacheFilename.c_str()) != 0) {
+		LOG_WARNING("Failed to replace pipeline cache {}", PipelineCacheFilename);
+		return;
 	}
 
+	LOG_INFO("Saved {} bytes of pipeline cache to {}", cacheSize, PipelineCacheFilename);
+}
+
+void cleanup_swap_chain()
+{
+	// the framebuffers refer to the image views, and the transient images are sized to the swap chain
+	FrameGraph.destroy_targets();
+
 	for (auto& imageView : ImageViews) {
 		vkDestroyImageView(Device, imageView, nullptr);
 	}
+	ImageViews.clear();
+}
+
+void destroy_buffer(Buffer& buffer)
+{
+	vkDestroyBuffer(Device, buffer.buffer, nullptr);
+	Allocator.free(buffer.allocation);
+	buffer = Buffer();
+}
+
+void destroy_image(Image& image)
+{
+	vkDestroyImage(Device, image.image, nullptr);
+	Allocator.free(image.allocation);
+	image = Image();
+}
+
+void vulkan_cleanup() {
+    TRACE_ZONE("vulkan_cleanup");
+
+    destroy_debug_report_callback_EXT(Instance, Callback);
+
+	save_pipeline_cache();
+	vkDestroyPipelineCache(Device, PipelineCache, nullptr);
+	PipelineCache = VK_NULL_HANDLE;
+
+	for (auto& frame : Frames.frames) {
+		vkDestroySemaphore(Device, frame.imageAvailableSemaphore, nullptr);
+		vkDestroySemaphore(Device, frame.renderFinishSemaphore, nullptr);
+		vkDestroyFence(Device, frame.inFlightFence, nullptr);
+		frame.descriptorAllocator.destroy();
+		// frees the frame's primary command buffer, the secondaries go with the recording threads' pools
+		vkDestroyCommandPool(Device, frame.commandPool, nullptr);
+		vkDestroySemaphore(Device, frame.simulationFinishSemaphore, nullptr);
+		vkDestroySemaphore(Device, frame.particlesReleasedSemaphore, nullptr);
+		vkDestroyCommandPool(Device, frame.computeCommandPool, nullptr);
+	}
+	Frames.frames.clear();
+	Frames.imagesInFlight.clear();
+
+	cleanup_swap_chain();
+
+	Profiler.destroy();
+
+	destroy_upload_queue();
+	destroy_sprite_overlay();
+	destroy_particle_system();
+	destroy_instanced_objects();
+	destroy_object_data();
+	destroy_gpu_culling();
+
+	RecordingThreads.destroy();
+	vkDestroyCommandPool(Device, CommandPool, nullptr);
+	vkDestroyCommandPool(Device, TransferCommandPool, nullptr);
 
 	vkDestroyPipeline(Device, Pipeline, nullptr);
-	vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
-	vkDestroyRenderPass(Device, RenderPass, nullptr);
+	// PipelineLayout belongs to Bindless
+	destroy_bindless_descriptors();
+	destroy_render_graph();
+
+	for (auto& offscreenImage : OffscreenImages) {
+		destroy_image(offscreenImage);
+	}
+	OffscreenImages.clear();
 
 	vkDestroySwapchainKHR(Device, SwapChain, nullptr);
-	vkDestroySurfaceKHR(Instance, Surface, nullptr);
+	if (Surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(Instance, Surface, nullptr);
+	}
+
+	destroy_mesh(SceneMesh);
+
+	Allocator.print_statistics();
+	Allocator.destroy();
 
 	vkDestroyDevice(Device, nullptr);
     vkDestroyInstance(Instance, nullptr);
@@ -783,7 +1611,11 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
     const char* msg,
     void* userData) {
 
-    std::cerr << "validation layer: " << msg << std::endl;
+    if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) {
+        LOG_ERROR("Validation layer {}: {}", layerPrefix, msg);
+    } else {
+        LOG_WARNING("Validation layer {}: {}", layerPrefix, msg);
+    }
 
     return VK_FALSE;
 }
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/vec4.hpp>
+
+#include "mesh.hpp"
+
+// One vkCmdDrawIndexed of a range of a mesh's indices
+struct DrawCommand {
+	const Mesh* mesh = nullptr;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	// xyz centre and w radius, in the space the vertex shader outputs
+	glm::vec4 boundingSphere = glm::vec4(0.0f);
+	// what the draw is sorted by ahead of its depth, everything is drawn with Pipeline and has no material yet
+	uint16_t pipelineId = 0;
+	uint16_t materialId = 0;
+};
+
+// A fixed set of worker threads for recording command buffers. Command pools can't be used from two threads
+// at once, so each worker owns its own pool per frame in flight and only ever records into buffers allocated
+// from it. The pools are transient and reset wholesale each time their frame comes around.
+class RecordingThreadPool {
+public:
+	void create(uint32_t threadCount, uint32_t frameCount, uint32_t queueFamilyIndex);
+	void destroy();
+
+	// Runs job(threadIndex) on the first jobCount threads and waits for all of them to finish. An exception
+	// thrown by a job is rethrown here.
+	void run(uint32_t jobCount, const std::function<void(uint32_t)>& job);
+
+	uint32_t thread_count() const {
+		return (uint32_t) workers.size();
+	}
+
+	VkCommandPool command_pool(uint32_t frameIndex, uint32_t threadIndex) const {
+		return commandPools[frameIndex * workers.size() + threadIndex];
+	}
+
+private:
+	void worker_loop(uint32_t threadIndex);
+
+	std::vector<std::thread> workers;
+	// [frame * thread_count() + thread]
+	std::vector<VkCommandPool> commandPools;
+
+	std::mutex mutex;
+	std::condition_variable jobReady;
+	std::condition_variable jobDone;
+	const std::function<void(uint32_t)>* job = nullptr;
+	uint32_t jobCount = 0;
+	uint32_t pendingWorkers = 0;
+	uint64_t generation = 0;
+	std::exception_ptr jobError;
+	bool stopping = false;
+};
+
+// 0 picks one thread per hardware thread
+extern uint32_t RecordingThreadCount;
+extern RecordingThreadPool RecordingThreads;
+
+// How many draws SceneMesh is split into, to stand in for a scene with many objects
+extern uint32_t DrawCount;
+extern std::vector<DrawCommand> DrawList;
+// How many instances of every draw are drawn, they all land on top of each other
+extern uint32_t InstanceCount;
+
+void create_recording_threads();
+
+// vertices and indices are what mesh was created from, to bound each draw
+void build_draw_list(const Mesh& mesh, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	uint32_t drawCount);
+
+// The range of VisibleDraws a thread records when it's split jobCount ways
+void get_draw_range(uint32_t threadIndex, uint32_t jobCount, size_t& firstDraw, size_t& drawCount);
+
+// Begins a secondary command buffer to be executed inside RenderPass on framebuffer, with the viewport and scissor set
+void begin_secondary_commands(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, VkCommandBufferUsageFlags usage);
+
+// Records a secondary command buffer executed inside RenderPass on framebuffer, drawing VisibleDraws[firstDraw]
+// onwards
+void record_draws(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, VkCommandBufferUsageFlags usage,
+	size_t firstDraw, size_t drawCount);
+
+// Resets the frame's command pools and records its command buffers from scratch for the swap chain image.
+// The frame's fence must have been waited on.
+void record_frame(uint32_t frameIndex, uint32_t imageIndex);
+
+// Records the whole draw list with 1, 2, 4... up to every recording thread and prints how long each took
+void benchmark_recording(uint32_t iterations);
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec4.hpp>
+
+// Hands out memory aligned to a cache line, so the arrays of a SceneObjectStore start on one
+template<typename T>
+struct CacheAlignedAllocator {
+	using value_type = T;
+
+	static constexpr size_t Alignment = 64;
+
+	CacheAlignedAllocator() = default;
+
+	template<typename U>
+	CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+	T* allocate(size_t count) {
+		return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T* pointer, size_t) {
+		::operator delete(pointer, std::align_val_t(Alignment));
+	}
+
+	template<typename U>
+	bool operator==(const CacheAlignedAllocator<U>&) const {
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const CacheAlignedAllocator<U>&) const {
+		return false;
+	}
+};
+
+template<typename T>
+using CacheAlignedVector = std::vector<T, CacheAlignedAllocator<T>>;
+
+// Bounding spheres of the scene's objects as a structure of arrays, so a SIMD kernel loads the same component
+// of 4 or 8 objects at once rather than gathering it
+struct SceneObjectStore {
+	CacheAlignedVector<float> centreX;
+	CacheAlignedVector<float> centreY;
+	CacheAlignedVector<float> centreZ;
+	CacheAlignedVector<float> radius;
+
+	size_t size() const {
+		return radius.size();
+	}
+
+	void clear();
+	void reserve(size_t count);
+	// xyz centre and w radius
+	void add(const glm::vec4& boundingSphere);
+};
+
+enum class CullingKernel {
+	Scalar,
+	Sse,
+	Avx2
+};
+
+// Culls DrawList on the CPU every frame before it's recorded
+extern bool CpuCullingEnabled;
+// The best kernel the CPU supports unless overridden
+extern CullingKernel CpuCullingKernel;
+// Fewer objects than this are culled on the calling thread, handing them out costs more than it saves
+extern size_t ParallelCullingThreshold;
+// One per DrawList entry, built along with it
+extern SceneObjectStore SceneObjects;
+// Indices into DrawList of the draws recorded this frame, in order. All of them unless culling on the CPU.
+extern std::vector<uint32_t> VisibleDraws;
+
+bool is_culling_kernel_supported(CullingKernel kernel);
+
+CullingKernel get_best_culling_kernel();
+
+const char* get_culling_kernel_name(CullingKernel kernel);
+
+CullingKernel parse_culling_kernel(const std::string& name);
+
+// Writes the indices of the objects in [first, first + count) that aren't entirely outside any of planes to visible,
+// in order, and returns how many there were. visible must have room for count indices, all of which may be written.
+size_t cull_objects(CullingKernel kernel, const SceneObjectStore& objects, const glm::vec4 planes[6], size_t first,
+	size_t count, uint32_t* visible);
+
+// Culls every object, split between the first jobCount recording threads. visible ends up holding just the
+// indices of the objects that survived.
+void cull_scene(CullingKernel kernel, const SceneObjectStore& objects, const glm::vec4 planes[6], uint32_t jobCount,
+	std::vector<uint32_t>& visible);
+
+// Fills VisibleDraws with what's inside the frustum of CullingViewProjection
+void cull_draw_list();
+
+// Culls objectCount randomly placed objects with every supported kernel, on one and on every recording thread, and
+// prints how many objects each culled per millisecond
+void benchmark_culling(size_t objectCount, uint32_t iterations);
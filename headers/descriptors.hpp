@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "memory-allocator.hpp"
+
+// One descriptor set holding every storage buffer and sampled image the renderer uses, in large arrays that
+// shaders index into with a number passed in push constants. Every pipeline shares the one layout, so the set is
+// bound once per command buffer and nothing is bound per draw. Slots are written as resources are registered,
+// even while the set is bound by frames in flight (update after bind), and unregistered slots are left empty
+// (partially bound).
+struct BindlessDescriptors {
+	// set 1 is for whatever a frame allocates from its DescriptorAllocator
+	static constexpr uint32_t DrawSet = 1;
+
+	static constexpr uint32_t SampledImageBinding = 0;
+	static constexpr uint32_t StorageBufferBinding = 1;
+	// what's asked for, capped by what the device can do
+	static constexpr uint32_t MaxSampledImages = 16384;
+	static constexpr uint32_t MaxStorageBuffers = 65536;
+	// every device has at least this much push constant space
+	static constexpr uint32_t PushConstantBytes = 128;
+	// push constants are visible to every stage, which means every push has to say so
+	static constexpr VkShaderStageFlags PushConstantStages = VK_SHADER_STAGE_ALL;
+
+	uint32_t sampledImageCapacity = 0;
+	uint32_t storageBufferCapacity = 0;
+
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	// DrawSet, a single dynamic uniform buffer with per draw data
+	VkDescriptorSetLayout drawSetLayout = VK_NULL_HANDLE;
+	// set 0 is the bindless set and set 1 is a draw set, followed by PushConstantBytes of push constants
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+
+	// slots handed back, reused before any that haven't been handed out yet
+	std::vector<uint32_t> freeSampledImages;
+	std::vector<uint32_t> freeStorageBuffers;
+	uint32_t nextSampledImage = 0;
+	uint32_t nextStorageBuffer = 0;
+
+	// Returns the index shaders find the buffer at. Only with BindlessEnabled.
+	uint32_t register_storage_buffer(const Buffer& buffer);
+	uint32_t register_sampled_image(VkImageView view, VkSampler sampler);
+	// Nothing the GPU has still to run may use the slot
+	void release_storage_buffer(uint32_t index);
+	void release_sampled_image(uint32_t index);
+
+	// Does nothing without BindlessEnabled, there's no set to bind
+	void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint) const;
+	void push_constants(VkCommandBuffer commandBuffer, const void* data, uint32_t size) const;
+};
+
+// Hands out descriptor sets that only live for a frame. Sets are carved linearly out of a pool, moving to a new pool
+// when one fills up, and resetting throws all of them away at once, so nothing is ever freed individually.
+class DescriptorAllocator {
+public:
+	void create(uint32_t setsPerPool);
+	void destroy();
+
+	// Everything allocated since the last reset is gone afterwards, the frame's fence must have been waited on
+	void reset();
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+	uint32_t pool_count() const {
+		return (uint32_t) (usedPools.size() + freePools.size());
+	}
+
+private:
+	VkDescriptorPool take_pool();
+
+	uint32_t setsPerPool = 0;
+	VkDescriptorPool currentPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPool> usedPools;
+	std::vector<VkDescriptorPool> freePools;
+};
+
+extern BindlessDescriptors Bindless;
+// Set by create_logical_device. Without it Bindless' set 0 is empty and only its pipeline layout and draw set are
+// usable, anything registering resources with it has to stay off.
+extern bool BindlessEnabled;
+// How many sets each pool of a frame's DescriptorAllocator has room for
+extern uint32_t FrameDescriptorSetsPerPool;
+
+void create_bindless_descriptors();
+
+void destroy_bindless_descriptors();
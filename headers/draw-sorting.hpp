@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// A draw and the key it's ordered by. Keys pack the pipeline into the top 16 bits, the material into the next 16
+// and the depth into the bottom 32, so sorting them groups draws by state first and front to back within that.
+struct SortedDraw {
+	uint64_t key;
+	uint32_t draw;
+};
+
+// Orders VisibleDraws front to back before recording, so the depth test rejects occluded fragments before
+// they're shaded
+extern bool DrawSortingEnabled;
+
+// depth is expected to be in 0 to 1, anything below is clamped to 0
+uint64_t make_draw_sort_key(uint16_t pipelineId, uint16_t materialId, float depth);
+
+// Stable least significant digit radix sort, a byte at a time. Bytes every key has in common are skipped, so with
+// a single pipeline and material only the depth is sorted. scratch is resized to match draws.
+void radix_sort_draws(std::vector<SortedDraw>& draws, std::vector<SortedDraw>& scratch);
+
+// Sorts VisibleDraws by the depth of their bounding spheres' centres under CullingViewProjection
+void sort_visible_draws();
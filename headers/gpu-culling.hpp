@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "memory-allocator.hpp"
+#include "mesh.hpp"
+
+// Matches the std430 layout of DrawObject in cull.comp, one per entry of DrawList
+struct CullingObject {
+	glm::vec4 boundingSphere;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t padding[2];
+};
+
+// Pushed to cull.comp every frame
+struct CullingConstants {
+	// facing inwards and normalised, so a sphere is outside when its centre is more than its radius behind one
+	glm::vec4 frustumPlanes[6];
+	uint32_t objectCount;
+	uint32_t instanceCount;
+	// appends the visible draws and counts them, rather than zeroing the instance count of culled draws in place
+	uint32_t compact;
+	// Bindless storage buffer indices
+	uint32_t objectBuffer;
+	uint32_t drawBuffer;
+	uint32_t drawCountBuffer;
+};
+
+// The draw list lives on the GPU. A compute pass tests every object's bounding sphere against the frustum and writes
+// the draws of the visible ones into an indirect buffer, which the scene pass then draws from with a single call, so
+// nothing per object is touched on the CPU after creation. The buffers are shared by the frames in flight, FrameGraph's
+// barriers keep the draw of one frame and the culling of the next apart.
+struct GpuCulling {
+	static constexpr uint32_t WorkgroupSize = 64;
+
+	// one indirect draw can only bind one vertex and index buffer, so every object has to be of this mesh
+	const Mesh* mesh = nullptr;
+	uint32_t objectCount = 0;
+
+	Buffer objectBuffer;
+	// a VkDrawIndexedIndirectCommand per object
+	Buffer drawBuffer;
+	// a single uint32_t, how many of the commands in drawBuffer are valid when compacting
+	Buffer drawCountBuffer;
+	// where Bindless has each of them
+	uint32_t objectBufferIndex = 0;
+	uint32_t drawBufferIndex = 0;
+	uint32_t drawCountBufferIndex = 0;
+
+	// with Bindless.pipelineLayout
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	// null unless VK_KHR_draw_indirect_count and multiDrawIndirect are both enabled, in which case the draws are compacted
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+
+	bool is_enabled() const {
+		return objectCount > 0;
+	}
+
+	bool is_compacting() const {
+		return drawIndexedIndirectCount != nullptr;
+	}
+};
+
+// Draws DrawList through GpuCulling rather than recording it on the recording threads
+extern bool GpuCullingEnabled;
+// Set by create_logical_device, only ever enabled along with GpuCullingEnabled
+extern bool MultiDrawIndirectEnabled;
+extern bool DrawIndirectCountEnabled;
+// What's culled against. Identity, as the scene's vertex shader outputs its positions as they are.
+extern glm::mat4 CullingViewProjection;
+extern GpuCulling Culling;
+
+void create_gpu_culling();
+
+// Zeroes the draw count when compacting, before the culling of the same frame
+void record_draw_count_reset(VkCommandBuffer commandBuffer);
+
+// FrameGraph's culling pass, reads the objects and writes the draws and their count
+void record_gpu_culling(VkCommandBuffer commandBuffer);
+
+// Records into a secondary command buffer begun inside RenderPass, with Pipeline bound
+void record_culled_draws(VkCommandBuffer commandBuffer);
+
+void destroy_gpu_culling();
+
+// The planes of the volume viewProjection maps onto Vulkan's clip space (0 to 1 depth), in the order left, right,
+// bottom, top, near, far
+void extract_frustum_planes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// Rolling GPU time of one named scope over the last GpuProfiler::HistoryLength frames it was recorded in
+struct GpuScopeStatistics {
+	std::string name;
+	uint32_t sampleCount = 0;
+	double minMs = 0.0;
+	double averageMs = 0.0;
+	double maxMs = 0.0;
+	double p99Ms = 0.0;
+};
+
+struct GpuPipelineStatistics {
+	uint64_t inputAssemblyVertices = 0;
+	uint64_t inputAssemblyPrimitives = 0;
+	uint64_t vertexShaderInvocations = 0;
+	uint64_t clippingPrimitives = 0;
+	uint64_t fragmentShaderInvocations = 0;
+};
+
+// Times named scopes of the frame's command buffer with timestamp queries, and optionally counts the work done
+// with a pipeline statistics query. Every frame in flight has its own query pools, and their results are read
+// back the next time that frame is recorded, by which point its fence has been waited on, so reading them
+// never stalls at the cost of FramesInFlight frames of latency.
+class GpuProfiler {
+public:
+	static constexpr uint32_t MaxScopesPerFrame = 64;
+	static constexpr uint32_t HistoryLength = 240;
+	static constexpr uint32_t InvalidScope = ~0u;
+
+	void create(uint32_t frameCount, bool enablePipelineStatistics);
+	void destroy();
+
+	// False when the graphics queue can't write timestamps, every other call is then a no-op
+	bool is_enabled() const {
+		return enabled;
+	}
+
+	// Collects the results from the last time frameIndex was recorded and resets its queries. The frame's fence
+	// must have been waited on, and this has to be recorded before any scope and outside a render pass.
+	void begin_frame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+	// Scopes can nest, but can't begin or end inside a subpass whose contents are secondary command buffers
+	uint32_t begin_scope(VkCommandBuffer commandBuffer, const std::string& name);
+	void end_scope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	void begin_pipeline_statistics(VkCommandBuffer commandBuffer);
+	void end_pipeline_statistics(VkCommandBuffer commandBuffer);
+
+	// What secondary command buffers executed while pipeline statistics are active have to inherit
+	VkQueryPipelineStatisticFlags pipeline_statistic_flags() const;
+
+	std::vector<GpuScopeStatistics> get_scope_statistics() const;
+
+	const GpuPipelineStatistics& get_pipeline_statistics() const {
+		return lastPipelineStatistics;
+	}
+
+	void print_statistics() const;
+
+	// Forgets every sample so far, including those of frames still in flight
+	void reset_statistics();
+
+private:
+	struct FrameScope {
+		uint32_t history = 0;
+		uint32_t beginQuery = 0;
+		uint32_t endQuery = InvalidScope;
+	};
+
+	struct FrameQueries {
+		VkQueryPool timestampPool = VK_NULL_HANDLE;
+		VkQueryPool statisticsPool = VK_NULL_HANDLE;
+		std::vector<FrameScope> scopes;
+		uint32_t queryCount = 0;
+		bool statisticsWritten = false;
+		// recorded since the results were last collected
+		bool pending = false;
+	};
+
+	// ring of the latest samples of one scope
+	struct ScopeHistory {
+		std::string name;
+		std::vector<double> samples;
+		uint32_t nextSample = 0;
+	};
+
+	void collect_results(FrameQueries& frame);
+
+	bool enabled = false;
+	bool pipelineStatisticsEnabled = false;
+	double timestampPeriodNs = 1.0;
+	uint64_t timestampMask = ~0ull;
+
+	std::vector<FrameQueries> frames;
+	uint32_t currentFrame = 0;
+
+	std::vector<ScopeHistory> histories;
+	std::unordered_map<std::string, uint32_t> historyIndices;
+	GpuPipelineStatistics lastPipelineStatistics;
+};
+
+// Counting pipeline statistics needs the pipelineStatisticsQuery and inheritedQueries device features
+extern bool PipelineStatisticsEnabled;
+extern GpuProfiler Profiler;
+
+void create_gpu_profiler();
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/vec4.hpp>
+
+#include "memory-allocator.hpp"
+#include "mesh.hpp"
+
+// Pushed to instanced.vert for every batch, Bindless storage buffer indices of its attributes
+struct InstancePushConstants {
+	uint32_t transformBuffer;
+	uint32_t colorBuffer;
+	uint32_t materialBuffer;
+};
+
+// A range of a mesh drawn once per instance with a single draw. Instances are kept as a structure of arrays, every
+// attribute in its own tightly packed storage buffer that instanced.vert indexes with gl_InstanceIndex, so a shader
+// only reads the attributes it uses and nothing is padded out to the largest of them.
+class InstanceBatch {
+public:
+	// capacity is how many instances the GPU buffers have room for
+	void create(const Mesh& mesh, uint32_t firstIndex, uint32_t indexCount, uint32_t capacity);
+	void destroy();
+
+	// transform is an xyz translation and a uniform scale in w. Returns the instance's index, the GPU only sees it
+	// once uploaded.
+	uint32_t add(const glm::vec4& transform, const glm::vec4& color, uint32_t materialId);
+	void clear();
+
+	// Copies every attribute to its device local buffer and waits for it, nothing of the batch's may be in flight
+	void upload();
+
+	// Records into a secondary command buffer begun inside RenderPass, with InstancedPipeline bound
+	void record(VkCommandBuffer commandBuffer) const;
+
+	uint32_t instance_count() const {
+		return uploadedCount;
+	}
+
+private:
+	const Mesh* mesh = nullptr;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	uint32_t capacity = 0;
+	uint32_t uploadedCount = 0;
+
+	std::vector<glm::vec4> transforms;
+	// RGBA8
+	std::vector<uint32_t> colors;
+	std::vector<uint32_t> materialIds;
+
+	Buffer transformBuffer;
+	Buffer colorBuffer;
+	Buffer materialBuffer;
+	InstancePushConstants bufferIndices = {};
+};
+
+// How many instances of InstanceMesh are drawn in a grid over the scene in one draw, 0 turns them off
+extern uint32_t InstancedObjectCount;
+extern Mesh InstanceMesh;
+extern InstanceBatch InstancedObjects;
+// With Bindless.pipelineLayout
+extern VkPipeline InstancedPipeline;
+
+// After create_graphics_pipeline, as it needs RenderPass
+void create_instanced_objects();
+
+// Records into a secondary command buffer begun inside RenderPass
+void record_instanced_objects(VkCommandBuffer commandBuffer);
+
+void destroy_instanced_objects();
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+enum class LogLevel : uint8_t {
+	Debug = 0,
+	Info = 1,
+	Warning = 2,
+	Error = 3
+};
+
+// Calls below this level are compiled out, so their arguments aren't even evaluated. Defaults to debug in debug
+// builds and info otherwise, build with -DLOG_COMPILED_LEVEL=N to override.
+#ifndef LOG_COMPILED_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILED_LEVEL 1
+#else
+#define LOG_COMPILED_LEVEL 0
+#endif
+#endif
+
+// Calls that are compiled in but below this level return before capturing anything
+extern LogLevel MinimumLogLevel;
+
+enum class LogArgumentType : uint8_t {
+	Signed,
+	Unsigned,
+	Float,
+	Bool,
+	String
+};
+
+struct LogArgument {
+	LogArgumentType type;
+	// strings are copied into the record, so they don't have to outlive the call
+	uint16_t stringOffset;
+	uint16_t stringLength;
+	union {
+		int64_t signedValue;
+		uint64_t unsignedValue;
+		double floatValue;
+	};
+};
+
+// A log call as it sits in the ring, the message is only formatted once the logging thread picks it up
+struct LogRecord {
+	static constexpr uint32_t MaxArguments = 8;
+	static constexpr uint32_t StringCapacity = 872;
+
+	LogLevel level;
+	uint8_t argumentCount;
+	uint16_t stringSize;
+	uint64_t timeNs;
+	// must outlive the logger, the LOG_* macros only accept string literals
+	const char* format;
+	LogArgument arguments[MaxArguments];
+	char strings[StringCapacity];
+};
+
+// Starts the logging thread, until then (and after stop_logger()) messages are formatted and written on the calling thread
+void start_logger();
+
+// Writes out everything still queued and joins the logging thread, no other thread may be logging by then
+void stop_logger();
+
+LogLevel parse_log_level(const std::string& name);
+
+// Claims a record in the ring, blocking while it's full, and publishes it once its arguments have been captured
+LogRecord& begin_log_record(LogLevel level, const char* format);
+void end_log_record(LogRecord& record);
+
+inline void capture_log_string(LogRecord& record, std::string_view value) {
+	LogArgument& argument = record.arguments[record.argumentCount++];
+	argument.type = LogArgumentType::String;
+	argument.stringOffset = record.stringSize;
+	// long strings (validation messages mostly) are cut off rather than spilling into another record
+	argument.stringLength = (uint16_t) std::min<size_t>(value.size(), LogRecord::StringCapacity - record.stringSize);
+
+	std::memcpy(record.strings + record.stringSize, value.data(), argument.stringLength);
+	record.stringSize += argument.stringLength;
+}
+
+template<typename T>
+void capture_log_argument(LogRecord& record, const T& value) {
+	using Type = std::decay_t<T>;
+
+	if constexpr (std::is_same_v<Type, bool>) {
+		LogArgument& argument = record.arguments[record.argumentCount++];
+		argument.type = LogArgumentType::Bool;
+		argument.unsignedValue = value ? 1 : 0;
+	} else if constexpr (std::is_same_v<Type, char>) {
+		capture_log_string(record, std::string_view(&value, 1));
+	} else if constexpr (std::is_enum_v<Type>) {
+		capture_log_argument(record, static_cast<std::underlying_type_t<Type>>(value));
+	} else if constexpr (std::is_integral_v<Type> && std::is_signed_v<Type>) {
+		LogArgument& argument = record.arguments[record.argumentCount++];
+		argument.type = LogArgumentType::Signed;
+		argument.signedValue = value;
+	} else if constexpr (std::is_integral_v<Type>) {
+		LogArgument& argument = record.arguments[record.argumentCount++];
+		argument.type = LogArgumentType::Unsigned;
+		argument.unsignedValue = value;
+	} else if constexpr (std::is_floating_point_v<Type>) {
+		LogArgument& argument = record.arguments[record.argumentCount++];
+		argument.type = LogArgumentType::Float;
+		argument.floatValue = value;
+	} else if constexpr (std::is_array_v<T>) {
+		// fixed size buffers like VkPhysicalDeviceProperties::deviceName
+		capture_log_string(record, std::string_view(value, strnlen(value, std::extent_v<T>)));
+	} else if constexpr (std::is_pointer_v<Type>) {
+		static_assert(std::is_convertible_v<Type, const char*>, "Only C strings can be logged as pointers");
+		capture_log_string(record, value ? std::string_view(value) : std::string_view("(null)"));
+	} else {
+		static_assert(std::is_convertible_v<const T&, std::string_view>, "Type can't be logged");
+		capture_log_string(record, std::string_view(value));
+	}
+}
+
+// Every "{}" in format is replaced by the next argument
+template<typename... Arguments>
+void log_message(LogLevel level, const char* format, const Arguments&... arguments) {
+	static_assert(sizeof...(Arguments) <= LogRecord::MaxArguments, "Too many arguments for a single log record");
+
+	if (level < MinimumLogLevel) return;
+
+	LogRecord& record = begin_log_record(level, format);
+	(capture_log_argument(record, arguments), ...);
+	end_log_record(record);
+}
+
+// The "" forces the format to be a string literal, which is what lets the record keep just a pointer to it
+#if LOG_COMPILED_LEVEL <= 0
+#define LOG_DEBUG(format, ...) log_message(LogLevel::Debug, "" format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) ((void) 0)
+#endif
+
+#if LOG_COMPILED_LEVEL <= 1
+#define LOG_INFO(format, ...) log_message(LogLevel::Info, "" format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) ((void) 0)
+#endif
+
+#if LOG_COMPILED_LEVEL <= 2
+#define LOG_WARNING(format, ...) log_message(LogLevel::Warning, "" format, ##__VA_ARGS__)
+#else
+#define LOG_WARNING(format, ...) ((void) 0)
+#endif
+
+#define LOG_ERROR(format, ...) log_message(LogLevel::Error, "" format, ##__VA_ARGS__)
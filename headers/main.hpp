@@ -1,22 +1,5 @@
 #pragma once
 
-#define GLFW_INCLUDE_VULKAN
-#include <GLFW/glfw3.h>
+#include "renderer.hpp"
 
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#include <glm/vec4.hpp>
-#include <glm/mat4x4.hpp>
-
-#include "vulkan-utils.hpp"
-
-void init_window();
-
-void init_vulkan();
-
-void create_surface();
-
-void main_loop();
-
-void draw_frame();
-
-void cleanup();
+void parse_arguments(int argc, char** argv);
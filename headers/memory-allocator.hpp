@@ -0,0 +1,247 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <limits>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// What a range of device memory is used for. Linear and optimally tiled resources sharing a page of
+// bufferImageGranularity bytes can alias each other on some hardware, so the allocator keeps them apart.
+enum class AllocationType {
+	Free,
+	Buffer,
+	ImageLinear,
+	ImageOptimal
+};
+
+// A range of a memory block, either handed out or free. Ranges are linked in address order (physical)
+// and, when free, into the free list for their size class.
+struct TlsfNode {
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	AllocationType type = AllocationType::Free;
+
+	TlsfNode* previousPhysical = nullptr;
+	TlsfNode* nextPhysical = nullptr;
+
+	TlsfNode* previousFree = nullptr;
+	TlsfNode* nextFree = nullptr;
+
+	bool is_free() const {
+		return type == AllocationType::Free;
+	}
+};
+
+// Two level segregated fit (TLSF) bookkeeping for one VkDeviceMemory block. The first level splits free ranges
+// by power of two and the second level splits each power of two linearly, so finding a free range that fits
+// is a couple of bit scans rather than a walk over every free range.
+class TlsfBlockMetadata {
+public:
+	void init(VkDeviceSize size, VkDeviceSize bufferImageGranularity);
+	void destroy();
+
+	// Returns nullptr if there's no free range that fits. Only ranges ending at or before limit are accepted.
+	TlsfNode* allocate(VkDeviceSize size, VkDeviceSize alignment, AllocationType type,
+		VkDeviceSize limit = std::numeric_limits<VkDeviceSize>::max());
+	void free(TlsfNode* node);
+
+	VkDeviceSize size() const {
+		return blockSize;
+	}
+
+	VkDeviceSize used_bytes() const {
+		return usedBytes;
+	}
+
+	uint32_t allocation_count() const {
+		return allocationCount;
+	}
+
+	bool empty() const {
+		return allocationCount == 0;
+	}
+
+	VkDeviceSize largest_free_range() const;
+
+private:
+	static constexpr uint32_t SecondLevelLog2 = 5;
+	static constexpr uint32_t SecondLevelCount = 1 << SecondLevelLog2;
+	// all sizes below this share first level 0, split linearly
+	static constexpr uint32_t SmallSizeLog2 = 8;
+	static constexpr uint32_t FirstLevelCount = 64 - SmallSizeLog2 + 1;
+
+	void get_list_index(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel) const;
+	bool fits(const TlsfNode* node, VkDeviceSize size, VkDeviceSize alignment, AllocationType type,
+		VkDeviceSize limit, VkDeviceSize& offset) const;
+	bool is_granularity_conflict(AllocationType first, AllocationType second) const;
+	bool on_same_page(VkDeviceSize firstEnd, VkDeviceSize secondStart) const;
+
+	void insert_free(TlsfNode* node);
+	void remove_free(TlsfNode* node);
+	TlsfNode* split(TlsfNode* node, VkDeviceSize firstSize);
+	void merge_with_next(TlsfNode* node);
+
+	TlsfNode* create_node();
+	void release_node(TlsfNode* node);
+
+	VkDeviceSize blockSize = 0;
+	VkDeviceSize granularity = 1;
+	VkDeviceSize usedBytes = 0;
+	uint32_t allocationCount = 0;
+
+	uint64_t firstLevelBitmap = 0;
+	uint32_t secondLevelBitmaps[FirstLevelCount] = {};
+	TlsfNode* freeLists[FirstLevelCount][SecondLevelCount] = {};
+
+	TlsfNode* firstNode = nullptr;
+	std::vector<TlsfNode*> spareNodes;
+};
+
+// One vkAllocateMemory call, carved up between many resources
+struct MemoryBlock {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	uint32_t memoryTypeIndex = 0;
+	// host visible blocks stay mapped for their whole lifetime
+	void* mapped = nullptr;
+	// holds a single resource too big to share a block, released as soon as it's freed
+	bool dedicated = false;
+	TlsfBlockMetadata metadata;
+};
+
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;
+	uint32_t memoryTypeIndex = 0;
+
+	MemoryBlock* block = nullptr;
+	TlsfNode* node = nullptr;
+};
+
+struct Buffer {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	VkBufferUsageFlags usage = 0;
+	Allocation allocation;
+};
+
+struct Image {
+	VkImage image = VK_NULL_HANDLE;
+	Allocation allocation;
+};
+
+struct AllocatorStatistics {
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	// device memory held by the allocator
+	VkDeviceSize bytesAllocated = 0;
+	// device memory handed out to resources
+	VkDeviceSize bytesUsed = 0;
+	VkDeviceSize largestFreeRange = 0;
+	// 0 when all free memory is one contiguous range, approaching 1 as it splits into smaller pieces
+	float fragmentation = 0.f;
+};
+
+// Sub-allocates resources out of large per memory type blocks, so the number of vkAllocateMemory calls stays
+// far below maxMemoryAllocationCount and small resources don't each pay for a whole allocation's alignment.
+class MemoryAllocator {
+public:
+	void init(VkDevice device, const VkPhysicalDeviceProperties& deviceProps,
+		const VkPhysicalDeviceMemoryProperties& memoryProperties);
+	void destroy();
+
+	Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+		AllocationType type);
+	void free(Allocation& allocation);
+
+	// Makes host writes to a mapped allocation visible to the device, a no-op for coherent memory
+	void flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+
+	// Moves the given buffers into the fullest blocks (and towards the start of them) so emptied blocks can be
+	// released. The GPU must not be using any of the buffers, and anything referring to a moved buffer's handle
+	// (descriptor sets, recorded command buffers) has to be refreshed afterwards. Returns how many were moved.
+	uint32_t defragment(const std::vector<Buffer*>& buffers, VkCommandPool commandPool, VkQueue queue);
+
+	AllocatorStatistics get_statistics();
+	void print_statistics();
+
+private:
+	VkDeviceSize preferred_block_size(uint32_t memoryTypeIndex) const;
+	bool try_allocate(uint32_t memoryTypeIndex, const VkMemoryRequirements& requirements, AllocationType type,
+		Allocation& allocation);
+	MemoryBlock* create_block(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated);
+	void free_locked(Allocation& allocation);
+	void release_empty_blocks(uint32_t memoryTypeIndex);
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	VkDeviceSize bufferImageGranularity = 1;
+	VkDeviceSize nonCoherentAtomSize = 1;
+	uint32_t maxDeviceAllocationCount = 0;
+	uint32_t deviceAllocationCount = 0;
+
+	std::vector<std::unique_ptr<MemoryBlock>> blocks[VK_MAX_MEMORY_TYPES];
+	std::mutex mutex;
+};
+
+extern MemoryAllocator Allocator;
+
+// Fragments device local memory with a few hundred MB of buffers, compacts what's left with defragment() and prints
+// the allocator's statistics before and after
+void benchmark_defragmentation();
+
+struct TransientAllocation {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	// usually write combined, so it's best written front to back and never read
+	void* mapped = nullptr;
+};
+
+// Hands out short lived ranges of one persistently mapped buffer for data the CPU writes every frame.
+// Ranges are given out in order, wrapping around, and everything a frame used is given back in one go
+// once that frame's fence has been waited on.
+class TransientRingBuffer {
+public:
+	void create(VkDeviceSize capacity, VkBufferUsageFlags usage, uint32_t frameCount);
+	void destroy();
+
+	// Enough for frameCount frames in flight of up to frameBytes each. A frame's range can't wrap around the end, so
+	// a ring sized to exactly the frames in flight can be left with its free space split, and there's room for one more.
+	static VkDeviceSize capacity_for(VkDeviceSize frameBytes, uint32_t frameCount) {
+		return frameBytes * (frameCount + 1);
+	}
+
+	// The fence of the last frame that used frameIndex must have been waited on
+	void begin_frame(uint32_t frameIndex);
+	TransientAllocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+	// Like allocate, but returns false instead of throwing when the ring has no room
+	bool try_allocate(VkDeviceSize size, VkDeviceSize alignment, TransientAllocation& allocation);
+
+	// Gives back everything frameIndex used without starting a new frame, for users that find out a frame is done
+	// before they reuse its index. Frames still have to be released in the order they were begun.
+	void release_frame(uint32_t frameIndex);
+
+	VkBuffer buffer() const {
+		return ringBuffer.buffer;
+	}
+
+	VkDeviceSize capacity() const {
+		return ringBuffer.size;
+	}
+
+	VkDeviceSize used_bytes() const {
+		return usedBytes;
+	}
+
+private:
+	Buffer ringBuffer;
+	VkDeviceSize head = 0;
+	VkDeviceSize usedBytes = 0;
+	uint32_t currentFrame = 0;
+	std::vector<VkDeviceSize> frameUsage;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "memory-allocator.hpp"
+
+// How vertex buffers are laid out, handed to the pipeline as its vertex input state
+struct VertexLayout {
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+};
+
+struct Vertex {
+	glm::vec3 position;
+	glm::vec3 color;
+
+	static VertexLayout get_layout();
+};
+
+// Vertex and index data living in device local memory
+struct Mesh {
+	Buffer vertexBuffer;
+	Buffer indexBuffer;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+
+	uint32_t triangle_count() const {
+		return indexCount / 3;
+	}
+};
+
+// Number of triangles in the mesh drawn every frame, 1 is the original single triangle
+extern uint32_t MeshTriangleCount;
+extern Mesh SceneMesh;
+
+// Uploads through a staging buffer on the transfer queue, and waits for the buffers to be ready for graphics
+Mesh create_mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+// Builds a grid of triangles covering most of the screen, for measuring throughput with large meshes
+void create_triangle_grid(uint32_t triangleCount, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// Uploads the grid and splits it into DrawCount draws
+void create_scene_mesh();
+
+// Smallest sphere around the box bounding a range of indices, as xyz centre and w radius
+glm::vec4 compute_bounding_sphere(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	uint32_t firstIndex, uint32_t indexCount);
+
+void bind_mesh(VkCommandBuffer commandBuffer, const Mesh& mesh);
+
+void destroy_mesh(Mesh& mesh);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/mat4x4.hpp>
+
+#include "memory-allocator.hpp"
+
+// Matches the std140 layout of Object in singleTriangleUniforms.vert, and the push constants of singleTriangle.vert
+struct ObjectUniforms {
+	glm::mat4 model;
+};
+
+enum class ObjectDataPath {
+	// pushed before every draw, for payloads that fit in Bindless' push constants
+	PushConstants,
+	// written to ObjectUniformRing every frame and picked out per draw with a dynamic offset
+	UniformBuffer
+};
+
+// Where this frame's object data is in ObjectUniformRing, set by write_object_uniforms
+struct ObjectFrameData {
+	// Bindless' draw set, pointing at the ring, from the frame's DescriptorAllocator
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	uint32_t baseOffset = 0;
+	// sizeof(ObjectUniforms) rounded up to minUniformBufferOffsetAlignment
+	uint32_t stride = 0;
+};
+
+// One per entry of DrawList, in the space the vertex shader's positions are in
+extern std::vector<glm::mat4> ObjectTransforms;
+// Spins every object about its bounding sphere's centre, so the spheres culling and sorting use stay valid
+extern bool ObjectAnimationEnabled;
+// Asked for on the command line, create_object_data falls back to the uniform buffer when the payload doesn't fit
+extern ObjectDataPath ObjectData;
+// Every frame in flight's object data, host visible and mapped for as long as it lives
+extern TransientRingBuffer ObjectUniformRing;
+// For the frame being recorded, read by the recording threads
+extern ObjectFrameData FrameObjects;
+
+// After the draw list and GPU culling, and before the scene pipeline which depends on ObjectData
+void create_object_data();
+
+// Steps the animation, once per frame, without allocating
+void update_object_transforms();
+
+// Copies every object's data into the frame's range of ObjectUniformRing in one pass and points a new draw set at it.
+// The frame's fence must have been waited on. Does nothing when pushing.
+void write_object_uniforms(uint32_t frameIndex);
+
+// Records whatever the draw needs for its object to be used by the next draw call, with Pipeline bound
+void record_object_data(VkCommandBuffer commandBuffer, uint32_t drawIndex);
+
+void destroy_object_data();
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include "memory-allocator.hpp"
+#include "mesh.hpp"
+
+// Matches the std430 layout of Particle in particles.comp
+struct Particle {
+	glm::vec2 position;
+	glm::vec2 velocity;
+	glm::vec4 color;
+
+	static VertexLayout get_layout();
+};
+
+// Pushed to particles.comp for every dispatch
+struct ParticleSimulationConstants {
+	float deltaSeconds;
+	uint32_t particleCount;
+	// seeds every particle instead of stepping it
+	uint32_t initialise;
+	// Bindless storage buffer index of particleBuffer
+	uint32_t particleBuffer;
+};
+
+// Particles live in a single storage buffer that the compute shader steps in place every frame, and that's then
+// bound as a vertex buffer and drawn as points. With an async compute family the step is submitted to ComputeQueue
+// and the buffer changes hands between the two families twice a frame, otherwise it's a FrameGraph pass.
+struct ParticleSystem {
+	static constexpr uint32_t WorkgroupSize = 256;
+
+	Buffer particleBuffer;
+	uint32_t particleBufferIndex = 0;
+	uint32_t particleCount = 0;
+
+	// both with Bindless.pipelineLayout
+	VkPipeline computePipeline = VK_NULL_HANDLE;
+	VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+
+	bool is_enabled() const {
+		return particleCount > 0;
+	}
+};
+
+// How many particles are simulated and drawn every frame, 0 turns the particle system off
+extern uint32_t ParticleCount;
+// Fixed so runs are repeatable regardless of frame rate
+extern float ParticleTimeStep;
+extern ParticleSystem Particles;
+// Steps the particles on ComputeQueue when the device has an async compute family, so the step can overlap the
+// graphics work of the frame before
+extern bool AsyncComputeEnabled;
+
+struct FrameSync;
+
+// Whether the particles are stepped on ComputeQueue, known before create_particle_system so the graph and the frames
+// can be set up around it
+bool particles_simulated_async();
+
+void create_particle_system();
+
+// FrameGraph's simulation pass when the step isn't async
+void record_particle_simulation(VkCommandBuffer commandBuffer);
+
+// Async only. Records and submits the frame's step to ComputeQueue, signalling frame.simulationFinishSemaphore. It
+// waits on the particlesReleasedSemaphore of the frame before, so the frame's own submission has to follow straight
+// after and signal its particlesReleasedSemaphore.
+void submit_particle_simulation(FrameSync& frame);
+
+// Async only, around everything in the frame's primary command buffer. Take the buffer over from the compute family
+// for the draw and hand it back for the next step.
+void record_particle_acquire(VkCommandBuffer commandBuffer);
+void record_particle_release(VkCommandBuffer commandBuffer);
+
+// Records into a secondary command buffer begun inside RenderPass
+void record_particle_draw(VkCommandBuffer commandBuffer);
+
+void destroy_particle_system();
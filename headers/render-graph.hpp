@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "memory-allocator.hpp"
+
+// How a pass uses a resource, which decides the stages, accesses and image layout it's synchronised on
+enum class ResourceUsage {
+	ColorAttachment,
+	DepthAttachment,
+	// sampled in a fragment shader
+	FragmentShaderRead,
+	ComputeShaderRead,
+	ComputeShaderWrite,
+	ComputeShaderReadWrite,
+	VertexBufferRead,
+	IndirectBufferRead,
+	TransferWrite
+};
+
+enum class RenderGraphPassType {
+	// recorded inside a render pass built from its attachments
+	Graphics,
+	// recorded outside of any render pass, dispatches and transfers
+	Compute
+};
+
+struct RenderGraphAccess {
+	uint32_t resource = 0;
+	ResourceUsage usage = ResourceUsage::ColorAttachment;
+	// attachments only, cleared to clearValue when the pass begins rather than loaded
+	bool clear = false;
+	VkClearValue clearValue = {};
+};
+
+// What an access has to wait on, worked out from the accesses before it
+struct RenderGraphBarrier {
+	uint32_t resource = 0;
+	VkPipelineStageFlags srcStages = 0;
+	VkAccessFlags srcAccess = 0;
+	VkPipelineStageFlags dstStages = 0;
+	VkAccessFlags dstAccess = 0;
+	VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+struct RenderGraphResource {
+	std::string name;
+	bool isImage = false;
+	// owned outside the graph, otherwise a transient image the graph creates and that only lives within a frame
+	bool imported = false;
+
+	// images
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkImageAspectFlags aspect = 0;
+	// imported images are left in this layout at the end of the frame, and the passes writing them are never culled
+	VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	// one per image index for imported images, a single one for transient images
+	std::vector<VkImage> images;
+	std::vector<VkImageView> views;
+
+	// imported buffers, looked up when the frame is recorded so they can be created after the graph
+	const Buffer* buffer = nullptr;
+
+	// set by compile(), first and last of the passes that use it or -1 if none does
+	int32_t firstPass = -1;
+	int32_t lastPass = -1;
+	// transient images only, what every pass between them uses it for
+	VkImageUsageFlags usage = 0;
+	// images in the same group have lifetimes that don't overlap, so they share memory
+	uint32_t aliasGroup = 0;
+};
+
+struct RenderGraphPass {
+	std::string name;
+	RenderGraphPassType type = RenderGraphPassType::Compute;
+	std::vector<RenderGraphAccess> accesses;
+	// records the pass' commands for the frame in flight
+	std::function<void(VkCommandBuffer, uint32_t)> record;
+	// graphics passes whose commands are all in secondary command buffers
+	VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+	// counted in the profiler's pipeline statistics
+	bool pipelineStatistics = false;
+
+	// set by compile()
+	bool culled = false;
+	// recorded before the pass, a graphics pass' attachments are handled by its render pass instead
+	std::vector<RenderGraphBarrier> barriers;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	std::vector<uint32_t> attachments;
+	std::vector<VkClearValue> clearValues;
+	// one per image index when an attachment is imported with several images, set by create_targets()
+	std::vector<VkFramebuffer> framebuffers;
+
+	void use(uint32_t resource, ResourceUsage usage);
+	void clear(uint32_t resource, ResourceUsage usage, VkClearValue clearValue);
+};
+
+// A frame described as passes declaring the resources they use, in the order they run. Compiling it culls the passes
+// nothing visible depends on, works out every barrier and layout transition between the rest (including between the
+// end of one frame and the start of the next, as frames in flight share everything but the imported images), and
+// builds a render pass per graphics pass. Transient images that are never alive at the same time alias the same
+// memory, lazily allocated where the device has it and the image never leaves its render pass.
+class RenderGraph {
+public:
+	uint32_t import_image(const std::string& name, VkFormat format, VkImageAspectFlags aspect, VkImageLayout finalLayout);
+	uint32_t import_buffer(const std::string& name, const Buffer* buffer);
+	// sized to the extent given to create_targets()
+	uint32_t create_transient_image(const std::string& name, VkFormat format, VkImageAspectFlags aspect);
+
+	// The pass runs after every pass added before it. The reference is only good until the next pass is added.
+	// record only records the pass' own work, every barrier it needs comes from what it use()s, so anything it
+	// touches that another pass also does has to be declared.
+	RenderGraphPass& add_pass(const std::string& name, RenderGraphPassType type,
+		std::function<void(VkCommandBuffer, uint32_t)> record);
+
+	// After every resource and pass has been added, creates the render passes
+	void compile();
+
+	// The images and views of an imported image, one per image index, before create_targets()
+	void set_imported_images(uint32_t resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views);
+	// Creates the transient images and the framebuffers, again whenever the extent or the imported images change
+	void create_targets(VkExtent2D extent);
+	void destroy_targets();
+
+	// Records every pass that wasn't culled, each in its own profiler scope
+	void execute(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex);
+
+	void destroy();
+
+	uint32_t pass_count() const {
+		return (uint32_t) passes.size();
+	}
+
+	const RenderGraphPass& pass(uint32_t index) const {
+		return passes[index];
+	}
+
+	VkFramebuffer framebuffer(uint32_t passIndex, uint32_t imageIndex) const {
+		const auto& framebuffers = passes[passIndex].framebuffers;
+		return framebuffers[imageIndex % framebuffers.size()];
+	}
+
+private:
+	void cull_passes();
+	void assign_alias_groups();
+	void derive_barriers();
+	void create_render_pass(uint32_t passIndex, const std::vector<RenderGraphBarrier>& attachmentBarriers,
+		const std::vector<VkImageLayout>& finalLayouts);
+	void record_barriers(VkCommandBuffer commandBuffer, const RenderGraphPass& pass, uint32_t imageIndex);
+
+	std::vector<RenderGraphResource> resources;
+	std::vector<RenderGraphPass> passes;
+	uint32_t aliasGroupCount = 0;
+	VkExtent2D extent = {};
+	// one per alias group
+	std::vector<Allocation> transientAllocations;
+
+	// kept between frames so recording barriers doesn't allocate
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+};
+
+// Where the frame is recorded from, rebuilt along with the swap chain's images. Executed with Bindless bound for
+// compute, so compute passes only bind their pipeline.
+extern RenderGraph FrameGraph;
+// FrameGraph's pass drawing the scene, its render pass is RenderPass
+extern uint32_t ScenePass;
+
+// Adds the renderer's passes to FrameGraph and compiles it, which creates RenderPass
+void create_render_graph();
+
+// For the current ImageViews and SurfaceExtent
+void create_render_graph_targets();
+
+void destroy_render_graph();
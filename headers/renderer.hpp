@@ -0,0 +1,55 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <chrono>
+
+#include "vulkan-utils.hpp"
+
+// Accumulated over the lifetime of main_loop, used to judge how much the CPU ends up waiting on the GPU
+struct FrameStatistics {
+	uint64_t frameCount = 0;
+	double fenceWaitSeconds = 0.0;
+	double recordSeconds = 0.0;
+	double totalSeconds = 0.0;
+};
+
+// size of the window or offscreen targets the renderer starts with
+extern uint32_t InitialWidth;
+extern uint32_t InitialHeight;
+
+extern GLFWwindow* Window;
+extern bool FramebufferResized;
+
+// how many frames to render before exiting when there is no window to close
+extern uint64_t HeadlessFrameCount;
+
+extern FrameStatistics Statistics;
+
+void init_window();
+
+void init_vulkan();
+
+void create_surface();
+
+void main_loop();
+
+void draw_frame();
+
+void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
+
+void handle_window_resize();
+
+void print_frame_statistics();
+
+void cleanup();
+
+// For numeric command line values, throwing a runtime_error naming argument when value isn't a whole number that fits
+uint32_t parse_uint32_argument(const std::string& argument, const std::string& value);
+
+uint64_t parse_uint64_argument(const std::string& argument, const std::string& value);
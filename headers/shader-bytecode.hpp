@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A SPIR-V module compiled and embedded into the binary at build time, see cmake/embed-spirv.cmake
+struct EmbeddedShader {
+	const char* name;
+	const uint32_t* code;
+	size_t size;
+};
+
+// SPIR-V ready to be handed to vkCreateShaderModule. Embedded shaders point straight at their constexpr array,
+// shaders loaded from disk own their words so they're always correctly aligned.
+struct ShaderBytecode {
+	const uint32_t* embeddedCode = nullptr;
+	std::vector<uint32_t> loadedCode;
+	size_t size = 0;
+
+	const uint32_t* data() const {
+		return loadedCode.empty() ? embeddedCode : loadedCode.data();
+	}
+};
+
+// When set, shaders are loaded from <ShaderOverrideDirectory>/<name>.spv instead of using the embedded copies
+extern std::string ShaderOverrideDirectory;
+
+// Looks up a shader by its source file name, e.g. "singleTriangle.vert"
+ShaderBytecode get_shader_bytecode(const std::string& name);
+
+std::vector<uint32_t> read_shader_bytecode(const std::string& filename);
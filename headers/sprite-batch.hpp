@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/vec2.hpp>
+
+#include "memory-allocator.hpp"
+#include "mesh.hpp"
+#include "draw-sorting.hpp"
+
+// Matches the vertex inputs of sprite.vert
+struct SpriteVertex {
+	glm::vec2 position;
+	glm::vec2 uv;
+	// RGBA8
+	uint32_t color;
+	// Bindless sampled image index, or SpriteBatcher::NoTexture
+	uint32_t texture;
+
+	static VertexLayout get_layout();
+};
+
+// An axis aligned quad in clip space
+struct SpriteQuad {
+	glm::vec2 min;
+	glm::vec2 max;
+	glm::vec2 uvMin = glm::vec2(0.0f);
+	glm::vec2 uvMax = glm::vec2(1.0f);
+	uint32_t color = 0xffffffff;
+	uint32_t texture = 0xffffffff;
+	// what the batcher's add_pipeline returned, 0 is the one it's created with
+	uint16_t pipeline = 0;
+	// drawn in increasing order, and in the order they were added within a layer, pipeline and texture
+	uint16_t layer = 0;
+};
+
+// A run of sorted quads drawn with one pipeline
+struct SpriteDraw {
+	uint16_t pipeline;
+	uint32_t firstQuad;
+	uint32_t quadCount;
+};
+
+// Collects quads for a frame and streams them into a persistently mapped vertex ring. Quads are sorted by layer,
+// pipeline and texture, and a draw is only issued when the pipeline changes: textures are Bindless indices carried in
+// the vertices, so they never split a draw. Every quad shares one static index buffer.
+class SpriteBatcher {
+public:
+	static constexpr uint32_t NoTexture = 0xffffffff;
+
+	// pipeline is drawn with as pipeline 0, it has to use SpriteVertex and Bindless.pipelineLayout
+	void create(uint32_t maxQuadsPerFrame, uint32_t frameCount, VkPipeline pipeline);
+	void destroy();
+
+	// For quads that need different state, the batcher doesn't own it
+	uint16_t add_pipeline(VkPipeline pipeline);
+
+	// Forgets the last frame's quads. The fence of the last frame that used frameIndex must have been waited on.
+	void begin_frame(uint32_t frameIndex);
+	void add_quad(const SpriteQuad& quad);
+
+	// Sorts the quads, writes their vertices into the ring in one pass and works out the draws
+	void flush();
+
+	// Records into a secondary command buffer begun inside RenderPass, after flush()
+	void record(VkCommandBuffer commandBuffer) const;
+
+	uint32_t quad_count() const {
+		return (uint32_t) quads.size();
+	}
+
+	uint32_t draw_count() const {
+		return (uint32_t) draws.size();
+	}
+
+private:
+	uint32_t maxQuadsPerFrame = 0;
+	std::vector<VkPipeline> pipelines;
+
+	TransientRingBuffer vertexRing;
+	// two triangles per quad, for as many quads as a frame can have
+	Buffer indexBuffer;
+
+	// kept between frames so batching doesn't allocate once they've grown to fit
+	std::vector<SpriteQuad> quads;
+	std::vector<SortedDraw> sortedQuads;
+	std::vector<SortedDraw> sortScratch;
+	std::vector<SpriteDraw> draws;
+	// where flush() wrote this frame's vertices
+	VkDeviceSize vertexOffset = 0;
+};
+
+// How many quads are drawn over everything every frame as a stand in for a UI, 0 turns them off
+extern uint32_t SpriteCount;
+extern SpriteBatcher Sprites;
+
+// After create_graphics_pipeline, as it needs RenderPass
+void create_sprite_overlay();
+
+// Builds the frame's quads and flushes them. The frame's fence must have been waited on.
+void update_sprite_overlay(uint32_t frameIndex);
+
+void destroy_sprite_overlay();
+
+// Batches 1000, 10000 and 100000 quads and prints how many quads were batched per ms
+void benchmark_sprite_batching(uint32_t iterations);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <iosfwd>
+#include <cstdint>
+
+// When false (the default) a trace zone costs a single branch, and nothing is allocated
+extern bool TracingEnabled;
+
+// Starts the trace clock and enables tracing, should be called before any other threads are started
+void start_tracing();
+
+// Nanoseconds since start_tracing()
+uint64_t trace_now();
+
+// name must outlive the trace, string literals are expected
+void record_trace_event(const char* name, uint64_t startNs, uint64_t endNs);
+
+// Shown as the calling thread's name on the timeline
+void set_trace_thread_name(const std::string& name);
+
+// Writes everything recorded so far in the Chrome trace event format, which chrome://tracing and Perfetto can open
+void write_trace(const std::string& filename);
+
+// Writes text as a quoted JSON string, escaping anything that would end it early
+void write_json_string(std::ostream& stream, const char* text);
+
+// Records the time from construction to destruction as a zone on the calling thread's timeline
+class TraceZone {
+public:
+	explicit TraceZone(const char* name) : name(TracingEnabled ? name : nullptr) {
+		if (this->name) {
+			startNs = trace_now();
+		}
+	}
+
+	~TraceZone() {
+		if (name) {
+			record_trace_event(name, startNs, trace_now());
+		}
+	}
+
+	TraceZone(const TraceZone&) = delete;
+	TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t startNs = 0;
+};
+
+#define TRACE_ZONE_CONCAT_INNER(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_ZONE_CONCAT(traceZone, __LINE__)(name)
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "memory-allocator.hpp"
+
+// Which batch an upload went out in. Batches complete in the order they were submitted, so one ticket being complete
+// means every ticket before it is too.
+using UploadTicket = uint64_t;
+
+// Accumulated over the lifetime of the queue
+struct UploadStatistics {
+	uint64_t batchesSubmitted = 0;
+	uint64_t copiesSubmitted = 0;
+	uint64_t bytesSubmitted = 0;
+	uint64_t bytesCompleted = 0;
+	// uploads turned away because the staging ring or every batch was busy, to be tried again later
+	uint64_t uploadsDeferred = 0;
+};
+
+// Streams data to device local buffers and images through one persistently mapped staging ring, without the CPU ever
+// waiting on the GPU. Copies are gathered into a batch and recorded and submitted to TransferQueue together, with a
+// fence per batch that poll() checks to give its staging space back.
+//
+// When the transfer queue is a dedicated family, a finished batch's resources are handed over to the graphics family
+// by an acquire that poll() submits to GraphicsQueue, so the graphics queue never waits on the transfer queue either.
+// Otherwise TransferQueue is GraphicsQueue and a barrier at the end of the batch does the same job.
+//
+// An upload can be used by anything submitted to GraphicsQueue once its ticket is complete. Nothing may use the
+// destination while its upload is in flight, and on a dedicated transfer family the destination's contents outside
+// of what was uploaded aren't kept.
+class UploadQueue {
+public:
+	// returned instead of a ticket when there's no room right now, poll() and try again later
+	static constexpr UploadTicket NoTicket = 0;
+
+	// batchCount is how many batches can be in flight at once, each gets an equal share of the ring before it's
+	// submitted without waiting for submit()
+	void create(VkDeviceSize stagingCapacity, uint32_t batchCount);
+	// Waits for everything in flight
+	void destroy();
+
+	UploadTicket upload_buffer(const Buffer& buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// Writes the whole of mip 0, layer 0 of an image created with TRANSFER_DST usage. The image's previous contents
+	// are thrown away and it's left in finalLayout.
+	UploadTicket upload_image(const Image& image, VkExtent3D extent, VkImageAspectFlags aspect, const void* data,
+		VkDeviceSize size, VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// Submits the batch being gathered, if there's anything in it. Meant to be called once a frame, before the frame's
+	// own submission, so nothing waits more than a frame to go out.
+	void submit();
+
+	// Retires every batch the GPU has finished with, without blocking
+	void poll();
+
+	bool is_complete(UploadTicket ticket) const {
+		return ticket <= completedTicket;
+	}
+
+	// Blocks until a ticket this queue handed out is complete, for loading screens and shutdown rather than the frame
+	// loop
+	void wait(UploadTicket ticket);
+
+	const UploadStatistics& statistics() const {
+		return uploadStatistics;
+	}
+
+	bool is_created() const {
+		return !batches.empty();
+	}
+
+private:
+	enum class BatchState {
+		Free,
+		Gathering,
+		Transferring,
+		// only with a dedicated transfer family
+		Acquiring
+	};
+
+	struct PendingBufferCopy {
+		VkBuffer buffer;
+		VkBufferCopy region;
+		VkPipelineStageFlags dstStage;
+		VkAccessFlags dstAccess;
+	};
+
+	struct PendingImageCopy {
+		VkImage image;
+		VkBufferImageCopy region;
+		VkImageLayout finalLayout;
+		VkPipelineStageFlags dstStage;
+		VkAccessFlags dstAccess;
+	};
+
+	struct UploadBatch {
+		BatchState state = BatchState::Free;
+		UploadTicket ticket = NoTicket;
+		VkDeviceSize bytes = 0;
+
+		// reset whenever the batch is reused, like a frame's pool
+		VkCommandPool transferPool = VK_NULL_HANDLE;
+		VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+		VkFence transferFence = VK_NULL_HANDLE;
+
+		VkCommandPool acquirePool = VK_NULL_HANDLE;
+		VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+		VkFence acquireFence = VK_NULL_HANDLE;
+
+		// recorded together at submit() so each side is a single barrier
+		std::vector<PendingBufferCopy> bufferCopies;
+		std::vector<PendingImageCopy> imageCopies;
+	};
+
+	// Opens a batch to gather into if there isn't one, returns nullptr when every batch is busy
+	UploadBatch* gathering_batch();
+	// Copies data into the gathering batch's staging space, returns false when it doesn't fit
+	bool stage(const void* data, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& stagingOffset);
+	void record_transfer(UploadBatch& batch);
+	void submit_acquire(UploadBatch& batch);
+
+	TransientRingBuffer stagingRing;
+	VkDeviceSize batchBytesLimit = 0;
+	VkDeviceSize imageCopyAlignment = 1;
+	bool dedicatedTransfer = false;
+
+	std::vector<UploadBatch> batches;
+	// batches are used round robin, so the oldest one in flight is always the next one to gather into
+	uint32_t gatheringBatch = 0;
+	bool gathering = false;
+
+	UploadTicket nextTicket = 1;
+	UploadTicket completedTicket = NoTicket;
+
+	UploadStatistics uploadStatistics;
+};
+
+extern UploadQueue Uploads;
+
+// How many MB are streamed into a device local buffer every frame to keep Uploads busy, 0 turns it off
+extern uint32_t UploadStreamMegabytes;
+
+// After create_command_pool
+void create_upload_queue();
+
+// Queues the frame's share of the upload stream, if there's room for it
+void update_upload_stream();
+
+void destroy_upload_queue();
+
+// Streams 256 MB through Uploads in different sized pieces, then as 1024x1024 RGBA8 images, and prints the MB/s for
+// each
+void benchmark_uploads();
@@ -2,16 +2,37 @@
 
 #include <vector>
 #include <set>
-#include <iostream>
 #include <fstream>
 #include <string>
 #include <string_view>
 #include <algorithm>
 #include <cstring>
+#include <limits>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "shader-bytecode.hpp"
+#include "memory-allocator.hpp"
+#include "mesh.hpp"
+#include "particles.hpp"
+#include "instancing.hpp"
+#include "sprite-batch.hpp"
+#include "upload-queue.hpp"
+#include "gpu-culling.hpp"
+#include "cpu-culling.hpp"
+#include "draw-sorting.hpp"
+#include "descriptors.hpp"
+#include "object-transforms.hpp"
+#include "render-graph.hpp"
+#include "command-recording.hpp"
+#include "gpu-profiler.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
+
 #define VK_EXT_DEBUG_REPORT_EXTENSION_NAME "VK_EXT_debug_report"
 
 #ifdef NDEBUG
@@ -23,6 +44,9 @@
 
 extern VkDebugReportCallbackEXT Callback;
 
+// When set there is no window, surface or swap chain; frames are rendered into OffscreenImages instead
+extern bool Headless;
+
 extern VkInstance Instance;
 extern VkPhysicalDevice PhysicalDevice;
 extern VkDevice Device;
@@ -32,25 +56,86 @@ extern VkSurfaceFormatKHR SurfaceFormat;
 extern VkExtent2D SurfaceExtent;
 
 extern VkSwapchainKHR SwapChain;
+extern std::vector<Image> OffscreenImages;
 extern VkQueue GraphicsQueue;
 extern VkQueue PresentQueue;
+// Same as GraphicsQueue when the device has no dedicated transfer or async compute family
+extern VkQueue TransferQueue;
+extern VkQueue ComputeQueue;
 extern std::vector<VkImageView> ImageViews;
+// Turns the scene pipeline's depth test and writes off, the depth attachment is still there
+extern bool DepthTestEnabled;
+// The scene pass of FrameGraph, which owns it
 extern VkRenderPass RenderPass;
 extern VkPipeline Pipeline;
+// Bindless.pipelineLayout, which every pipeline shares
 extern VkPipelineLayout PipelineLayout;
 
-extern std::vector<VkFramebuffer> Framebuffers;
+extern VkPipelineCache PipelineCache;
+// whether PipelineCache was seeded from a valid file on disk
+extern bool PipelineCacheWarm;
+
+// for one off work like uploads, frames record from their own pools
 extern VkCommandPool CommandPool;
-extern std::vector<VkCommandBuffer> CommandBuffers;
+// For uploads submitted to TransferQueue
+extern VkCommandPool TransferCommandPool;
+
+// Synchronisation objects and command buffers owned by a single frame in flight
+struct FrameSync {
+	VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+	VkSemaphore renderFinishSemaphore = VK_NULL_HANDLE;
+	VkFence inFlightFence = VK_NULL_HANDLE;
+
+	// transient, reset every time the frame is recorded
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	// one per recording thread, allocated from that thread's pool for this frame, or just cullingCommandBuffer when
+	// culling on the GPU. Followed by instanceCommandBuffer when there are instanced objects, particleCommandBuffer
+	// when there are particles and spriteCommandBuffer when there are sprites, so they're all executed in one go.
+	std::vector<VkCommandBuffer> secondaryCommandBuffers;
+	// recorded on the thread submitting the frame, from commandPool
+	VkCommandBuffer cullingCommandBuffer = VK_NULL_HANDLE;
+	VkCommandBuffer instanceCommandBuffer = VK_NULL_HANDLE;
+	VkCommandBuffer particleCommandBuffer = VK_NULL_HANDLE;
+	VkCommandBuffer spriteCommandBuffer = VK_NULL_HANDLE;
+
+	// only when the particles are simulated async, the step is recorded into computeCommandBuffer and signals
+	// simulationFinishSemaphore for the frame, which signals particlesReleasedSemaphore for the next step
+	VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+	VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
+	VkSemaphore simulationFinishSemaphore = VK_NULL_HANDLE;
+	VkSemaphore particlesReleasedSemaphore = VK_NULL_HANDLE;
+
+	// sets that only live for the frame, thrown away when it's next recorded along with its command buffers
+	DescriptorAllocator descriptorAllocator;
+};
+
+// Tracks the frames the CPU is allowed to record/submit ahead of the GPU, and which of
+// those frames is currently rendering into each swap chain image
+struct FrameContext {
+	std::vector<FrameSync> frames;
+	std::vector<VkFence> imagesInFlight;
+	uint32_t currentFrame = 0;
+
+	FrameSync& current() {
+		return frames[currentFrame];
+	}
+
+	void advance() {
+		currentFrame = (currentFrame + 1) % frames.size();
+	}
+};
 
-extern VkSemaphore ImageAvailableSemaphore;
-extern VkSemaphore RenderFinishSemaphore;
+extern uint32_t FramesInFlight;
+extern FrameContext Frames;
 
 
 const std::vector<const char*> ValidationLayers = {
     "VK_LAYER_LUNARG_standard_validation"
 };
 
+const std::string PipelineCacheFilename = "pipeline.cache";
+
 const std::vector<const char*> Extensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
@@ -65,25 +150,66 @@ void pick_physical_device();
 
 void create_logical_device();
 
+void create_memory_allocator();
+
+Buffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+
+Image create_image(const VkImageCreateInfo& createInfo, VkMemoryPropertyFlags properties);
+
 void create_swap_chain(const uint32_t width, const uint32_t height);
 
+void recreate_swap_chain(const uint32_t width, const uint32_t height);
+
+void create_offscreen_targets(const uint32_t width, const uint32_t height);
+
 void create_image_views();
 
-void create_render_pass();
+void create_pipeline_cache();
+
+void create_graphics_pipeline(const VertexLayout& vertexLayout);
+
+// A pipeline for subpass 0 of RenderPass, the viewport and scissor are dynamic state. With depthTest fragments
+// behind what's already been drawn are rejected, and what's drawn writes its depth.
+VkPipeline build_graphics_pipeline(const std::string& vertexShaderName, const std::string& fragmentShaderName,
+	const VertexLayout& vertexLayout, VkPrimitiveTopology topology, VkPipelineLayout layout, bool depthTest);
 
-void create_graphics_pipeline();
+VkPipeline create_compute_pipeline(const std::string& shaderName, VkPipelineLayout layout);
 
-VkShaderModule create_shader_module(const std::vector<char>& shaderByteCode);
+VkDescriptorSetLayout create_descriptor_set_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
 
-std::vector<char> read_shader_bytecode(const std::string& filename);
+VkPipelineLayout create_pipeline_layout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+	const std::vector<VkPushConstantRange>& pushConstantRanges);
 
-void create_framebuffers();
+VkShaderModule create_shader_module(const ShaderBytecode& shaderByteCode);
 
 void create_command_pool();
 
 void create_command_buffers();
 
-void create_semaphores();
+// One secondary command buffer from commandPool, freed along with the pool
+VkCommandBuffer allocate_secondary_command_buffer(VkCommandPool commandPool);
+
+// For one off work like uploads and copies, the end call submits to queue and waits for it to finish
+VkCommandBuffer begin_single_time_commands(VkCommandPool commandPool);
+
+void end_single_time_commands(VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer);
+
+// Ends and submits a buffer begun from TransferCommandPool. When the transfer queue is a dedicated family,
+// acquireCommandBuffer (begun from CommandPool) is submitted to the graphics queue behind a semaphore so only the
+// GPU waits between them, and the CPU waits once for both. Otherwise acquireCommandBuffer must be VK_NULL_HANDLE.
+void end_transfer_commands(VkCommandBuffer transferCommandBuffer, VkCommandBuffer acquireCommandBuffer);
+
+// A queue family ownership transfer of a whole buffer is a release recorded on a queue of srcFamily followed by a
+// matching acquire on a queue of dstFamily. The release makes srcAccess writes available, the acquire makes them
+// visible to dstAccess, and the acquire's submission has to wait on the release's. Both are no-ops when the
+// families are the same, a regular barrier is needed then instead.
+void record_buffer_release(VkCommandBuffer commandBuffer, const Buffer& buffer, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags srcStage, VkAccessFlags srcAccess);
+
+void record_buffer_acquire(VkCommandBuffer commandBuffer, const Buffer& buffer, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+void create_sync_objects();
 
 // Queries
 
@@ -91,25 +217,84 @@ bool check_validation_layers();
 
 std::vector<const char*> get_required_instance_extensions();
 
-bool check_device_extension_support(VkPhysicalDevice device);
-
-bool is_device_suitable(VkPhysicalDevice device);
+std::vector<const char*> get_required_device_extensions();
 
 struct QueueFamilyIndices {
 	int graphicsFamily = -1;
 	int presentFamily = -1;
+	// fall back to graphicsFamily when the device has no family just for them
+	int transferFamily = -1;
+	int computeFamily = -1;
+
+	bool is_valid() const {
+		return (graphicsFamily >= 0) && (Headless || (presentFamily >= 0));
+	}
 
-	bool is_valid() {
-		return (graphicsFamily >= 0) && (presentFamily >= 0);
+	bool has_dedicated_transfer() const {
+		return transferFamily != graphicsFamily;
+	}
+
+	bool has_async_compute() const {
+		return computeFamily != graphicsFamily;
 	}
 };
-QueueFamilyIndices get_queue_family_indices(VkPhysicalDevice device);
 
 struct SwapChainSupportDetails {
 	VkSurfaceCapabilitiesKHR capabilities;
 	std::vector<VkSurfaceFormatKHR> formats;
 	std::vector<VkPresentModeKHR> presentationModes;
 };
+
+// Everything about a physical device needed to choose it and set it up, queried once per device by
+// pick_physical_device so nothing downstream has to go back to the driver for it
+struct DeviceCapabilities {
+	VkPhysicalDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties = {};
+	VkPhysicalDeviceFeatures features = {};
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	std::vector<VkQueueFamilyProperties> queueFamilies;
+	std::vector<VkExtensionProperties> extensions;
+	QueueFamilyIndices queueFamilyIndices;
+	// empty when headless. The surface capabilities follow the window, so the swap chain queries them again.
+	SwapChainSupportDetails surfaceSupport;
+	VkDeviceSize deviceLocalBytes = 0;
+	// the most precise format usable as a depth attachment
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+	// zeroed when the device doesn't have VK_EXT_descriptor_indexing, the pNext chains are cleared after the query
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT descriptorIndexingProperties = {};
+
+	bool has_extension(std::string_view name) const;
+
+	// Indexing into large, partially bound arrays of storage buffers and sampled images with non constant indices,
+	// and updating them after they've been bound
+	bool supports_bindless() const;
+	// The first thing supports_bindless() found missing, nullptr when there's nothing
+	const char* missing_bindless_capability() const;
+};
+// The capabilities of PhysicalDevice
+extern DeviceCapabilities PhysicalDeviceCapabilities;
+
+// Set to a device index or part of a device's name to use that device instead of the best scoring one
+const char* const DeviceOverrideVariable = "VK_RENDERER_DEVICE";
+
+DeviceCapabilities query_device_capabilities(VkPhysicalDevice device);
+
+bool check_device_extension_support(const DeviceCapabilities& capabilities);
+
+bool is_device_suitable(const DeviceCapabilities& capabilities);
+
+// Higher is better, only meaningful between suitable devices
+uint64_t score_device(const DeviceCapabilities& capabilities);
+
+const char* get_device_type_name(VkPhysicalDeviceType type);
+
+VkFormat get_best_depth_format(VkPhysicalDevice physicalDevice);
+
+bool is_pipeline_cache_compatible(const std::vector<char>& cacheData);
+
+QueueFamilyIndices get_queue_family_indices(const DeviceCapabilities& capabilities);
+
 SwapChainSupportDetails get_swap_chain_support_details(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
 
 VkSurfaceFormatKHR get_best_surface_format(const std::vector<VkSurfaceFormatKHR>& formats);
@@ -119,8 +304,21 @@ VkPresentModeKHR get_best_present_mode(const std::vector<VkPresentModeKHR>& pres
 VkExtent2D get_best_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities,
 	const uint32_t width, const uint32_t height);
 
+uint32_t find_memory_type(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+// The swap chain's images, or the offscreen targets when headless, in image index order
+std::vector<VkImage> get_target_images();
+
 // Cleanup
 
+void save_pipeline_cache();
+
+void cleanup_swap_chain();
+
+void destroy_buffer(Buffer& buffer);
+
+void destroy_image(Image& image);
+
 void vulkan_cleanup();
 
 // Extensions
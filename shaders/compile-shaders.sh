@@ -1,9 +1,14 @@
 #!/bin/bash
 
-GLSL_VALIDATOR_PATH="/c/VulkanSDK/1.1.70.0/Bin/glslangValidator.exe"
+# The build compiles and embeds the shaders itself, this is only needed to produce .spv files
+# for loading at runtime with --shader-dir
+
+GLSL_VALIDATOR_PATH="${GLSL_VALIDATOR_PATH:-glslangValidator}"
 
 echo "Using GLSL Validator at $GLSL_VALIDATOR_PATH"
 echo ""
 
-$GLSL_VALIDATOR_PATH -V ./*.vert
-$GLSL_VALIDATOR_PATH -V ./*.frag
\ No newline at end of file
+for shader in ./*.vert ./*.frag ./*.comp; do
+	[ -e "$shader" ] || continue
+	$GLSL_VALIDATOR_PATH -V "$shader" -o "$shader.spv"
+done
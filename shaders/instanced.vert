@@ -0,0 +1,43 @@
+#version 450
+#extension GL_ARB_seperate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+};
+
+layout(location = 0) out vec3 fragColor;
+
+// the bindless storage buffers, each holding one attribute of every instance in the batch
+layout(std430, set = 0, binding = 1) readonly buffer Transforms {
+	// xyz translation, w uniform scale
+	vec4 transforms[];
+} transformBuffers[];
+
+layout(std430, set = 0, binding = 1) readonly buffer Colors {
+	// RGBA8
+	uint colors[];
+} colorBuffers[];
+
+layout(std430, set = 0, binding = 1) readonly buffer Materials {
+	uint materialIds[];
+} materialBuffers[];
+
+layout(push_constant) uniform Instances {
+	uint transformBuffer;
+	uint colorBuffer;
+	uint materialBuffer;
+} instances;
+
+void main() {
+	vec4 transform = transformBuffers[instances.transformBuffer].transforms[gl_InstanceIndex];
+	vec4 color = unpackUnorm4x8(colorBuffers[instances.colorBuffer].colors[gl_InstanceIndex]);
+	uint materialId = materialBuffers[instances.materialBuffer].materialIds[gl_InstanceIndex];
+
+	gl_Position = vec4(inPosition * transform.w + transform.xyz, 1.0);
+	// there are no materials yet, odd ones are shaded darker so they can be told apart
+	fragColor = inColor * color.rgb * (((materialId & 1u) != 0u) ? 0.6 : 1.0);
+}
\ No newline at end of file
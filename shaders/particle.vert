@@ -0,0 +1,18 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec4 inColor;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+	float gl_PointSize;
+};
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+	gl_Position = vec4(inPosition, 0.0, 1.0);
+	// has to be written when drawing points
+	gl_PointSize = 1.0;
+	fragColor = inColor;
+}
\ No newline at end of file
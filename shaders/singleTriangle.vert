@@ -1,25 +1,20 @@
 #version 450
 #extension GL_ARB_seperate_shader_objects : enable
 
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
 out gl_PerVertex {
 	vec4 gl_Position;
 };
 
 layout(location = 0) out vec3 fragColor;
 
-vec2 triangleVerts[3] = vec2[] (
-	vec2(0.0, -0.5),
-	vec2(0.5, 0.5),
-	vec2(-0.5, 0.5)
-);
-
-vec3 triangleColors[3] = vec3[] (
-	vec3(1.0, 0.0, 0.0),
-	vec3(0.0, 1.0, 0.0),
-	vec3(0.0, 0.0, 1.0)
-);
+layout(push_constant) uniform Object {
+	mat4 model;
+} object;
 
 void main() {
-	gl_Position = vec4(triangleVerts[gl_VertexIndex], 0.0, 1.0);
-	fragColor = triangleColors[gl_VertexIndex];
+	gl_Position = object.model * vec4(inPosition, 1.0);
+	fragColor = inColor;
 }
\ No newline at end of file
@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_seperate_shader_objects : enable
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+};
+
+layout(location = 0) out vec3 fragColor;
+
+// the draw's element of the object uniform ring, picked out with a dynamic offset
+layout(std140, set = 1, binding = 0) uniform Object {
+	mat4 model;
+} object;
+
+void main() {
+	gl_Position = object.model * vec4(inPosition, 1.0);
+	fragColor = inColor;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec2 fragUv;
+layout(location = 1) in vec4 fragColor;
+layout(location = 2) flat in uint fragTexture;
+
+layout(location = 0) out vec4 outColor;
+
+// the bindless sampled images
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+// SpriteBatcher::NoTexture
+const uint NoTexture = 0xffffffffu;
+
+void main() {
+	outColor = fragColor;
+
+	// a draw can mix textures, so the index isn't uniform across it
+	if (fragTexture != NoTexture) {
+		outColor *= texture(textures[nonuniformEXT(fragTexture)], fragUv);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inUv;
+layout(location = 2) in vec4 inColor;
+layout(location = 3) in uint inTexture;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+};
+
+layout(location = 0) out vec2 fragUv;
+layout(location = 1) out vec4 fragColor;
+layout(location = 2) flat out uint fragTexture;
+
+void main() {
+	gl_Position = vec4(inPosition, 0.0, 1.0);
+	fragUv = inUv;
+	fragColor = inColor;
+	fragTexture = inTexture;
+}
\ No newline at end of file